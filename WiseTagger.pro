@@ -35,6 +35,30 @@ DEFINES +=                                           \
 
 CONFIG += c++14
 
+linux {
+    # batched prefetch reads, falls back to a thread pool without liburing
+    packagesExist(liburing) {
+        DEFINES += WISETAGGER_HAVE_IO_URING
+        LIBS += -luring
+    }
+}
+
+unix {
+    # native image decoders, Qt image plugins are used for missing ones
+    packagesExist(libjpeg) {
+        DEFINES += WISETAGGER_HAVE_LIBJPEG
+        LIBS += -ljpeg
+    }
+    packagesExist(libpng) {
+        DEFINES += WISETAGGER_HAVE_LIBPNG
+        LIBS += -lpng
+    }
+    packagesExist(libwebp) {
+        DEFINES += WISETAGGER_HAVE_LIBWEBP
+        LIBS += -lwebp
+    }
+}
+
 Debug:PRECOMPILED_HEADER += util/precompiled.h
 
 SOURCES +=                                           \
@@ -51,12 +75,27 @@ SOURCES +=                                           \
     src/tagger.cpp                                   \
     src/tag_parser.cpp                               \
     src/window.cpp                                   \
+    util/batch_file_reader.cpp                       \
+    util/duplicate_finder.cpp                        \
+    util/image_decoder.cpp                           \
+    util/image_filter.cpp                            \
+    util/image_probe.cpp                             \
     util/imagecache.cpp                              \
+    util/slideshow_scheduler.cpp                     \
+    util/integrity_scanner.cpp                       \
+    util/encoded_file_cache.cpp                      \
+    util/mapped_file_device.cpp                      \
+    util/memory_governor.cpp                         \
     util/misc.cpp                                    \
     util/open_graphical_shell.cpp                    \
+    util/perceptual_hash.cpp                         \
+    util/prefetch_planner.cpp                        \
+    util/resample.cpp                                \
+    util/scaled_read.cpp                             \
     util/strings.cpp                                 \
     util/tag_fetcher.cpp                             \
-    util/tag_file.cpp
+    util/tag_file.cpp                                \
+    util/tag_suggester.cpp
 
 HEADERS  +=                                          \
     src/file_queue.h                                 \
@@ -73,15 +112,31 @@ HEADERS  +=                                          \
     src/window.h                                     \
     util/command_placeholders.h                      \
     util/imageboard.h                                \
+    util/batch_file_reader.h                         \
+    util/duplicate_finder.h                          \
+    util/image_decoder.h                             \
+    util/image_filter.h                              \
+    util/image_probe.h                               \
     util/imagecache.h                                \
+    util/slideshow_scheduler.h                       \
+    util/integrity_scanner.h                         \
+    util/encoded_file_cache.h                        \
+    util/mapped_file_device.h                        \
+    util/memory_governor.h                           \
     util/misc.h                                      \
     util/network.h                                   \
     util/open_graphical_shell.h                      \
+    util/perceptual_hash.h                           \
+    util/prefetch_planner.h                          \
+    util/queue_aware_cache.h                         \
     util/project_info.h                              \
+    util/resample.h                                  \
+    util/scaled_read.h                               \
     util/size.h                                      \
     util/strings.h                                   \
     util/tag_fetcher.h                               \
     util/tag_file.h                                  \
+    util/tag_suggester.h                             \
     util/traits.h                                    \
     util/unordered_map_qt.h
 
@@ -0,0 +1,129 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+/**
+ * @file decoder_benchmark.cpp
+ * @brief Compares image decoders registered in DecoderRegistry on real files.
+ *
+ * Usage: decoder_benchmark [-r repetitions] [-t WIDTHxHEIGHT] files...
+ *
+ * Every file is decoded by every decoder supporting its format, at full size
+ * or, with \c -t, at the reduced size used for displaying in a window.
+ */
+
+#include "util/image_decoder.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+/// Accumulated results of a decoder on one format.
+struct Totals
+{
+	double time_ms = 0;
+	double megapixels = 0;
+	int    files = 0;
+	int    failed = 0;
+};
+
+/// Median run time of decoding \p data with \p decoder in milliseconds, negative on failure.
+static double measure(int reps, const ImageDecoder& decoder, const QByteArray& data, QSize target,
+                      QSize* decoded_size)
+{
+	std::vector<double> times;
+	for(int i = 0; i < reps; ++i) {
+		QElapsedTimer t;
+		t.start();
+		auto res = DecoderRegistry::instance().decodeWith(decoder, data, target);
+		times.push_back(t.nsecsElapsed() / 1e6);
+		if(res.isNull())
+			return -1;
+		*decoded_size = res.size();
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+	QGuiApplication app(argc, argv); // NOTE: needed for Qt image plugins
+
+	int reps = 5;
+	QSize target;
+	std::vector<const char*> files;
+	for(int i = 1; i < argc; ++i) {
+		if(std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			reps = std::max(1, std::atoi(argv[++i]));
+		} else if(std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			int w = 0, h = 0;
+			if(std::sscanf(argv[++i], "%dx%d", &w, &h) == 2)
+				target = QSize(w, h);
+		} else {
+			files.push_back(argv[i]);
+		}
+	}
+	if(files.empty()) {
+		std::fprintf(stderr, "usage: %s [-r repetitions] [-t WIDTHxHEIGHT] files...\n", argv[0]);
+		return 1;
+	}
+
+	std::printf("repetitions: %d, target: %s\n\n", reps,
+	            target.isValid() ? qPrintable(QStringLiteral("%1x%2").arg(target.width()).arg(target.height())) : "full size");
+	std::printf("%-40s %-6s %-8s %-12s %10s %10s\n", "file", "format", "decoder", "decoded", "time", "MP/s");
+
+	// keyed by format and decoder name
+	std::map<std::pair<std::string, std::string>, Totals> totals;
+
+	for(const auto filename : files) {
+		QFile file(QString::fromLocal8Bit(filename));
+		if(!file.open(QIODevice::ReadOnly)) {
+			std::fprintf(stderr, "%s: %s\n", filename, qPrintable(file.errorString()));
+			continue;
+		}
+		const QByteArray data = file.readAll();
+		const auto format = util::detect_image_format(data.left(util::image_magic_size));
+		const std::string format_name = format == ImageFormat::Unknown
+		        ? std::string("?") : util::image_format_name(format).toStdString();
+
+		const std::string name = QFile::decodeName(filename).section('/', -1).left(40).toStdString();
+		for(const auto decoder : DecoderRegistry::instance().decoders(format)) {
+			auto& total = totals[{format_name, decoder->name()}];
+			QSize decoded;
+			const double ms = measure(reps, *decoder, data, target, &decoded);
+			if(ms < 0) {
+				++total.failed;
+				std::printf("%-40s %-6s %-8s %-12s %10s %10s\n", name.c_str(), format_name.c_str(),
+				            decoder->name(), "-", "failed", "-");
+				continue;
+			}
+			const double mp = decoded.width() * static_cast<double>(decoded.height()) / 1e6;
+			total.time_ms += ms;
+			total.megapixels += mp;
+			++total.files;
+
+			char size_str[32];
+			std::snprintf(size_str, sizeof(size_str), "%dx%d", decoded.width(), decoded.height());
+			std::printf("%-40s %-6s %-8s %-12s %8.1fms %10.1f\n", name.c_str(), format_name.c_str(),
+			            decoder->name(), size_str, ms, mp / (ms / 1e3));
+		}
+	}
+
+	std::printf("\n%-6s %-8s %6s %6s %10s %10s\n", "format", "decoder", "files", "failed", "time", "MP/s");
+	for(const auto& t : totals) {
+		const auto& total = t.second;
+		std::printf("%-6s %-8s %6d %6d %8.1fms %10.1f\n", t.first.first.c_str(), t.first.second.c_str(),
+		            total.files, total.failed, total.time_ms,
+		            total.time_ms > 0 ? total.megapixels / (total.time_ms / 1e3) : 0.0);
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+/**
+ * @file probe_benchmark.cpp
+ * @brief Compares util::probe_image_files with QImageReader::size().
+ *
+ * Usage: probe_benchmark directory...
+ *
+ * Run twice to compare cold and warm page cache.
+ */
+
+#include "util/image_probe.h"
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+int main(int argc, char** argv)
+{
+	QGuiApplication app(argc, argv); // NOTE: needed for Qt image plugins
+
+	std::vector<QString> files;
+	for(int i = 1; i < argc; ++i) {
+		QDirIterator it(QString::fromLocal8Bit(argv[i]), QDir::Files, QDirIterator::Subdirectories);
+		while(it.hasNext())
+			files.push_back(it.next());
+	}
+	if(files.empty()) {
+		std::fprintf(stderr, "usage: %s directory...\n", argv[0]);
+		return 1;
+	}
+	std::printf("files: %zu\n\n", files.size());
+	std::printf("%-16s %8s %10s %12s\n", "method", "images", "time", "files/s");
+
+	auto report = [&files](const char* method, size_t images, qint64 ns) {
+		std::printf("%-16s %8zu %8.1fms %12.0f\n", method, images, ns / 1e6, files.size() / (ns / 1e9));
+	};
+
+	const int threads = QThread::idealThreadCount();
+	for(int t : {1, threads}) {
+		QElapsedTimer timer;
+		timer.start();
+		const auto infos = util::probe_image_files(files, t);
+		const auto ns = timer.nsecsElapsed();
+		const auto images = std::count_if(infos.begin(), infos.end(), [](const auto& i) { return i.isValid(); });
+
+		char method[32];
+		std::snprintf(method, sizeof(method), "probe/%d", t);
+		report(method, static_cast<size_t>(images), ns);
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	size_t images = 0;
+	for(const auto& f : files) {
+		QImageReader reader(f);
+		if(reader.size().isValid())
+			++images;
+	}
+	report("qimagereader/1", images, timer.nsecsElapsed());
+	return 0;
+}
@@ -0,0 +1,98 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+/**
+ * @file resample_benchmark.cpp
+ * @brief Compares util::resample with QImage::scaled() on large images.
+ *
+ * Usage: resample_benchmark [repetitions]
+ */
+
+#include "util/resample.h"
+#include <QElapsedTimer>
+#include <QImage>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+/// Synthetic photo-like image: smooth gradients with noise.
+static QImage make_image(QSize size, bool alpha)
+{
+	QImage img(size, alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> noise(-16, 16);
+	for(int y = 0; y < img.height(); ++y) {
+		auto line = reinterpret_cast<QRgb*>(img.scanLine(y));
+		for(int x = 0; x < img.width(); ++x) {
+			const int a = alpha ? 128 + (x * 127 / img.width()) : 255;
+			const int r = std::min(std::max(x * 255 / img.width() + noise(rng), 0), 255);
+			const int g = std::min(std::max(y * 255 / img.height() + noise(rng), 0), 255);
+			const int b = std::min(std::max(((x + y) & 255) + noise(rng), 0), 255);
+			line[x] = qRgba(r * a / 255, g * a / 255, b * a / 255, a);
+		}
+	}
+	return img;
+}
+
+/// Median run time of \p fn in milliseconds.
+static double measure(int reps, const std::function<QImage()>& fn)
+{
+	std::vector<double> times;
+	for(int i = 0; i < reps; ++i) {
+		QElapsedTimer t;
+		t.start();
+		auto res = fn();
+		times.push_back(t.nsecsElapsed() / 1e6);
+		if(res.isNull()) {
+			std::fprintf(stderr, "scaling failed\n");
+			std::exit(1);
+		}
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+	using namespace util::resample;
+	const int reps = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+	const int threads = QThread::idealThreadCount();
+
+	std::printf("kernels: %s, threads: %d, repetitions: %d\n\n", kernel_name(), threads, reps);
+	std::printf("%-12s %-12s %-5s %10s %10s %10s %10s %10s\n",
+	            "source", "target", "alpha", "qt", "box/1", "lanczos/1", "box/N", "lanczos/N");
+
+	const QSize sources[] = { {6000, 4000}, {9504, 6336} }; // 24 MP, 60 MP
+	for(auto src_size : sources) {
+		for(bool alpha : {false, true}) {
+			const auto image = make_image(src_size, alpha);
+			const QSize targets[] = {
+				src_size.scaled(1920, 1080, Qt::KeepAspectRatio),
+				src_size / 2,
+				src_size * 3 / 4,
+			};
+			for(auto dst_size : targets) {
+				const double qt = measure(reps, [&]{ return image.scaled(dst_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation); });
+				const double box1 = measure(reps, [&]{ return scaled(image, dst_size, Filter::Box, 1); });
+				const double lan1 = measure(reps, [&]{ return scaled(image, dst_size, Filter::Lanczos3, 1); });
+				const double boxn = measure(reps, [&]{ return scaled(image, dst_size, Filter::Box, threads); });
+				const double lann = measure(reps, [&]{ return scaled(image, dst_size, Filter::Lanczos3, threads); });
+
+				char src_str[32], dst_str[32];
+				std::snprintf(src_str, sizeof(src_str), "%dx%d", src_size.width(), src_size.height());
+				std::snprintf(dst_str, sizeof(dst_str), "%dx%d", dst_size.width(), dst_size.height());
+				std::printf("%-12s %-12s %-5s %8.1fms %8.1fms %8.1fms %8.1fms %8.1fms\n",
+				            src_str, dst_str, alpha ? "yes" : "no", qt, box1, lan1, boxn, lann);
+			}
+		}
+	}
+	return 0;
+}
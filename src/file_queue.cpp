@@ -14,9 +14,12 @@
 #include <QTextStream>
 #include <QCollator>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QSaveFile>
 #include <QFile>
 #include <QBuffer>
+#include <iterator>
+#include <numeric>
 
 namespace logging_category {
 	Q_LOGGING_CATEGORY(filequeue, "FileQueue")
@@ -29,6 +32,9 @@ const QString FileQueue::m_empty{nullptr,0};
 const QString FileQueue::sessionExtensionFilter = QStringLiteral("*.wt-session");
 const int FileQueue::watcher_update_granularity_ms = 100;
 
+/// Queue is filtered and sorted again at most this often while files are probed in background.
+static constexpr int probe_update_interval_ms = 500;
+
 
 FileQueue::FileQueue()
 {
@@ -39,6 +45,39 @@ FileQueue::FileQueue()
 		}
 		m_watcher_changed_dirs.clear();
 	});
+
+	m_probe_pool.setMaxThreadCount(1);
+	m_probe_update_timer.setSingleShot(true);
+	m_probe_update_timer.setInterval(probe_update_interval_ms);
+	connect(&m_probe_update_timer, &QTimer::timeout, this, &FileQueue::update_image_properties);
+
+	connect(&m_duplicates, &DuplicateFinder::progress, this, [this](){
+		if(m_sort_by == SortQueueBy::Duplicates && !m_probe_update_timer.isActive())
+			m_probe_update_timer.start();
+	});
+	connect(&m_duplicates, &DuplicateFinder::finished, this, [this](){
+		m_probe_update_timer.stop();
+		update_image_properties(); // NOTE: sorting starts hashing files added meanwhile
+	});
+	connect(&m_tag_suggester, &TagSuggester::finished, this, &FileQueue::start_indexing);
+
+	connect(&m_integrity_scanner, &IntegrityScanner::progress, this, [this](){
+		if(!(m_status_filter_include.empty() && m_status_filter_exclude.empty()) && !m_probe_update_timer.isActive())
+			m_probe_update_timer.start();
+	});
+	connect(&m_integrity_scanner, &IntegrityScanner::finished, this, [this](){
+		if(!(m_status_filter_include.empty() && m_status_filter_exclude.empty())) {
+			m_probe_update_timer.stop();
+			update_image_properties();
+		}
+		start_scanning(); // files added while checking
+	});
+}
+
+FileQueue::~FileQueue()
+{
+	++m_probe_generation;
+	m_probe_pool.waitForDone();
 }
 
 void FileQueue::setExtensionFilter(const QStringList &f) noexcept(false)
@@ -50,13 +89,24 @@ void FileQueue::setSubstringFilter(const QStringList & filters)
 {
 	m_substr_filter_include.clear();
 	m_substr_filter_exclude.clear();
+	m_image_filter_include.clear();
+	m_image_filter_exclude.clear();
+	m_status_filter_include.clear();
+	m_status_filter_exclude.clear();
 
 	if (!filters.isEmpty()) {
 		for (const auto& tag : filters) {
-			if (tag.size() > 1 && (tag[0] == '!' || tag[0] == '-'))
-				m_substr_filter_exclude.append(tag.mid(1));
+			const bool exclude = tag.size() > 1 && (tag[0] == '!' || tag[0] == '-');
+			const auto term = exclude ? tag.mid(1) : tag;
+
+			ImagePredicate predicate;
+			MediaStatusPredicate status_predicate;
+			if (MediaStatusPredicate::parse(term, &status_predicate))
+				(exclude ? m_status_filter_exclude : m_status_filter_include).push_back(status_predicate);
+			else if (ImagePredicate::parse(term, &predicate))
+				(exclude ? m_image_filter_exclude : m_image_filter_include).push_back(predicate);
 			else
-				m_substr_filter_include.append(tag);
+				(exclude ? m_substr_filter_exclude : m_substr_filter_include).append(term);
 		}
 		m_substr_filter_exclude.sort();
 		m_substr_filter_include.sort();
@@ -69,11 +119,14 @@ void FileQueue::setSubstringFilter(const QStringList & filters)
 		                              m_substr_filter_include.end());
 	}
 	update_filter();
+	start_probing(true);
 }
 
 bool FileQueue::substringFilterActive() const
 {
-	return m_substr_filter_exclude.size() + m_substr_filter_include.size();
+	return m_substr_filter_exclude.size() + m_substr_filter_include.size()
+	        + m_image_filter_exclude.size() + m_image_filter_include.size()
+	        + m_status_filter_exclude.size() + m_status_filter_include.size();
 }
 
 bool FileQueue::checkSessionFileSuffix(const QFileInfo &fi)
@@ -373,11 +426,82 @@ void FileQueue::sort() noexcept
 		}
 	}
 
+	if(m_sort_by == SortQueueBy::ImageWidth || m_sort_by == SortQueueBy::ImageHeight
+	   || m_sort_by == SortQueueBy::AspectRatio || m_sort_by == SortQueueBy::PixelCount
+	   || m_sort_by == SortQueueBy::ImageFormat)
+	{
+		struct ImageSortEntry
+		{
+			bool    known;
+			double  key;
+			QString file;
+		};
+
+		auto sort_key = [this](const ImageInfo& info) -> double {
+			const QSize size = info.orientedSize();
+			switch(m_sort_by) {
+			case SortQueueBy::ImageWidth:  return size.width();
+			case SortQueueBy::ImageHeight: return size.height();
+			case SortQueueBy::AspectRatio: return size.width() / static_cast<double>(size.height());
+			case SortQueueBy::PixelCount:  return size.width() * static_cast<double>(size.height());
+			default:                       return static_cast<double>(info.format);
+			}
+		};
+
+		// files not probed yet, and files that are not images, go last
+		std::vector<ImageSortEntry> entries;
+		entries.reserve(m_files.size());
+		for(const auto& f : m_files) {
+			const auto probed = m_image_info.find(f);
+			const bool known = probed != m_image_info.end() && probed->info.isValid();
+			entries.push_back(ImageSortEntry{known, known ? sort_key(probed->info) : 0.0, f});
+		}
+		std::sort(entries.begin(), entries.end(), [&collator](const auto& a, const auto& b) {
+			if(a.known != b.known)
+				return a.known;
+			if(a.key != b.key)
+				return a.key < b.key;
+			return collator.compare(a.file, b.file) < 0;
+		});
+		for(size_t i = 0u; i < entries.size(); ++i) {
+			m_files[i] = entries[i].file;
+		}
+	}
+
+	if(m_sort_by == SortQueueBy::Duplicates) {
+		std::sort(m_files.begin(), m_files.end(), compare_names);
+
+		// groups are numbered by their first file, so ordering by group keeps names sorted in each group
+		const std::vector<QString> files(m_files.begin(), m_files.end());
+		const auto groups = m_duplicates.groups(files);
+		std::vector<size_t> group_sizes(files.size(), 0u);
+		for(auto g : groups)
+			++group_sizes[g];
+
+		// files with near-duplicates go first, others after them by name
+		std::vector<size_t> order(files.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&groups, &group_sizes](size_t a, size_t b) {
+			const bool a_single = group_sizes[groups[a]] == 1;
+			const bool b_single = group_sizes[groups[b]] == 1;
+			if(a_single != b_single)
+				return b_single;
+			return !a_single && groups[a] < groups[b];
+		});
+		for(size_t i = 0u; i < order.size(); ++i) {
+			m_files[i] = files[order[i]];
+		}
+	}
+
 	select(find(curr_file));
 	if(m_current >= m_files.size()) // in case duplicates were actually erased
 		m_current = 0;
 
 	update_filter();
+	start_probing(false);
+	start_hashing();
+	start_indexing();
+	start_scanning();
 }
 
 FileQueue::RenameResult FileQueue::renameCurrentFile(const QString& new_path)
@@ -396,7 +520,7 @@ FileQueue::RenameResult FileQueue::renameCurrentFile(const QString& new_path)
 	if(!source_file.exists())
 		return RenameResult::SourceFileMissing;
 
-	auto on_rename = [this, &source_file_name, &source_dir](const QString& new_path){
+	auto on_rename = [this, &source_name, &source_file_name, &source_dir](const QString& new_path){
 		auto dir_it = m_dir_files.find(source_dir);
 		if (dir_it != m_dir_files.end()) {
 			auto& files_in_dir = dir_it.value();
@@ -412,6 +536,15 @@ FileQueue::RenameResult FileQueue::renameCurrentFile(const QString& new_path)
 		}
 
 		m_files.at(m_current) = new_path;
+
+		const auto probed = m_image_info.find(source_name);
+		if (probed != m_image_info.end()) {
+			const auto entry = probed.value();
+			m_image_info.erase(probed);
+			m_image_info.insert(new_path, entry);
+		}
+		m_tag_suggester.renameFile(source_name, new_path);
+		m_integrity_scanner.renameFile(source_name, new_path);
 	};
 
 	if(QFile::exists(new_path)) {
@@ -464,28 +597,7 @@ void FileQueue::eraseCurrent()
 		return;
 	}
 
-	auto current_fi = QFileInfo(m_files[m_current]);
-	// since the file is deleted, canonicalPath() will not work
-	auto current_dir = QFileInfo{current_fi.absolutePath()}.canonicalFilePath();
-
-	auto dir_it = m_dir_files.find(current_dir);
-	if (dir_it != m_dir_files.end()) {
-		auto& files_in_dir = dir_it.value();
-		bool removed = files_in_dir.remove(current_fi.fileName());
-		Q_ASSERT(removed && "eraseCurrent(): missing entry for file in the dir mapping");
-
-		if (files_in_dir.empty()) {
-			// no more files in this dir, remove the entry and stop watching
-			m_dir_files.erase(dir_it);
-			if (m_dir_watcher && !m_dir_watcher->removePath(current_dir)){
-				 pwarn << "eraseCurrent(): could not remove" << current_dir << "from filesystem watcher";
-			}
-		}
-
-	} else {
-		Q_ASSERT(false && "eraseCurrent(): directory entry does not exist");
-	}
-
+	forget_file(m_files[m_current]);
 	m_files.erase(std::next(std::begin(m_files), m_current));
 	if (!m_accepted_by_filter.empty()) {
 		bool was_accepted = m_accepted_by_filter[m_current];
@@ -507,6 +619,66 @@ void FileQueue::eraseCurrent()
 	}
 }
 
+size_t FileQueue::eraseBroken()
+{
+	// NOTE: erased in a single pass, there may be thousands of them in a large queue
+	size_t index = 0;
+	size_t erased_before_current = 0;
+	const auto first_erased = std::remove_if(m_files.begin(), m_files.end(), [&](const QString& file)
+	{
+		const bool broken = m_integrity_scanner.isBroken(file);
+		if (broken) {
+			forget_file(file);
+			erased_before_current += index < m_current;
+		}
+		++index;
+		return broken;
+	});
+	const auto erased = static_cast<size_t>(std::distance(first_erased, m_files.end()));
+	if (erased == 0)
+		return 0;
+
+	m_files.erase(first_erased, m_files.end());
+	pdbg << "erased" << erased << "broken files";
+
+	// selects the file after current one if current one was erased
+	m_current -= std::min(erased_before_current, m_current);
+	if (m_current >= m_files.size())
+		m_current = 0u;
+
+	update_filter();
+	if (!m_accepted_by_filter.empty() && !m_files.empty() && !m_accepted_by_filter[m_current])
+		forward();
+	return erased;
+}
+
+void FileQueue::forget_file(const QString& path)
+{
+	m_integrity_scanner.removeFile(path);
+
+	const auto fi = QFileInfo(path);
+	// since the file is deleted, canonicalPath() will not work
+	const auto dir = QFileInfo{fi.absolutePath()}.canonicalFilePath();
+
+	auto dir_it = m_dir_files.find(dir);
+	if (dir_it != m_dir_files.end()) {
+		auto& files_in_dir = dir_it.value();
+		bool removed = files_in_dir.remove(fi.fileName());
+		Q_ASSERT(removed && "forget_file(): missing entry for file in the dir mapping");
+
+		if (files_in_dir.empty()) {
+			// no more files in this dir, remove the entry and stop watching
+			m_dir_files.erase(dir_it);
+			if (m_dir_watcher && !m_dir_watcher->removePath(dir)){
+				 pwarn << "forget_file(): could not remove" << dir << "from filesystem watcher";
+			}
+		}
+
+	} else {
+		Q_ASSERT(false && "forget_file(): directory entry does not exist");
+	}
+}
+
 size_t FileQueue::saveToFile(const QString &path) const
 {
 	if(empty() || !checkSessionFileSuffix(path))
@@ -711,6 +883,10 @@ void FileQueue::process_changed_directory(const QString &dir_path)
 			m_files.push_back(fi.absoluteFilePath());
 		}
 		update_filter();
+		start_probing(false);
+		start_hashing();
+		start_indexing();
+		start_scanning();
 		emit newFilesAdded();
 	}
 }
@@ -859,6 +1035,36 @@ bool FileQueue::fileMatchesFilter(const QFileInfo& file) const
 	if (!substringFilterActive())
 		return true;
 
+	if (!m_status_filter_include.empty() || !m_status_filter_exclude.empty()) {
+		// files are filtered out until they are checked in background
+		const auto status = m_integrity_scanner.status(file.filePath());
+		for (const auto& predicate : m_status_filter_exclude) {
+			if (predicate.matches(status))
+				return false;
+		}
+		for (const auto& predicate : m_status_filter_include) {
+			if (!predicate.matches(status))
+				return false;
+		}
+	}
+
+	if (!m_image_filter_include.empty() || !m_image_filter_exclude.empty()) {
+		// files are filtered out until their headers are probed in background
+		const auto probed = m_image_info.find(file.filePath());
+		if (probed == m_image_info.end())
+			return false;
+
+		const auto& info = probed->info;
+		for (const auto& predicate : m_image_filter_exclude) {
+			if (predicate.matches(info))
+				return false;
+		}
+		for (const auto& predicate : m_image_filter_include) {
+			if (!predicate.matches(info))
+				return false;
+		}
+	}
+
 	QString name = file.completeBaseName();
 
 	auto contains_separate = [](const QString& name, const auto& tag)
@@ -989,6 +1195,254 @@ void FileQueue::clear() noexcept
 	m_dir_files.clear();
 	m_dir_watcher.reset();
 	m_accepted_by_filter.clear();
+	m_image_info.clear();
+	++m_probe_generation;
+	m_probe_running = false;
+	m_duplicates.clear();
+	m_tag_suggester.cancel();
+	m_integrity_scanner.clear();
 	m_current = 0u;
 	m_accepted_by_filter_count = -1;
 }
+
+void FileQueue::probeImages()
+{
+	QElapsedTimer timer;
+	timer.start();
+	const auto results = probe_changed(std::vector<QString>(m_files.begin(), m_files.end()), m_image_info);
+	m_image_info.reserve(static_cast<int>(m_files.size()));
+	for(const auto& r : results)
+		m_image_info.insert(r.first, r.second);
+	pdbg << "probed" << results.size() << "files in" << timer.elapsed() << "ms";
+}
+
+ImageInfo FileQueue::imageInfo(const QString& file) const
+{
+	return m_image_info.value(file).info;
+}
+
+DuplicateFinder& FileQueue::duplicates() noexcept
+{
+	return m_duplicates;
+}
+
+TagSuggester& FileQueue::tagSuggester() noexcept
+{
+	return m_tag_suggester;
+}
+
+void FileQueue::setTagSuggestionsEnabled(bool enabled)
+{
+	m_tag_suggestions_enabled = enabled;
+	if(enabled)
+		start_indexing();
+	else
+		m_tag_suggester.cancel();
+}
+
+bool FileQueue::tagSuggestionsEnabled() const noexcept
+{
+	return m_tag_suggestions_enabled;
+}
+
+IntegrityScanner& FileQueue::integrityScanner() noexcept
+{
+	return m_integrity_scanner;
+}
+
+void FileQueue::setIntegrityScanEnabled(bool enabled)
+{
+	m_integrity_scan_enabled = enabled;
+	if(enabled)
+		start_scanning();
+	else
+		m_integrity_scanner.cancel();
+}
+
+bool FileQueue::integrityScanEnabled() const noexcept
+{
+	return m_integrity_scan_enabled;
+}
+
+/// Task for probing headers of files in queue in background.
+struct ProbeQueueTask : public QRunnable
+{
+	ProbeQueueTask(FileQueue* q, uint64_t g, std::vector<QString>&& f, const QHash<QString, FileQueue::ProbedImage>& k) :
+	        queue(q), generation(g), files(std::move(f)), known(k)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		queue->probeThreadFunc(generation, files, known);
+	}
+
+	FileQueue* queue;
+	uint64_t   generation;
+	std::vector<QString> files;
+	QHash<QString, FileQueue::ProbedImage> known; // NOTE: implicitly shared copy, read only
+};
+
+FileQueue::ProbeResults FileQueue::probe_changed(const std::vector<QString>& files,
+                                                 const QHash<QString, ProbedImage>& known)
+{
+	ProbeResults res;
+	std::vector<QString> changed;
+	for(const auto& f : files) {
+		const QFileInfo fi(f);
+		ProbedImage entry;
+		entry.file_size = fi.size();
+		entry.modified = fi.lastModified().toMSecsSinceEpoch();
+
+		// same path, size and modification time is treated as same file
+		const auto it = known.find(f);
+		if(it != known.end() && it->file_size == entry.file_size && it->modified == entry.modified)
+			continue;
+		changed.push_back(f);
+		res.emplace_back(f, entry);
+	}
+
+	const auto infos = util::probe_image_files(changed);
+	Q_ASSERT(infos.size() == res.size());
+	for(size_t i = 0; i < res.size(); ++i)
+		res[i].second.info = infos[i];
+	return res;
+}
+
+bool FileQueue::image_properties_needed() const
+{
+	switch(m_sort_by) {
+	case SortQueueBy::ImageWidth:
+	case SortQueueBy::ImageHeight:
+	case SortQueueBy::AspectRatio:
+	case SortQueueBy::PixelCount:
+	case SortQueueBy::ImageFormat:
+		return true;
+	default:
+		return !m_image_filter_include.empty() || !m_image_filter_exclude.empty();
+	}
+}
+
+void FileQueue::start_probing(bool force)
+{
+	if(!image_properties_needed() || m_files.empty())
+		return;
+
+	std::vector<QString> files;
+	if(force) {
+		files.assign(m_files.begin(), m_files.end());
+	} else {
+		// NOTE: running pass will start again for files added meanwhile once it is done
+		if(m_probe_running)
+			return;
+		for(const auto& f : m_files) {
+			if(!m_image_info.contains(f))
+				files.push_back(f);
+		}
+		if(files.empty())
+			return;
+	}
+
+	const auto generation = ++m_probe_generation;
+	{
+		QMutexLocker _{&m_probe_lock};
+		m_probe_results.clear();
+		m_probe_finished = false;
+	}
+	m_probe_running = true;
+	pdbg << "probing" << files.size() << "files in background";
+	m_probe_pool.start(new ProbeQueueTask(this, generation, std::move(files), m_image_info));
+}
+
+void FileQueue::probeThreadFunc(uint64_t generation, const std::vector<QString>& files,
+                                const QHash<QString, ProbedImage>& known)
+{
+	// NOTE: batches are posted as they are done, so results appear progressively
+	constexpr size_t batch_size = 1024;
+	for(size_t begin = 0; begin < files.size(); begin += batch_size) {
+		if(m_probe_generation != generation)
+			return;
+
+		const auto end = std::next(files.begin(), static_cast<ptrdiff_t>(std::min(begin + batch_size, files.size())));
+		auto results = probe_changed(std::vector<QString>(std::next(files.begin(), static_cast<ptrdiff_t>(begin)), end),
+		                             known);
+		{
+			QMutexLocker _{&m_probe_lock};
+			if(m_probe_generation != generation)
+				return;
+			std::move(results.begin(), results.end(), std::back_inserter(m_probe_results));
+			m_probe_finished = end == files.end();
+		}
+		QMetaObject::invokeMethod(this, "applyProbeResults", Qt::QueuedConnection);
+	}
+}
+
+void FileQueue::applyProbeResults()
+{
+	ProbeResults results;
+	bool finished;
+	{
+		QMutexLocker _{&m_probe_lock};
+		std::swap(results, m_probe_results);
+		finished = m_probe_finished;
+		m_probe_finished = false;
+	}
+
+	for(auto& r : results)
+		m_image_info.insert(r.first, std::move(r.second));
+
+	if(finished) {
+		m_probe_running = false;
+		m_probe_update_timer.stop();
+		update_image_properties();
+		start_probing(false); // files added while probing
+	} else if(!results.empty() && !m_probe_update_timer.isActive()) {
+		m_probe_update_timer.start();
+	}
+}
+
+void FileQueue::update_image_properties()
+{
+	if(!image_properties_needed() && m_sort_by != SortQueueBy::Duplicates
+	&& m_status_filter_include.empty() && m_status_filter_exclude.empty())
+		return;
+
+	switch(m_sort_by) {
+	case SortQueueBy::ImageWidth:
+	case SortQueueBy::ImageHeight:
+	case SortQueueBy::AspectRatio:
+	case SortQueueBy::PixelCount:
+	case SortQueueBy::ImageFormat:
+	case SortQueueBy::Duplicates:
+		sort(); // NOTE: also updates filter
+		break;
+	default:
+		update_filter();
+	}
+	emit imageInfoUpdated();
+}
+
+void FileQueue::start_hashing()
+{
+	// NOTE: running pass will start again for files added meanwhile once it is done
+	if(m_sort_by != SortQueueBy::Duplicates || m_files.empty() || m_duplicates.isRunning())
+		return;
+	m_duplicates.hashFiles(std::vector<QString>(m_files.begin(), m_files.end()));
+}
+
+void FileQueue::start_indexing()
+{
+	// NOTE: files added while indexing are indexed once running pass is done
+	if(!m_tag_suggestions_enabled || m_files.empty() || m_tag_suggester.isRunning())
+		return;
+	m_tag_suggester.indexFiles(std::vector<QString>(m_files.begin(), m_files.end()));
+}
+
+void FileQueue::start_scanning()
+{
+	// NOTE: files added while checking are checked once running pass is done
+	if(!m_integrity_scan_enabled || m_files.empty() || m_integrity_scanner.isRunning())
+		return;
+	m_integrity_scanner.scanFiles(std::vector<QString>(m_files.begin(), m_files.end()));
+}
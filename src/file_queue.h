@@ -22,6 +22,13 @@
 #include <deque>
 #include <memory>
 #include "global_enums.h"
+#include "util/duplicate_finder.h"
+#include "util/image_filter.h"
+#include "util/integrity_scanner.h"
+#include "util/tag_suggester.h"
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
 
 /*!
  * \brief File Queue class designed for image viewing and renaming.
@@ -38,6 +45,7 @@ public:
 
 	/// Construct FileQueue object.
 	FileQueue();
+	~FileQueue() override;
 
 	/// Result of rename operation
 	enum class RenameResult
@@ -78,13 +86,18 @@ public:
 
 	/*!
 	 * \brief Set filename substring filter.
-	 * \param filters List of substring filters.
+	 * \param filters List of substring filters, image predicates and media status predicates,
+	 *        see \ref ImagePredicate and \ref MediaStatusPredicate.
+	 *
+	 * Files are matched by image predicates once their headers have been probed
+	 * in background, until then they are filtered out. Same goes for media status
+	 * predicates and files not checked by \ref integrityScanner() yet.
 	 */
 	void setSubstringFilter(const QStringList& filters);
 
 
 	/*!
-	 * \brief Is substring filter currently activated.
+	 * \brief Is substring filter or an image predicate currently activated.
 	 */
 	bool substringFilterActive() const;
 
@@ -256,6 +269,58 @@ public:
 	 */
 	size_t currentIndex() const noexcept;
 
+
+	/*!
+	 * \brief Read format and dimensions of all files in queue from their headers.
+	 *
+	 * Files are probed in parallel, files probed before and not modified since are skipped.
+	 * Blocks until done.
+	 *
+	 * Sorting by image properties and image predicates in filter probe files in background instead.
+	 */
+	void probeImages();
+
+
+	/*!
+	 * \brief Format and dimensions of \p file.
+	 * \retval ImageInfo() File has not been probed or is not a recognized image.
+	 */
+	ImageInfo imageInfo(const QString& file) const;
+
+	/*!
+	 * \brief Perceptual hashes of files in queue.
+	 *
+	 * Files are hashed in background while queue is sorted by \ref SortQueueBy::Duplicates,
+	 * or when hashing is started explicitly.
+	 */
+	DuplicateFinder& duplicates() noexcept;
+
+	/*!
+	 * \brief Index of visual descriptors and tags of files in queue.
+	 *
+	 * Files are indexed in background while tag suggestions are enabled.
+	 */
+	TagSuggester& tagSuggester() noexcept;
+
+	/// Enable indexing files for \ref tagSuggester(), starts indexing files in queue.
+	void setTagSuggestionsEnabled(bool enabled);
+
+	/// Are files indexed for \ref tagSuggester().
+	bool tagSuggestionsEnabled() const noexcept;
+
+	/*!
+	 * \brief Status of files in queue checked for damage.
+	 *
+	 * Files are checked in background while integrity scanning is enabled.
+	 */
+	IntegrityScanner& integrityScanner() noexcept;
+
+	/// Enable checking files for damage, starts checking files in queue.
+	void setIntegrityScanEnabled(bool enabled);
+
+	/// Are files checked for damage.
+	bool integrityScanEnabled() const noexcept;
+
 	/*!
 	 * \brief Index of currently selected file among filtered files.
 	 * \return FileQueue::npos Filtered queue is empty
@@ -297,6 +362,15 @@ public:
 	void eraseCurrent();
 
 
+	/*!
+	 * \brief Erase files found damaged by \ref integrityScanner() from queue.
+	 * \return Number of erased files.
+	 *
+	 * Current file stays selected, or the next file if it was erased.
+	 */
+	size_t eraseBroken();
+
+
 	/*!
 	 * \brief Serialize file names in queue to a binary file at \p path.
 	 * \return Number of bytes written.
@@ -338,7 +412,37 @@ signals:
 	 */
 	void newFilesAdded();
 
+	/*!
+	 * \brief Emitted when background probing got dimensions, hashing got hashes, or checking
+	 *        got status of more files, and queue was filtered or sorted again.
+	 */
+	void imageInfoUpdated();
+
+private slots:
+	void applyProbeResults();
+
 private:
+	/// Probed image info of file, with identity of file it was probed from.
+	struct ProbedImage
+	{
+		ImageInfo info;
+		qint64    file_size = -1;
+		qint64    modified  = 0;
+	};
+	using ProbeResults = std::vector<std::pair<QString, ProbedImage>>;
+	friend struct ProbeQueueTask;
+
+	static ProbeResults probe_changed(const std::vector<QString>& files, const QHash<QString, ProbedImage>& known);
+	bool image_properties_needed() const;
+	void start_probing(bool force);
+	void probeThreadFunc(uint64_t generation, const std::vector<QString>& files,
+	                     const QHash<QString, ProbedImage>& known);
+	void update_image_properties();
+	void start_hashing();
+	void start_indexing();
+	void start_scanning();
+	void forget_file(const QString& path);
+
 	void update_filter();
 	void on_watcher_directory_changed(const QString& dir);
 	void process_changed_directory(const QString& dir);
@@ -351,12 +455,31 @@ private:
 	QSet<QString>        m_watcher_changed_dirs;
 	QTimer               m_watcher_timer;
 	std::vector<bool>    m_accepted_by_filter;
+	QHash<QString, ProbedImage> m_image_info;
+	std::vector<ImagePredicate> m_image_filter_include;
+	std::vector<ImagePredicate> m_image_filter_exclude;
+	std::vector<MediaStatusPredicate> m_status_filter_include;
+	std::vector<MediaStatusPredicate> m_status_filter_exclude;
 	QStringList          m_ext_filters;
 	QStringList          m_substr_filter_include;
 	QStringList          m_substr_filter_exclude;
 	size_t               m_current = npos;
 	ptrdiff_t            m_accepted_by_filter_count = -1;
 	SortQueueBy          m_sort_by = SortQueueBy::FileName;
+
+	std::atomic<uint64_t> m_probe_generation{0};
+	bool                 m_probe_running = false;
+	QTimer               m_probe_update_timer;
+	QMutex               m_probe_lock;
+	ProbeResults         m_probe_results;  ///< Guarded by \p m_probe_lock.
+	bool                 m_probe_finished = false; ///< Guarded by \p m_probe_lock.
+	QThreadPool          m_probe_pool;
+
+	DuplicateFinder      m_duplicates;
+	TagSuggester         m_tag_suggester;
+	bool                 m_tag_suggestions_enabled = false;
+	IntegrityScanner     m_integrity_scanner;
+	bool                 m_integrity_scan_enabled = true;
 };
 
 #endif
@@ -39,7 +39,16 @@ FilterDialog::FilterDialog(QWidget * _parent) : QDialog(_parent)
 	                    "<ul><li><b><code>\"tail\"</code></b> will match just the tag <code>tail</code></li></ul>"
 	                    "Use minus sign to exclude tags:"
 	                    "<ul><li><b><code>-cat</code></b> will exclude any occurence of <code>cat</code>, e.g. <code>catgirl</code></li>"
-	                    "<li><b><code>-\"cat\"</code></b> will exclude just the tag <code>cat</code></li></ul>");
+	                    "<li><b><code>-\"cat\"</code></b> will exclude just the tag <code>cat</code></li></ul>"
+	                    "Compare image properties with <code>width</code>, <code>height</code>, <code>ratio</code>, <code>mp</code> (megapixels), "
+	                    "<code>format</code> and <code>orientation</code>:"
+	                    "<ul><li><b><code>width&lt;1000</code></b> will match images narrower than 1000 pixels</li>"
+	                    "<li><b><code>orientation=portrait</code></b> will match images taller than wide</li>"
+	                    "<li><b><code>-format=png</code></b> will exclude PNG images</li></ul>"
+	                    "Filter by damage found in background with <code>status</code>: <code>broken</code>, <code>ok</code>, "
+	                    "<code>empty</code>, <code>truncated</code>, <code>corrupt</code> or <code>unreadable</code>:"
+	                    "<ul><li><b><code>status=broken</code></b> will match damaged files</li>"
+	                    "<li><b><code>-status=broken</code></b> will exclude damaged files</li></ul>");
 	setWhatsThis(help_text);
 
 	setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
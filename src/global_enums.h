@@ -62,6 +62,12 @@ public:
 		ModificationDate,  ///< Sort by modification date, then by file name.
 		FileNameLength,    ///< Sort by file name length, then by file name.
 		TagCount,          ///< Sort by tag count, then by file name.
+		ImageWidth,        ///< Sort by image width, then by file name.
+		ImageHeight,       ///< Sort by image height, then by file name.
+		AspectRatio,       ///< Sort by image aspect ratio, then by file name.
+		PixelCount,        ///< Sort by number of pixels in image, then by file name.
+		ImageFormat,       ///< Sort by image format detected from contents, then by file name.
+		Duplicates,        ///< Sort near-duplicate images next to each other, then by file name.
 	};
 	Q_ENUM(SortQueueBy)
 
@@ -231,16 +231,24 @@ void TagInput::loadTagData(const QByteArray& data)
 {
 	if (!m_tag_parser.loadTagData(data)) {
 		m_tags_model.clear();
+		m_tags_model_num_suggested_tags = 0;
 		return;
 	}
 
 	m_tags_model_num_main_tags = update_model(m_tags_model, m_tag_parser);
+	m_tags_model_num_suggested_tags = 0;
+	updateModelSuggestedTags();
 
+	set_model_completer();
+	updateText(text());
+}
+
+void TagInput::set_model_completer()
+{
 	m_completer = std::make_unique<MultiSelectCompleter>(&m_tags_model, nullptr);
 	m_completer->setCompletionRole(Qt::UserRole);
 	m_completer->setCompletionMode(QCompleter::PopupCompletion);
 	setCompleter(m_completer.get());
-	updateText(text());
 }
 
 static void set_line_edit_text_formats(QLineEdit& input, const std::vector<QTextLayout::FormatRange>& formats)
@@ -407,7 +415,7 @@ void TagInput::classifyText(const QStringList& tag_list)
 
 void TagInput::updateModelRemovedTags(const QStringList& tag_list)
 {
-	int current_row = m_tags_model_num_main_tags;
+	int current_row = m_tags_model_num_suggested_tags + m_tags_model_num_main_tags;
 
 	// add all tags to model with negation
 	for (const auto& tag : tag_list) {
@@ -430,6 +438,50 @@ void TagInput::updateModelRemovedTags(const QStringList& tag_list)
 	m_tags_model.setRowCount(current_row);
 }
 
+void TagInput::setSuggestedTags(const std::vector<TagSuggester::Suggestion>& suggestions)
+{
+	m_suggested_tags = suggestions;
+	updateModelSuggestedTags();
+
+	// NOTE: without tag file, completer is not set up for the model
+	if (m_tags_model_num_suggested_tags > 0 && m_completer->model() != &m_tags_model)
+		set_model_completer();
+}
+
+void TagInput::updateModelSuggestedTags()
+{
+	m_tags_model.removeRows(0, m_tags_model_num_suggested_tags);
+	m_tags_model_num_suggested_tags = 0;
+
+	const auto tag_list = tags_list();
+	std::vector<const TagSuggester::Suggestion*> shown;
+	for (const auto& s : m_suggested_tags) {
+		if (tag_list.contains(s.tag))
+			continue;
+		if (m_tag_parser.hasTagFile() && (m_tag_parser.classify(s.tag, tag_list) & TagParser::TagKind::Unknown))
+			continue;
+		shown.push_back(&s);
+	}
+	if (shown.empty())
+		return;
+
+	if (m_tags_model.columnCount() == 0)
+		m_tags_model.setColumnCount(1);
+	m_tags_model.insertRows(0, static_cast<int>(shown.size()));
+	for (int i = 0; i < static_cast<int>(shown.size()); ++i) {
+		const auto& tag = shown[static_cast<size_t>(i)]->tag;
+		const auto votes = shown[static_cast<size_t>(i)]->votes;
+		auto index = m_tags_model.index(i, 0);
+		m_tags_model.setData(index, tag, Qt::UserRole);
+		m_tags_model.setData(index, tr("%1  (in %n similar images)", nullptr, votes).arg(tag), Qt::DisplayRole);
+
+		auto color = m_tag_parser.getColor(tag);
+		if (color.isValid())
+			m_tags_model.setData(index, color, Qt::ForegroundRole);
+	}
+	m_tags_model_num_suggested_tags = static_cast<int>(shown.size());
+}
+
 QString TagInput::postURL() const
 {
 	return ib::get_imageboard_meta(m_text_list.begin(), m_text_list.end()).post_url;
@@ -20,6 +20,7 @@
 #include "multicompleter.h"
 #include "tag_parser.h"
 #include "global_enums.h"
+#include "util/tag_suggester.h"
 
 
 class QKeyEvent;
@@ -186,6 +187,14 @@ public:
 	 */
 	QAbstractItemModel* completionModel();
 
+	/*!
+	 * \brief Offer \p suggestions in autocomplete, before tags from tag file.
+	 *
+	 * Pressing Tab after a space cycles through suggestions first. Tags already
+	 * in text, and tags unknown to the tag file if there is one, are left out.
+	 */
+	void setSuggestedTags(const std::vector<TagSuggester::Suggestion>& suggestions);
+
 signals:
 
 	/*!
@@ -204,6 +213,9 @@ protected:
 private:
 	bool        next_completer();
 
+	/// Use completer over \p m_tags_model.
+	void        set_model_completer();
+
 	void        updateText(const QString &t);
 
 	/// Classify all tags in current list and style accordingly.
@@ -212,6 +224,9 @@ private:
 	/// Add negated versions of all tags in current list and append to model.
 	void        updateModelRemovedTags(const QStringList& tag_list);
 
+	/// Insert suggested tags at the beginning of model.
+	void        updateModelSuggestedTags();
+
 	void        update_qss();
 
 	static constexpr int m_minimum_height         = 30;
@@ -240,6 +255,10 @@ private:
 	QStandardItemModel m_tags_model;
 	/// Number of main tags in model.
 	int m_tags_model_num_main_tags = 0;
+	/// Number of suggested tags in model, before main tags.
+	int m_tags_model_num_suggested_tags = 0;
+	/// Tags suggested for current file.
+	std::vector<TagSuggester::Suggestion> m_suggested_tags;
 
 	std::unique_ptr<MultiSelectCompleter>     m_completer;
 	using tag_iterator = decltype(std::begin(m_text_list));
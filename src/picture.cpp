@@ -7,19 +7,25 @@
 
 #include "picture.h"
 #include "statistics.h"
+#include "util/image_decoder.h"
 #include "util/misc.h"
+#include "util/resample.h"
+#include "util/scaled_read.h"
 #include <QSettings>
 #include <QResizeEvent>
 #include <QDragEnterEvent>
 #include <QDragMoveEvent>
 #include <QDropEvent>
+#include <QPainter>
 #include <QApplication>
 #include <QLoggingCategory>
 #include <QThread>
 #include <QFile>
+#include <QFileInfo>
 #include <QElapsedTimer>
 #include <QGridLayout>
 #include <QGraphicsDropShadowEffect>
+#include <QImageReader>
 
 namespace logging_category {Q_LOGGING_CATEGORY(picture, "Picture")}
 #define pdbg qCDebug(logging_category::picture)
@@ -30,15 +36,103 @@ static auto make_movie(QIODevice *d)
 	return std::make_unique<QMovie>(d);
 }
 
+/// Frame delay used when animation does not specify one, same as browsers do.
+static constexpr int default_frame_delay = 100; // ms
+
+/// Smaller images are decoded fast enough to not need a preview.
+static constexpr qint64 preview_min_pixels = 4 * 1024 * 1024;
+
+/// Size of media of \p media_size shown in \p viewport, both in device pixels.
+static QSize display_size(QSize media_size, QSize viewport, bool upscale)
+{
+	if(upscale)
+		return media_size.scaled(viewport, Qt::KeepAspectRatio);
+	return media_size.scaled(std::min(viewport.width(), media_size.width()),
+	                         std::min(viewport.height(), media_size.height()),
+	                         Qt::KeepAspectRatio);
+}
+
+/// Is \p image in a format that is painted without conversion.
+static bool is_display_format(const QImage& image)
+{
+	return image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32_Premultiplied;
+}
+
+/// \p image in a format that is painted without conversion.
+static QImage display_image(const QImage& image)
+{
+	if(is_display_format(image))
+		return image;
+	return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+	                                                     : QImage::Format_RGB32);
+}
+
+/// \p image scaled to \p size in display format, device pixel ratio is set to \p dpr.
+static QImage fit_display_image(const QImage& image, QSize size, double dpr)
+{
+	QImage res = image.size() == size ? display_image(image) : util::resample::scaled(image, size);
+	res.setDevicePixelRatio(dpr);
+	return res;
+}
+
+/// Loads media file for \ref Picture in a worker thread.
+struct LoadMediaTask : public QRunnable
+{
+	LoadMediaTask(Picture* p, uint64_t gen, const QString& f, QSize ws, double r, int rot, bool cached, bool up,
+	              bool pre) :
+	        picture(p), generation(gen), filename(f), window_size(ws), dpr(r), rotation(rot), use_cache(cached),
+	        upscale(up), preview(pre) { }
+
+	void run() override
+	{
+		picture->loadMediaThreadFunc(generation, filename, window_size, dpr, rotation, use_cache, upscale, preview);
+	}
+
+	Picture* picture;
+	uint64_t generation;
+	QString  filename;
+	QSize    window_size;
+	double   dpr;
+	int      rotation;
+	bool     use_cache;
+	bool     upscale;
+	bool     preview;
+};
+
+/// Resamples displayed image of \ref Picture to new size in a worker thread.
+struct RescaleTask : public QRunnable
+{
+	RescaleTask(Picture* p, uint64_t gen, const QImage& img, qint64 k, QSize s, double r) :
+	        picture(p), generation(gen), image(img), key(k), size(s), dpr(r) { }
+
+	void run() override
+	{
+		picture->rescaleThreadFunc(generation, image, key, size, dpr);
+	}
+
+	Picture* picture;
+	uint64_t generation;
+	QImage   image;
+	qint64   key;
+	QSize    size;
+	double   dpr;
+};
+
 Picture::Picture(QWidget *parent) :
 	QLabel{parent},
 	m_widget_size{0,0},
 	m_media_size{0,0},
+	m_display_key{0},
+	m_rescaled_key{0},
 	m_movie{nullptr},
+	m_frame{0},
+	m_loops_done{0},
+	m_playing{false},
 	m_type{Type::WelcomeText},
 	m_rotation{0},
 	m_has_alpha{false},
 	m_upscale{false},
+	m_loading{false},
 	m_status_left{this},
 	m_status_right{this}
 {
@@ -100,23 +194,67 @@ Picture::Picture(QWidget *parent) :
 
 	connect(&m_resize_timer, &QTimer::timeout, this, [this]()
 	{
-		cache.clear();
-		if(!m_pixmap.isNull()) {
-			if(m_pixmap.size() != m_media_size || std::abs(m_pixmap.devicePixelRatioF() - devicePixelRatioF()) > 0.05f) {
-				pwarn << "pixmap not suitable for resize, reloading...";
+		if(m_loading) {
+			// NOTE: decode in flight is not restarted, its result is checked once it is shown
+			m_resize_timer.start(resize_timeout);
+			return;
+		}
+		if(m_type == Type::Image && !m_image.isNull()) {
+			// decoded image is resampled to new size, decoding again is needed only if it is too small
+			const auto needed = display_size(m_media_size, viewportSize(), m_upscale).boundedTo(m_media_size);
+			if(m_image.width() < needed.width() || m_image.height() < needed.height()) {
+				// pick the pyramid level closest to new size
+				if(tryLoadImageFromCache(m_current_file))
+					return;
+				pwarn << "decoded image too small for new size, reloading...";
+				loadMedia(m_current_file);
+				return;
+			}
+		}
+		if(m_animation && !m_animation->frames.empty()) {
+			const auto frame_size = m_animation->frames.front().size();
+			const auto needed = m_media_size.scaled(size() * devicePixelRatioF(), Qt::KeepAspectRatio);
+			if(frame_size != m_media_size && (frame_size.width() < needed.width() || frame_size.height() < needed.height())) {
+				pwarn << "cached frames not suitable for resize, reloading...";
 				loadMedia(m_current_file);
 				return;
 			}
 		}
-		if(!m_pixmap.isNull() || (m_movie && m_movie->isValid()))
+		if(!m_image.isNull() || (m_movie && m_movie->isValid()) || m_animation)
 			resizeMedia();
 	});
 	m_resize_timer.setSingleShot(true);
 
+	connect(&m_frame_timer, &QTimer::timeout, this, &Picture::nextFrame);
+	m_frame_timer.setSingleShot(true);
+
+	// show placeholder only if loading takes a while, to avoid flicker
+	connect(&m_placeholder_timer, &QTimer::timeout, this, [this]()
+	{
+		const QFileInfo fi(m_current_file);
+		showText(tr("<p>Loading <b>%1</b> (%2 KiB)...</p>")
+			.arg(fi.fileName().toHtmlEscaped())
+			.arg(fi.size() / 1024));
+	});
+	m_placeholder_timer.setSingleShot(true);
+
+	// loads are cancelled on navigation, two threads let a new load start while a stale one finishes decoding
+	m_load_pool.setMaxThreadCount(2);
+
 	m_status_font.setPointSize(8);
 	m_status_left.setFont(m_status_font);
 	m_status_right.setFont(m_status_font);
 	clear();
+	MemoryGovernor::instance().registerConsumer(this);
+}
+
+Picture::~Picture()
+{
+	MemoryGovernor::instance().unregisterConsumer(this);
+	m_generation.fetch_add(1, std::memory_order_acq_rel);
+	m_rescale_generation.fetch_add(1, std::memory_order_acq_rel);
+	m_load_pool.clear();
+	m_load_pool.waitForDone();
 }
 
 // Implement empty event handlers to allow filtering by MainWindow
@@ -129,73 +267,316 @@ bool Picture::loadMedia(const QString &filename)
 	clearState();
 	m_current_file = filename;
 
-	if(m_rotation == 0 && tryLoadImageFromCache(filename))
+	if(tryLoadImageFromCache(filename)) {
+		emit mediaLoaded(filename);
 		return true;
+	}
 
-	QElapsedTimer timer;
-	timer.start();
-
-	QFile file(filename);
-	bool open = file.open(QIODevice::ReadOnly);
-	if(!open) {
+	const QFileInfo fi(filename);
+	if(!fi.isFile() || !fi.isReadable()) {
 		pwarn << "failed to open file for reading";
 		return false;
 	}
-	m_file_buf.setData(file.readAll());
-	file.close();
 
-	QImageReader reader(&m_file_buf);
-	auto format = util::guess_image_format(filename);
-	if(!format.isEmpty()) {
-		reader.setFormat(format);
+	QSettings settings;
+	const bool use_cache = settings.value(QStringLiteral("performance/pixmap_precache_enabled"), true).toBool();
+	if(use_cache && m_rotation != 0) {
+		// cache rotates its downscaled copy if it has one, worker waits for it
+		cache.addFile(filename, this->size(), devicePixelRatioF(), m_rotation);
 	}
 
-	if(reader.imageCount() > 1) {
-		reader.jumpToImage(0);
-		const auto first_frame = reader.read();
+	// drop queued loads of previous files, running ones are cancelled by generation
+	m_load_pool.clear();
+	const bool preview = settings.value(QStringLiteral("performance/progressive_preview"), true).toBool();
+	m_load_pool.start(new LoadMediaTask(this, m_generation.load(std::memory_order_acquire), filename,
+	                                    this->size(), devicePixelRatioF(), m_rotation, use_cache, m_upscale,
+	                                    preview));
+	m_loading = true;
+	m_placeholder_timer.start(placeholder_timeout);
+	return true;
+}
 
-		m_media_size = first_frame.size();
-		m_has_alpha  = first_frame.hasAlphaChannel();
-		m_type       = Type::AnimatedImage;
+/* Waits for cache or reads and decodes file, runs in worker thread. */
+void Picture::loadMediaThreadFunc(uint64_t generation, const QString& filename, QSize window_size, double dpr,
+                                  int rotation, bool use_cache, bool upscale, bool preview)
+{
+	const auto cancelled = [this, generation]() {
+		return m_generation.load(std::memory_order_acquire) != generation;
+	};
 
-		m_file_buf.reset();
-		m_movie = make_movie(&m_file_buf);
+	QElapsedTimer timer;
+	timer.start();
+
+	auto result = std::make_unique<LoadResult>();
+	result->generation = generation;
+	result->filename   = filename;
+
+	const float device_pixel_ratio = dpr; // NOTE: same rounding as resizeMedia()
+	const QSize viewport(window_size.width() * device_pixel_ratio, window_size.height() * device_pixel_ratio);
 
-		if(!m_movie->isValid()) {
-			pwarn << "invalid movie";
-			clear();
-			return false;
+	if(use_cache) {
+		// file may be being loaded by cache right now
+		const int sleep_amount_ms = 20;
+		const int sleep_timeout_ms = 5000;
+		uint64_t unique_id = 0;
+		while(!cancelled()) {
+			if(timer.elapsed() > sleep_timeout_ms) {
+				pwarn << "pixmap query timed out after" << timer.elapsed() << "ms.";
+				break;
+			}
+			auto query_result = cache.getImage(filename, window_size, unique_id, rotation);
+			unique_id = query_result.unique_id;
+			if(query_result.result == ImageCache::State::Loading) {
+				QThread::msleep(sleep_amount_ms);
+				continue;
+			}
+			if(query_result.result == ImageCache::State::Ready) {
+				result->cached = std::move(query_result);
+				result->from_cache = true;
+			}
+			break;
 		}
+	}
 
-		m_movie->setCacheMode(QMovie::CacheNone);
-		this->setMovie(m_movie.get());
-		TaggerStatistics::instance().movieLoadedDirectly(timer.nsecsElapsed() / 1e6);
-	} else {
-		m_pixmap = QPixmap::fromImage(reader.read());
-		if(m_pixmap.isNull()) {
-			pwarn << "invalid pixmap";
-			clear();
-			return false;
+	if(!result->from_cache && !cancelled()) {
+		// decode from contents read ahead by cache, or straight from page cache
+		// through a mapping that is released once decoded
+		const auto encoded = cache.encodedData(filename);
+		std::unique_ptr<MappedFileDevice> mapped;
+		QBuffer buffer;
+		QIODevice* device = &buffer;
+		if(!encoded.isEmpty()) {
+			buffer.setData(encoded);
+		} else {
+			mapped = std::make_unique<MappedFileDevice>(filename);
+			device = mapped.get();
 		}
-		m_pixmap.setDevicePixelRatio(devicePixelRatioF());
+		if(device->open(QIODevice::ReadOnly)) {
+			if(mapped) {
+				mapped->advise(MappedFileDevice::Access::Sequential);
+			}
 
-		m_has_alpha  = m_pixmap.hasAlpha();
-		m_type       = Type::Image;
+			auto format = util::guess_image_format(filename);
+			if(preview && !cancelled()) {
+				readPreview(generation, filename, *device, format, rotation);
+				device->seek(0);
+			}
+
+			QImageReader reader(device);
+			reader.setAutoTransform(true); // apply EXIF orientation
+			if(!format.isEmpty()) {
+				reader.setFormat(format);
+			}
 
-		if (m_rotation) {
-			QTransform t;
-			t.rotate(90.0f * m_rotation);
-			m_pixmap = m_pixmap.transformed(t, Qt::FastTransformation);
+			if(!cancelled() && reader.imageCount() > 1) {
+				reader.jumpToImage(0);
+				result->image    = reader.read();
+				result->animated = true;
+				if(!mapped) {
+					result->data = encoded;
+				} else {
+#ifdef Q_OS_WIN
+					// NOTE: mapped files can not be renamed on Windows, play from heap copy instead
+					mapped->seek(0);
+					result->data     = mapped->readAll();
+#else
+					// animation keeps reading the mapping during playback
+					mapped->advise(MappedFileDevice::Access::WillNeed);
+					mapped->moveToThread(thread());
+					result->device   = std::move(mapped);
+#endif
+				}
+			} else if(!cancelled()) {
+				// huge images are decoded at window size, rotation is applied afterwards
+				const bool transpose = rotation % 2;
+				result->image = util::read_scaled(reader, transpose ? viewport.transposed() : viewport,
+				                                  &result->original_size);
+				if(rotation && !result->image.isNull()) {
+					QTransform t;
+					t.rotate(90.0f * rotation);
+					result->image = result->image.transformed(t, Qt::FastTransformation);
+					if(transpose)
+						result->original_size.transpose();
+				}
+			}
+		} else {
+			pwarn << "failed to open file for reading";
+		}
+	}
+	// fit image to window here, so main thread only has to paint it
+	const QImage& source = result->from_cache ? result->cached.image : result->image;
+	if(!result->animated && !source.isNull() && !cancelled()) {
+		const QSize media_size = result->from_cache ? result->cached.original_size : result->original_size;
+		result->display = fit_display_image(source, display_size(media_size, viewport, upscale), dpr);
+	}
+	result->time_ms = timer.nsecsElapsed() / 1e6;
+
+	{
+		QMutexLocker _{&m_load_result_lock};
+		if(cancelled())
+			return;
+		m_load_result = std::move(result);
+	}
+	QMetaObject::invokeMethod(this, "applyLoadResult", Qt::QueuedConnection);
+}
+
+/* Decodes a cheap low resolution version of large images and shows it while the full one is decoded. */
+void Picture::readPreview(uint64_t generation, const QString& filename, QIODevice& device, const QByteArray& format,
+                          int rotation)
+{
+	// NOTE: other handlers implement scaled size by decoding the full image and scaling it afterwards
+	if(util::detect_image_format(device.peek(util::image_magic_size)) != ImageFormat::Jpeg)
+		return;
+
+	QImageReader reader(&device, format);
+	reader.setAutoTransform(true);
+	const QSize raw_size = reader.size();
+	if(!raw_size.isValid() || static_cast<qint64>(raw_size.width()) * raw_size.height() < preview_min_pixels)
+		return;
+
+	// NOTE: JPEG decodes only DC coefficients at 1/8 scale
+	reader.setScaledSize(QSize(std::max(raw_size.width() / 8, 1), std::max(raw_size.height() / 8, 1)));
+	auto result = std::make_unique<LoadResult>();
+	result->generation = generation;
+	result->filename   = filename;
+	result->image      = reader.read();
+	if(result->image.isNull())
+		return;
+
+	const bool transposed = reader.transformation() & QImageIOHandler::TransformationRotate90;
+	result->original_size = transposed ? raw_size.transposed() : raw_size;
+	if(rotation) {
+		QTransform t;
+		t.rotate(90.0f * rotation);
+		result->image = result->image.transformed(t, Qt::FastTransformation);
+		if(rotation % 2)
+			result->original_size.transpose();
+	}
+
+	{
+		QMutexLocker _{&m_load_result_lock};
+		if(m_generation.load(std::memory_order_acquire) != generation)
+			return;
+		m_preview_result = std::move(result);
+	}
+	QMetaObject::invokeMethod(this, "applyPreviewResult", Qt::QueuedConnection);
+}
+
+/* Shows preview stretched to media display size, unless the load was cancelled or finished already. */
+void Picture::applyPreviewResult()
+{
+	std::unique_ptr<LoadResult> result;
+	{
+		QMutexLocker _{&m_load_result_lock};
+		result = std::move(m_preview_result);
+	}
+	if(!result || result->generation != m_generation.load(std::memory_order_acquire) || m_type != Type::WelcomeText)
+		return;
+
+	m_placeholder_timer.stop();
+	m_image      = std::move(result->image);
+	m_media_size = result->original_size;
+	m_has_alpha  = m_image.hasAlphaChannel();
+	m_type       = Type::Image;
+	updateStyle();
+	updateWidgetSize();
+	setDisplayImage(m_image);
+	m_display_key = m_image.cacheKey();
+}
+
+/* Displays media loaded by worker thread, unless it was cancelled. */
+void Picture::applyLoadResult()
+{
+	std::unique_ptr<LoadResult> result;
+	{
+		QMutexLocker _{&m_load_result_lock};
+		result = std::move(m_load_result);
+	}
+	if(!result || result->generation != m_generation.load(std::memory_order_acquire))
+		return;
+
+	m_loading = false;
+	m_placeholder_timer.stop();
+	const auto filename = result->filename;
+
+	if(result->from_cache) {
+		if(!result->display.isNull()) {
+			m_display = std::move(result->display);
+			m_display_key = result->cached.image.cacheKey();
+		}
+		if(!applyCacheResult(result->cached, result->time_ms)) {
+			emit mediaLoadFailed(filename);
+			return;
+		}
+		emit mediaLoaded(filename);
+		return;
+	}
+
+	if(result->image.isNull()) {
+		pwarn << "invalid media";
+		clear();
+		emit mediaLoadFailed(filename);
+		return;
+	}
+
+	if(result->animated) {
+		m_media_size  = result->image.size();
+		m_has_alpha   = result->image.hasAlphaChannel();
+		m_mapped_file = std::move(result->device);
+		if(!m_mapped_file) {
+			m_file_buf.setData(result->data);
+			result->data.clear();
+		}
+
+		if(!startMovie()) {
+			emit mediaLoadFailed(filename);
+			return;
+		}
+		TaggerStatistics::instance().movieLoadedDirectly(result->time_ms);
+	} else {
+		m_image = std::move(result->image);
+		m_image.setDevicePixelRatio(devicePixelRatioF());
+		if(!result->display.isNull()) {
+			m_display = std::move(result->display);
+			m_display_key = m_image.cacheKey();
 		}
 
-		m_media_size = m_pixmap.size();
+		m_has_alpha  = m_image.hasAlphaChannel();
+		m_type       = Type::Image;
+		m_media_size = result->original_size; // NOTE: huge images are decoded at window size
 
-		TaggerStatistics::instance().pixmapLoadedDirectly(timer.nsecsElapsed() * 1e-6);
+		TaggerStatistics::instance().pixmapLoadedDirectly(result->time_ms);
 	}
 
 	updateStyle();
 	resizeMedia();
-	return true;
+	MemoryGovernor::instance().usageChanged();
+	emit mediaLoaded(filename);
+}
+
+void Picture::showPreview(const QString& filename)
+{
+	clearState();
+	m_current_file = filename;
+
+	const auto query_result = cache.getImage(filename, this->size());
+	if(query_result.result == ImageCache::State::Ready) {
+		auto image = query_result.image;
+		if(query_result.animation && !query_result.animation->frames.empty())
+			image = query_result.animation->frames.front();
+
+		if(!image.isNull()) {
+			m_image      = image;
+			m_media_size = query_result.original_size;
+			m_has_alpha  = m_image.hasAlphaChannel();
+			m_type       = Type::Image;
+			updateStyle();
+			resizeMedia();
+			return;
+		}
+	}
+	updateStyle();
+	showText(QFileInfo(filename).fileName().toHtmlEscaped());
 }
 
 QSize Picture::sizeHint() const
@@ -203,6 +584,113 @@ QSize Picture::sizeHint() const
 	return m_widget_size;
 }
 
+bool Picture::isAnimated() const
+{
+	return m_type == Type::AnimatedImage;
+}
+
+bool Picture::isPlaying() const
+{
+	if(m_animation && !m_animation->frames.empty())
+		return m_playing;
+	return m_movie && m_movie->state() == QMovie::Running;
+}
+
+void Picture::setPlaying(bool playing)
+{
+	if(m_animation && !m_animation->frames.empty()) {
+		if(playing == m_playing)
+			return;
+		m_playing = playing;
+		if(!playing) {
+			m_frame_timer.stop();
+			return;
+		}
+		const bool finished = m_animation->loop_count >= 0 && m_loops_done > m_animation->loop_count;
+		if(finished) { // restart like QMovie does
+			m_loops_done = 0;
+			m_frame = 0;
+			showFrame();
+		}
+		m_frame_timer.start(frameDelay());
+		return;
+	}
+	if(m_movie)
+		m_movie->setPaused(!playing);
+}
+
+float Picture::frameRate() const
+{
+	int delay = 0;
+	if(m_animation && !m_animation->frames.empty()) {
+		delay = frameDelay();
+	} else if(m_movie) {
+		delay = m_movie->nextFrameDelay();
+	}
+	if(delay > 0)
+		return 1000.0f / delay;
+	return 0.0f;
+}
+
+/** Sets up QMovie over mapped file or encoded data in m_file_buf. */
+bool Picture::startMovie()
+{
+	m_type = Type::AnimatedImage;
+	QIODevice* device = m_mapped_file ? static_cast<QIODevice*>(m_mapped_file.get()) : &m_file_buf;
+	if(!device->isOpen())
+		device->open(QIODevice::ReadOnly);
+	device->reset();
+	m_movie = make_movie(device);
+
+	if(!m_movie->isValid()) {
+		pwarn << "invalid movie";
+		clear();
+		return false;
+	}
+
+	m_movie->setCacheMode(QMovie::CacheNone);
+	m_display = QImage();
+	this->setMovie(m_movie.get());
+	return true;
+}
+
+/** Displays current frame of cached animation scaled to widget size. */
+void Picture::showFrame()
+{
+	Q_ASSERT(m_animation && m_frame < m_animation->frames.size());
+	// NOTE: frames of other size are stretched by painter, resampling each one would stall playback
+	setDisplayImage(m_animation->frames[m_frame]);
+}
+
+/** Advances cached animation, stops after the last loop. */
+void Picture::nextFrame()
+{
+	if(!m_animation || m_animation->frames.empty())
+		return;
+
+	if(++m_frame >= m_animation->frames.size()) {
+		++m_loops_done;
+		if(m_animation->loop_count >= 0 && m_loops_done > m_animation->loop_count) {
+			m_frame = m_animation->frames.size() - 1;
+			m_playing = false;
+			return;
+		}
+		m_frame = 0;
+	}
+	showFrame();
+	if(m_playing)
+		m_frame_timer.start(frameDelay());
+}
+
+/** Delay after current frame of cached animation. */
+int Picture::frameDelay() const
+{
+	const auto& delays = m_animation->delays;
+	if(m_frame < delays.size() && delays[m_frame] > 0)
+		return delays[m_frame];
+	return default_frame_delay;
+}
+
 QSize Picture::mediaSize() const
 {
 	return m_media_size;
@@ -215,7 +703,8 @@ QSizeF Picture::mediaDisplaySize() const
 	switch (m_type) {
 	case Type::AnimatedImage:
 		size = m_widget_size;
-		size *= devicePixelRatioF();
+		if(m_movie) // frames of cached animations are already in device pixels
+			size *= devicePixelRatioF();
 		break;
 	case Type::Image:
 		size = m_widget_size;
@@ -239,6 +728,8 @@ bool Picture::upscalingEnabled() const
 
 void Picture::setRotation(int steps)
 {
+	if(steps == m_rotation)
+		return;
 	m_rotation = steps;
 	if (m_type == Type::Image) {
 		loadMedia(m_current_file);
@@ -255,33 +746,32 @@ int Picture::rotation() const
 void Picture::resizeMedia()
 {
 	// Pixmaps use separate scaling factor set when loading image, so we compensate here to be pixel-perfect.
-	// GIFs don't have such scaling (and thus are not actually pixel-perfect), hence this check.
-	const float device_pixel_ratio = (m_type == Type::Image) ? devicePixelRatioF() : 1.0f;
-	const int viewport_width = size().width() * device_pixel_ratio;
-	const int viewport_height = size().height() * device_pixel_ratio;
-
-	if (m_upscale) {
-		m_widget_size = m_media_size.scaled(viewport_width, viewport_height, Qt::KeepAspectRatio);
-	} else {
-		m_widget_size = m_media_size.scaled(std::min(viewport_width, m_media_size.width()),
-		                                    std::min(viewport_height, m_media_size.height()),
-		                                    Qt::KeepAspectRatio);
-	}
+	// GIFs played by QMovie don't have such scaling (and thus are not actually pixel-perfect), hence this check.
+	updateWidgetSize();
 
 	switch(m_type) {
 		case Type::Image:
-
-			if(m_pixmap.size() == m_widget_size)
-			{
-				QLabel::setPixmap(m_pixmap); // for pixmaps from cache
+			if(m_display_key == m_image.cacheKey() && m_display.size() == m_widget_size) {
+				setDisplayImage(m_display); // prepared by worker thread
+			} else if(m_image.size() == m_widget_size && is_display_format(m_image)) {
+				setDisplayImage(m_image);
+				m_display_key = m_image.cacheKey();
 			} else {
-				pdbg << "resizing pixmap from" << m_pixmap.size() << "to" << m_widget_size;
-				QLabel::setPixmap(m_pixmap.scaled(m_widget_size,
-				                                  Qt::IgnoreAspectRatio,
-							          Qt::SmoothTransformation));
+				// current image is stretched until the worker is done, display of previous one never is
+				pdbg << "resizing image from" << m_image.size() << "to" << m_widget_size;
+				if(m_display_key != m_image.cacheKey()) {
+					m_display = is_display_format(m_image) ? m_image : QImage();
+					m_display_key = m_display.isNull() ? 0 : m_image.cacheKey();
+				}
+				startRescale();
+				update();
 			}
 			break;
 		case Type::AnimatedImage:
+			if(m_animation && !m_animation->frames.empty()) {
+				showFrame();
+				break;
+			}
 			Q_ASSERT(m_movie != nullptr);
 			m_movie->stop();
 			m_movie->setScaledSize(m_widget_size);
@@ -293,6 +783,112 @@ void Picture::resizeMedia()
 	emit mediaResized();
 }
 
+/** Fits media size to widget size. */
+void Picture::updateWidgetSize()
+{
+	// Pixmaps use separate scaling factor set when loading image, so we compensate here to be pixel-perfect.
+	// GIFs played by QMovie don't have such scaling (and thus are not actually pixel-perfect), hence this check.
+	const bool scaled = m_type == Type::Image || m_animation;
+
+	m_widget_size = display_size(m_media_size, scaled ? viewportSize() : size(), m_upscale);
+}
+
+QSize Picture::viewportSize() const
+{
+	const float device_pixel_ratio = devicePixelRatioF();
+	const int viewport_width = size().width() * device_pixel_ratio;
+	const int viewport_height = size().height() * device_pixel_ratio;
+	return QSize(viewport_width, viewport_height);
+}
+
+/** Starts resampling current image to widget size in worker thread. */
+void Picture::startRescale()
+{
+	const auto generation = m_rescale_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+	m_load_pool.start(new RescaleTask(this, generation, m_image, m_image.cacheKey(), m_widget_size,
+	                                  devicePixelRatioF()));
+}
+
+/* Resamples image for display, runs in worker thread. */
+void Picture::rescaleThreadFunc(uint64_t generation, const QImage& image, qint64 key, QSize size, double dpr)
+{
+	const auto current = [this, generation]() {
+		return m_rescale_generation.load(std::memory_order_acquire) == generation;
+	};
+	if(!current())
+		return;
+
+	auto display = fit_display_image(image, size, dpr);
+	{
+		QMutexLocker _{&m_load_result_lock};
+		if(!current())
+			return;
+		m_rescaled = std::move(display);
+		m_rescaled_key = key;
+	}
+	QMetaObject::invokeMethod(this, "applyRescaleResult", Qt::QueuedConnection);
+}
+
+/* Displays image resampled by worker thread, unless it is out of date. */
+void Picture::applyRescaleResult()
+{
+	QImage image;
+	qint64 key;
+	{
+		QMutexLocker _{&m_load_result_lock};
+		image = std::move(m_rescaled);
+		key = m_rescaled_key;
+		m_rescaled = QImage();
+	}
+	if(image.isNull() || m_type != Type::Image || key != m_image.cacheKey() || image.size() != m_widget_size)
+		return;
+
+	setDisplayImage(image);
+	m_display_key = key;
+	MemoryGovernor::instance().usageChanged();
+}
+
+/** Shows \p image, converted to display format if needed, instead of label contents. */
+void Picture::setDisplayImage(QImage image)
+{
+	if(!text().isEmpty() || movie())
+		QLabel::clear();
+	m_display = display_image(image);
+	m_display.setDevicePixelRatio(devicePixelRatioF());
+	update();
+}
+
+/** Shows \p text instead of displayed image. */
+void Picture::showText(const QString& text)
+{
+	m_display = QImage();
+	m_display_key = 0;
+	setText(text);
+}
+
+/** Paints displayed image centered over label background. */
+void Picture::paintEvent(QPaintEvent* e)
+{
+	QLabel::paintEvent(e); // background, text or movie
+	if(m_display.isNull() || !text().isEmpty() || movie())
+		return;
+
+	// stretch displayed image while it is being resampled to new size
+	const QSize size = m_widget_size.isEmpty() || m_type == Type::WelcomeText ? m_display.size() : m_widget_size;
+	const qreal dpr = size == m_display.size() ? m_display.devicePixelRatio() : devicePixelRatioF();
+	const QSizeF logical_size = QSizeF(size) / dpr;
+	QRectF target(QPointF(), logical_size);
+	target.moveCenter(QRectF(contentsRect()).center());
+
+	QPainter painter(this);
+	if(size == m_display.size()) {
+		painter.drawImage(target.topLeft(), m_display);
+	} else {
+		painter.setRenderHint(QPainter::SmoothPixmapTransform);
+		painter.drawImage(target, m_display);
+	}
+}
+
 /** Applies checkerboard background if media has alpha channel. */
 void Picture::updateStyle()
 {
@@ -306,9 +902,20 @@ void Picture::updateStyle()
 /** Sets data members to default values. */
 void Picture::clearState()
 {
-	m_pixmap.loadFromData(nullptr);
+	m_image = QImage();
 	m_movie.reset(nullptr);
+	m_generation.fetch_add(1, std::memory_order_acq_rel); // cancel pending load
+	m_rescale_generation.fetch_add(1, std::memory_order_acq_rel);
+	m_placeholder_timer.stop();
+	m_frame_timer.stop();
+	m_loading = false;
+	m_animation = nullptr;
+	m_frame = 0;
+	m_loops_done = 0;
+	m_playing = false;
 	m_file_buf.close();
+	m_file_buf.setData(QByteArray());
+	m_mapped_file.reset(); // NOTE: after movie that reads from it
 	m_widget_size = m_media_size = QSize(0,0);
 	m_type = Type::WelcomeText;
 	m_has_alpha = false;
@@ -318,7 +925,58 @@ void Picture::clear()
 {
 	clearState();
 	updateStyle();
-	setText(util::read_resource_html("welcome.html"));
+	showText(util::read_resource_html("welcome.html"));
+	MemoryGovernor::instance().usageChanged();
+}
+
+/// Approximate size of decoded image data of \p size.
+static size_t image_bytes(QSize size, int depth = 32)
+{
+	return static_cast<size_t>(size.width()) * size.height() * depth / 8;
+}
+
+size_t Picture::memoryUsage() const
+{
+	// NOTE: mapped file is backed by page cache and is not counted
+	size_t usage = static_cast<size_t>(m_file_buf.data().size());
+	switch(m_type) {
+	case Type::Image:
+		usage += image_bytes(m_image.size(), m_image.depth());
+		if(m_display.cacheKey() != m_image.cacheKey())
+			usage += image_bytes(m_display.size(), m_display.depth()); // scaled copy being displayed
+		break;
+	case Type::AnimatedImage:
+		if(m_animation && !m_animation->frames.empty()) {
+			usage += m_animation->bytes() + image_bytes(m_widget_size); // frames and scaled copy of current one
+		} else {
+			usage += image_bytes(m_media_size) + image_bytes(m_widget_size); // current frame and its scaled copy
+		}
+		break;
+	default:
+		break;
+	}
+	return usage;
+}
+
+MemoryConsumer::Priority Picture::memoryPriority() const
+{
+	return Priority::Display;
+}
+
+void Picture::setMemoryAllowance(size_t bytes)
+{
+	if(m_type != Type::Image || memoryUsage() <= bytes)
+		return;
+
+	// keep only the displayed version, resize timer reloads the full one when needed
+	if(m_widget_size.isEmpty() || m_image.width() <= m_widget_size.width())
+		return;
+
+	pdbg << "dropping full resolution image" << m_image.size() << "to release memory";
+	m_image = m_display.size() == m_widget_size ? m_display
+	                                            : fit_display_image(m_image, m_widget_size, devicePixelRatioF());
+	setDisplayImage(m_image);
+	m_display_key = m_image.cacheKey();
 }
 
 void Picture::setStatusText(const QString& left, const QString& right)
@@ -333,9 +991,13 @@ void Picture::setUpscalingEnabled(bool enabled)
 	resizeMedia();
 }
 
-/* Restart timer on resize */
+/* Stretch displayed image and restart timer on resize */
 void Picture::resizeEvent(QResizeEvent*)
 {
+	if(m_type == Type::Image || m_animation) {
+		updateWidgetSize();
+		update();
+	}
 	m_resize_timer.start(resize_timeout);
 }
 
@@ -348,38 +1010,68 @@ bool Picture::tryLoadImageFromCache(const QString& filename)
 	QElapsedTimer timer;
 	timer.start();
 
-	const int sleep_amount_ms = 20;
-	const int sleep_timeout_ms = 5000;
-	uint64_t unique_id = 0;
-
-	while(true) {
-		if(timer.elapsed() > sleep_timeout_ms) {
-			pwarn << "pixmap query timed out after" << timer.elapsed() << "ms.";
-			break;
-		}
+	// NOTE: compact entries are converted to display format by worker thread, as images loaded from file are
+	const auto displayable = [](const ImageCache::QueryResult& r) {
+		return r.result == ImageCache::State::Ready && (r.animation || is_display_format(r.image));
+	};
 
-		auto query_result = cache.getImage(filename, this->size(), unique_id);
-		unique_id = query_result.unique_id;
+	// slide show frames are already of display size, shown without rescaling
+	if(m_rotation == 0) {
+		const auto frame = cache.getFrame(filename, viewportSize(), m_upscale);
+		if(displayable(frame))
+			return applyCacheResult(frame, timer.nsecsElapsed() / 1e6);
+	}
 
-		switch (query_result.result) {
-		case ImageCache::State::Loading:
-			QThread::msleep(sleep_amount_ms);
-			continue;
-		case ImageCache::State::Ready:
-			m_pixmap     = QPixmap::fromImage(query_result.image);
-			m_media_size = query_result.original_size;
-			m_has_alpha  = m_pixmap.hasAlpha();
-			m_type       = Type::Image;
-			updateStyle();
-			resizeMedia();
-			TaggerStatistics::instance().pixmapLoadedFromCache(timer.nsecsElapsed() / 1e6);
-			return true;
-		default:
-			break; // doesn't break the loop, kept so I remember that
-		}
-		break;
+	// NOTE: does not wait if the file is still being loaded, worker thread does
+	const auto query_result = cache.getImage(filename, this->size(), 0, m_rotation);
+	if(displayable(query_result))
+		return applyCacheResult(query_result, timer.nsecsElapsed() / 1e6);
+	if(query_result.result == ImageCache::State::Ready) {
+		pdbg << "cached image of" << filename << "needs conversion, loading asynchronously...";
+		return false;
 	}
 
-	pwarn << "cache miss:" << filename << "/" << unique_id <<", trying to load directly...";
+	pdbg << "cache miss:" << filename << "/" << query_result.unique_id << ", loading asynchronously...";
 	return false;
 }
+
+/* Displays image or animation returned by cache query. */
+bool Picture::applyCacheResult(const ImageCache::QueryResult& query_result, double time_ms)
+{
+	if(query_result.animation) {
+		m_media_size = query_result.original_size;
+		if(query_result.animation->frames.empty()) {
+			// frames did not fit into cache, decode them during playback
+			m_has_alpha = false;
+			m_file_buf.setData(query_result.animation->encoded);
+			{
+				QImageReader reader(&m_file_buf, query_result.animation->format);
+				m_has_alpha = reader.read().hasAlphaChannel();
+			}
+			m_file_buf.close();
+			if(!startMovie())
+				return false;
+		} else {
+			m_animation = query_result.animation;
+			m_has_alpha = m_animation->frames.front().hasAlphaChannel();
+			m_type      = Type::AnimatedImage;
+			m_playing   = true;
+		}
+		updateStyle();
+		resizeMedia();
+		if(m_animation)
+			m_frame_timer.start(frameDelay());
+		MemoryGovernor::instance().usageChanged();
+		TaggerStatistics::instance().pixmapLoadedFromCache(time_ms);
+		return true;
+	}
+	m_image      = query_result.image;
+	m_media_size = query_result.original_size;
+	m_has_alpha  = m_image.hasAlphaChannel();
+	m_type       = Type::Image;
+	updateStyle();
+	resizeMedia();
+	MemoryGovernor::instance().usageChanged();
+	TaggerStatistics::instance().pixmapLoadedFromCache(time_ms);
+	return true;
+}
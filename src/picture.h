@@ -12,37 +12,78 @@
  *  @brief Class @ref Picture
  */
 
+#include <atomic>
 #include <memory>
 #include <QBuffer>
 #include <QLabel>
 #include <QMovie>
-#include <QPixmap>
+#include <QImage>
+#include <QMutex>
 #include <QString>
+#include <QThreadPool>
 #include <QTimer>
 #include "util/imagecache.h"
+#include "util/mapped_file_device.h"
+#include "util/memory_governor.h"
 
+class QPaintEvent;
 class QResizeEvent;
 class QDragEnterEvent;
 class QDragMoveEvent;
 class QDropEvent;
 
 
-/// Widget for displaying images and GIFs
-class Picture : public QLabel
+/*!
+ * \brief Widget for displaying images and GIFs
+ *
+ * Animations preloaded by \ref ImageCache are played from their decoded
+ * frames, other animations are decoded by QMovie during playback.
+ *
+ * Media files that are not cached are read and decoded in a worker thread.
+ * Each load gets a new generation number, results of older loads are dropped.
+ *
+ * Images and cached animation frames are painted directly from a QImage
+ * already fitted to widget size in a display-native format. Worker thread
+ * prepares it for loaded images, so showing them takes no conversion.
+ * On resize, the displayed image is stretched while a worker thread
+ * resamples the image to the new size.
+ *
+ * Large JPEG images, which can be decoded cheaply at reduced size, are first
+ * shown as a stretched 1/8 scale preview, until the full decode is done.
+ *
+ * Memory held for displayed media is reported to \ref MemoryGovernor.
+ * When asked to release memory, full resolution image is replaced with
+ * its displayed version and reloaded on the next resize.
+ */
+class Picture : public QLabel, public MemoryConsumer
 {
 	Q_OBJECT
 public:
 	/// Construct Picture object and display welcome text.
 	explicit Picture(QWidget *parent = nullptr);
+	~Picture() override;
 
 	/*!
 	 * \brief Load and display media.
 	 * \param filename Media file to show.
-	 * \retval true Loaded successfully.
-	 * \retval false Failed to load media.
+	 * \retval true Media was loaded from cache or is being loaded.
+	 * \retval false Failed to open media file.
+	 *
+	 * Cached media is shown immediately, otherwise the file is loaded
+	 * asynchronously and a placeholder is shown if it takes a while.
+	 * Either \ref mediaLoaded() or \ref mediaLoadFailed() is emitted
+	 * once done, unless cancelled by another load or \ref clear().
 	 */
 	bool loadMedia(const QString& filename);
 
+	/*!
+	 * \brief Show cached version of \p filename without reading the file.
+	 *
+	 * Shows file name as placeholder if the file is not cached yet.
+	 * Media should be loaded with \ref loadMedia() afterwards.
+	 */
+	void showPreview(const QString& filename);
+
 	/// Does the current media has alpha channel.
 	bool hasAlpha() const;
 
@@ -61,17 +102,47 @@ public:
 	/// Display dimensions of loaded media.
 	QSizeF mediaDisplaySize() const;
 
+	/// Size of area images are displayed in, in device pixels.
+	QSize viewportSize() const;
+
 	/// Size hint of the widget wrt. media size
 	QSize sizeHint() const override;
 
+	/// Is the current media an animated image.
+	bool isAnimated() const;
+
+	/// Is the current animation playing.
+	bool isPlaying() const;
+
+	/// Pause or resume the current animation.
+	void setPlaying(bool playing);
+
+	/// Frame rate of the current animation at its current frame, \c 0 if unknown.
+	float frameRate() const;
+
 	/// \ref ImageCache object
 	ImageCache cache;
 
+	/// Memory held by encoded file data, decoded image and displayed frame.
+	size_t   memoryUsage() const override;
+
+	/// Displayed media is \a Priority::Display.
+	Priority memoryPriority() const override;
+
+	/// Drop full resolution image if memory usage is above \p bytes.
+	void     setMemoryAllowance(size_t bytes) override;
+
 signals:
 
 	/// Emitted when media display size has changed.
 	void mediaResized();
 
+	/// Emitted when media \p filename has been loaded and displayed.
+	void mediaLoaded(const QString& filename);
+
+	/// Emitted when media \p filename could not be decoded.
+	void mediaLoadFailed(const QString& filename);
+
 public slots:
 
 	/// Clear media and display welcome text.
@@ -88,6 +159,7 @@ protected:
 	void dragMoveEvent(QDragMoveEvent*)   override;
 	void dropEvent(QDropEvent*)           override;
 	void resizeEvent(QResizeEvent*)       override;
+	void paintEvent(QPaintEvent*)         override;
 
 private:
 	enum class Type {
@@ -98,10 +170,47 @@ private:
 
 	using MoviePtr = std::unique_ptr<QMovie>;
 
+	/// Media loaded by worker thread.
+	struct LoadResult
+	{
+		uint64_t   generation = 0;
+		QString    filename;
+		ImageCache::QueryResult cached{}; ///< Cache query result if \p from_cache is set.
+		QImage     image;                 ///< Decoded image or first frame of animation.
+		QImage     display;               ///< Image fitted to window in display format, if not animated.
+		QSize      original_size;         ///< Full size of \p image, it is decoded smaller if huge.
+		QByteArray data;                  ///< Encoded file data of animation, if not mapped.
+		std::unique_ptr<MappedFileDevice> device; ///< Mapped file of animation.
+		bool       from_cache = false;
+		bool       animated   = false;
+		double     time_ms    = 0.0;
+	};
+
 	static constexpr int resize_timeout = 100; //ms
+	static constexpr int placeholder_timeout = 150; //ms
+
+	friend struct LoadMediaTask;
+	friend struct RescaleTask;
 
 	bool tryLoadImageFromCache(const QString& filename);
+	bool applyCacheResult(const ImageCache::QueryResult& query_result, double time_ms);
+	void loadMediaThreadFunc(uint64_t generation, const QString& filename, QSize window_size, double dpr,
+	                         int rotation, bool use_cache, bool upscale, bool preview);
+	void readPreview(uint64_t generation, const QString& filename, QIODevice& device, const QByteArray& format,
+	                 int rotation);
+	Q_INVOKABLE void applyLoadResult();
+	Q_INVOKABLE void applyPreviewResult();
+	void startRescale();
+	void rescaleThreadFunc(uint64_t generation, const QImage& image, qint64 key, QSize size, double dpr);
+	Q_INVOKABLE void applyRescaleResult();
+	bool startMovie();
+	void showFrame();
+	void nextFrame();
+	int  frameDelay() const;
 	void resizeMedia();
+	void updateWidgetSize();
+	void setDisplayImage(QImage image);
+	void showText(const QString& text);
 	void updateStyle();
 	void clearState();
 
@@ -109,13 +218,31 @@ private:
 	QSize     m_widget_size;
 	QSize     m_media_size;
 	QTimer    m_resize_timer;
+	QTimer    m_placeholder_timer;
+	QThreadPool m_load_pool;
+	QMutex    m_load_result_lock;
+	std::unique_ptr<LoadResult> m_load_result;
+	std::unique_ptr<LoadResult> m_preview_result;
+	std::atomic<uint64_t> m_generation{0};
+	std::atomic<uint64_t> m_rescale_generation{0};
+	QImage    m_rescaled;       ///< Result of rescale worker, guarded by \p m_load_result_lock.
+	qint64    m_rescaled_key;   ///< Cache key of image \p m_rescaled was made from.
 	QBuffer   m_file_buf;
-	QPixmap   m_pixmap;
+	std::unique_ptr<MappedFileDevice> m_mapped_file;
+	QImage    m_image;
+	QImage    m_display;
+	qint64    m_display_key;
 	MoviePtr  m_movie;
+	ImageCache::AnimationPtr m_animation;
+	QTimer    m_frame_timer;
+	size_t    m_frame;
+	int       m_loops_done;
+	bool      m_playing;
 	Type      m_type;
 	int       m_rotation;
 	bool      m_has_alpha;
 	bool      m_upscale;
+	bool      m_loading; ///< Media is being decoded by worker thread.
 
 	QLabel    m_status_left;
 	QLabel    m_status_right;
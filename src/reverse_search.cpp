@@ -22,6 +22,7 @@
 #include <stdexcept>
 #include <memory>
 #include "util/size.h"
+#include "util/image_probe.h"
 #include "util/network.h"
 
 namespace logging_category {
@@ -61,9 +62,10 @@ void ReverseSearch::upload_file()
 
 	{ // new scope since we don't need those afterwards
 		QImageReader reader(&m_image_file);
-		const auto format = reader.format();
+		const auto info = util::probe_image_file(m_image_file.fileName());
+		const auto format = util::image_format_name(info.format);
 		QByteArray formats{iqdb_supported_formats};
-		if(!formats.contains(format.toUpper())) {
+		if(format.isEmpty() || !formats.contains(format.toUpper())) {
 			QMessageBox::critical(nullptr,
 				tr("Reverse search"),
 				tr("<p>Reverse search of <b>%1</b> failed: Unsupported file format.</p><p>Supported formats are: <b>%2</b>.</p>")
@@ -72,7 +74,7 @@ void ReverseSearch::upload_file()
 			return;
 		}
 
-		auto dimensions = reader.size();
+		auto dimensions = info.size;
 		if(!dimensions.isValid()) {
 			pwarn << "Could not determine image dimensions";
 			return;
@@ -6,6 +6,7 @@
  */
 
 #include "statistics.h"
+#include "util/imagecache.h"
 #include "util/misc.h"
 #include "util/size.h"
 #include "util/strings.h"
@@ -14,6 +15,10 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QDateTime>
+#include <QApplication>
+#include <QClipboard>
+#include <QJsonDocument>
+#include <QPushButton>
 
 namespace logging_category {Q_LOGGING_CATEGORY(stats, "Statistics")}
 #define pdbg qCDebug(logging_category::stats)
@@ -49,6 +54,11 @@ TaggerStatistics &TaggerStatistics::instance()
 }
 
 
+void TaggerStatistics::setImageCache(const ImageCache *cache)
+{
+	m_image_cache = cache;
+}
+
 TaggerStatistics::TaggerStatistics() : QObject(nullptr)
 {
 	m_elapsed_timer.start();
@@ -236,7 +246,8 @@ void TaggerStatistics::showStatsDialog()
 		               "The stats displayed here are from previous launches.</p>"));
 	}
 
-	if(direct_pixmap_avg.count || cached_pixmap_avg.count || direct_movie_avg.count) {
+	const auto cache_text = imageCacheStats();
+	if(direct_pixmap_avg.count || cached_pixmap_avg.count || direct_movie_avg.count || !cache_text.isEmpty()) {
 		QLocale loc;
 		auto min_direct = direct_pixmap_minmax.hasMin() ? loc.toString(direct_pixmap_minmax.min, 'f', 2) : QStringLiteral("0");
 		auto max_direct = direct_pixmap_minmax.hasMax() ? loc.toString(direct_pixmap_minmax.max, 'f', 2) : QStringLiteral("0");
@@ -271,10 +282,64 @@ void TaggerStatistics::showStatsDialog()
 				min_movie,
 				max_movie));
 		}
+		perf_text.append(cache_text);
 		desc.append(util::read_resource_html("performance.html").arg(perf_text));
 	}
 
 	QMessageBox mb(QMessageBox::Information, tr("Statistics"), desc, QMessageBox::Ok, nullptr);
 	mb.setTextInteractionFlags(Qt::TextBrowserInteraction);
+	QPushButton* copy_json = nullptr;
+	if(m_image_cache) {
+		copy_json = mb.addButton(tr("Copy cache stats as JSON"), QMessageBox::ActionRole);
+	}
 	mb.exec();
+
+	if(copy_json && mb.clickedButton() == copy_json) {
+		const auto json = QJsonDocument(m_image_cache->statistics().toJson()).toJson(QJsonDocument::Indented);
+		QApplication::clipboard()->setText(QString::fromUtf8(json));
+	}
+}
+
+/// Image cache counters formatted with performance_image_cache.html, empty if cache was not used.
+QString TaggerStatistics::imageCacheStats() const
+{
+	if(!m_image_cache)
+		return QString();
+
+	const auto s = m_image_cache->statistics();
+	const auto queries = s.hits + s.misses;
+	if(queries == 0 && s.formats.empty())
+		return QString();
+
+	QLocale loc;
+	const auto loaded = s.prefetch_used + s.prefetch_wasted;
+	const auto hit_ratio = queries ? loc.toString(100.0 * s.hits / queries, 'f', 1) : QStringLiteral("0");
+	const auto used_ratio = loaded ? loc.toString(100.0 * s.prefetch_used / loaded, 'f', 1) : QStringLiteral("0");
+
+	QString formats_str;
+	for(const auto& f : s.formats) {
+		using Stats = ImageCache::Statistics;
+		formats_str += tr("<li>&nbsp;&nbsp;%1&nbsp;&ndash; <strong>&nbsp;%n</strong> decoded, "
+		                  "decode median &le;&nbsp;%2&nbsp;ms, 90th percentile &le;&nbsp;%3&nbsp;ms, "
+		                  "scale median &le;&nbsp;%4&nbsp;ms</li>", "formats", static_cast<int>(f.decoded))
+			.arg(QString::fromLatin1(f.format).toUpper(),
+			     loc.toString(Stats::percentile(f.decode_time, 0.5)),
+			     loc.toString(Stats::percentile(f.decode_time, 0.9)),
+			     loc.toString(Stats::percentile(f.scale_time, 0.5)));
+	}
+
+	return util::read_resource_html("performance_image_cache.html")
+		.arg(QString::number(s.hits),			// 1
+		     QString::number(s.misses),			// 2
+		     QString::number(s.eviction_misses),	// 3
+		     hit_ratio,					// 4
+		     QString::number(s.prefetch_used),		// 5
+		     QString::number(s.prefetch_wasted),	// 6
+		     used_ratio,				// 7
+		     QString::number(s.tasks_rejected),	// 8
+		     util::size::printable(s.bytes))		// 9
+		.arg(util::size::printable(s.capacity),	// 10
+		     QString::number(s.entries),		// 11
+		     QString::number(s.queue_depth),		// 12
+		     formats_str);				// 13
 }
@@ -17,6 +17,8 @@
 #include <QElapsedTimer>
 #include <QSize>
 
+class ImageCache;
+
 /// The TaggerStatistics singleton collects and displays various statistics.
 class TaggerStatistics : public QObject {
 	Q_OBJECT
@@ -25,6 +27,9 @@ public:
 	/// Returns reference to an instance of TaggerStatistics
 	static TaggerStatistics& instance();
 
+	/// Set image cache whose counters are displayed in statistics dialog, or \c nullptr.
+	void setImageCache(const ImageCache* cache);
+
 public slots:
 	/// Collects information about opened file.
 	void fileOpened(const QString& filename, QSize dimensions);
@@ -54,8 +59,11 @@ private:
 	TaggerStatistics();
 	~TaggerStatistics() override;
 
+	QString imageCacheStats() const;
+
 	QSettings m_settings;
 	QElapsedTimer m_elapsed_timer;
+	const ImageCache* m_image_cache = nullptr;
 
 
 	template<typename T>
@@ -17,6 +17,7 @@
 #include <QStandardPaths>
 #include <QUrl>
 #include <QInputDialog>
+#include <QtMultimedia/QMediaMetaData>
 #include <algorithm>
 #include <cmath>
 #include "global_enums.h"
@@ -40,13 +41,37 @@ namespace logging_category {
 	static int qt_ntfs_permission_lookup;
 #endif
 
+/// Task for probing header of opened file for statistics in background.
+struct StatsProbeTask : public QRunnable
+{
+	StatsProbeTask(Tagger* t, const QString& f) : tagger(t), file(f)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		tagger->statsProbeThreadFunc(file);
+	}
+
+	Tagger* tagger;
+	QString file;
+};
+
 Tagger::Tagger(QWidget *_parent) :
 	QWidget(_parent)
 {
 	installEventFilter(_parent);
 	m_picture.installEventFilter(_parent);
+	m_stats_probe_pool.setMaxThreadCount(1);
 	m_file_queue.setExtensionFilter(util::supported_image_formats_namefilter() +
 	                                util::supported_video_formats_namefilter());
+	m_file_queue.duplicates().setImageCache(&m_picture.cache);
+	m_file_queue.tagSuggester().setImageCache(&m_picture.cache);
+
+	const auto cache_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	if(!cache_dir.isEmpty() && QDir().mkpath(cache_dir))
+		m_file_queue.tagSuggester().setIndexPath(QDir(cache_dir).filePath(QStringLiteral("similar-images.dat")));
 
 	m_main_layout.setContentsMargins(0, 0, 0, 0);
 	m_main_layout.setSpacing(0);
@@ -71,11 +96,72 @@ Tagger::Tagger(QWidget *_parent) :
 	connect(&m_input, &TagInput::parseError, this, &Tagger::parseError);
 	connect(&m_picture, &Picture::linkActivated, this, &Tagger::linkActivated);
 	connect(&m_picture, &Picture::mediaResized, this, &Tagger::mediaResized);
+	connect(&m_picture, &Picture::mediaResized, this, [this]()
+	{
+		// frames prepared for previous size would be rescaled when shown
+		if(m_slideshow.isActive() && m_slideshow.setViewport(m_picture.viewportSize(),
+		                                                     m_picture.devicePixelRatioF(),
+		                                                     m_picture.upscalingEnabled()))
+			prefetchAround();
+	});
+	connect(&m_slideshow, &SlideshowScheduler::advance, this, [this]()
+	{
+		if(!m_file_queue.empty())
+			nextFile();
+	});
 	connect(this, &Tagger::fileRenamed, &TaggerStatistics::instance(), &TaggerStatistics::fileRenamed);
 	connect(this, &Tagger::fileOpened, this, [this](const auto& file)
 	{
 		m_fetcher.abort();
-		TaggerStatistics::instance().fileOpened(file, m_picture.mediaSize());
+		m_input.setSuggestedTags({});
+		if(m_file_queue.tagSuggestionsEnabled() && !mediaIsVideo())
+			m_file_queue.tagSuggester().requestSuggestions(file);
+
+		if(mediaIsVideo()) {
+			TaggerStatistics::instance().fileOpened(file, m_picture.mediaSize());
+			return;
+		}
+		// NOTE: dimensions come from file header, files skipped before they load count too
+		const auto info = m_file_queue.imageInfo(file);
+		if(info.isValid()) {
+			if(file != m_stats_file) {
+				m_stats_file = file;
+				TaggerStatistics::instance().fileOpened(file, info.orientedSize());
+			}
+			return;
+		}
+		// header is probed in background, whichever of probe and load finishes first counts the file
+		m_stats_probe_pending.insert(file);
+		m_stats_probe_pool.start(new StatsProbeTask(this, file));
+	});
+	connect(&m_file_queue.tagSuggester(), &TagSuggester::suggestionsReady, this,
+	        [this](const QString& file, const std::vector<TagSuggester::Suggestion>& suggestions)
+	{
+		if(file == currentFile())
+			m_input.setSuggestedTags(suggestions);
+	});
+	// NOTE: picture only reports its latest load, older ones are cancelled
+	connect(&m_picture, &Picture::mediaLoaded, this, [this](const QString& file)
+	{
+		// NOTE: picture is reloaded on resize and rotation, count each file once
+		m_stats_probe_pending.remove(file);
+		if(file != m_stats_file) {
+			m_stats_file = file;
+			TaggerStatistics::instance().fileOpened(file, m_picture.mediaSize());
+		}
+		emit mediaLoaded();
+	});
+	connect(&m_picture, &Picture::mediaLoadFailed, this, [this](const QString& file)
+	{
+		QMessageBox::critical(this,
+			tr("Error opening media"),
+			tr("<p>Could not open <b>%1</b></p>"
+			   "<p>File format is not supported or file corrupted.</p>")
+				.arg(QFileInfo(file).fileName()));
+		pdbg << "erasing invalid file from queue:" << file;
+		m_picture.cache.invalidate(file);
+		m_file_queue.eraseCurrent();
+		loadCurrentFile();
 	});
 	connect(&m_fetcher, &TagFetcher::ready, this, &Tagger::tagsFetched);
 	connect(&m_player, QOverload<QMediaPlayer::Error>::of(&QMediaPlayer::error), this, [this](QMediaPlayer::Error) {
@@ -89,12 +175,54 @@ Tagger::Tagger(QWidget *_parent) :
 	});
 	connect(&m_player, &QMediaPlayer::metaDataAvailableChanged, this, [this](bool){
 		emit fileOpened(currentFile());
+		MemoryGovernor::instance().usageChanged();
 	});
 
 
 	updateSettings();
 	setFocusPolicy(Qt::ClickFocus);
 	clear();
+	MemoryGovernor::instance().registerConsumer(this);
+	TaggerStatistics::instance().setImageCache(&m_picture.cache);
+	m_slideshow.setImageCache(&m_picture.cache);
+}
+
+Tagger::~Tagger()
+{
+	m_stats_probe_pool.waitForDone();
+	TaggerStatistics::instance().setImageCache(nullptr);
+	MemoryGovernor::instance().unregisterConsumer(this);
+}
+
+void Tagger::statsProbeThreadFunc(const QString& file)
+{
+	const auto info = util::probe_image_file(file);
+	{
+		QMutexLocker _{&m_stats_probe_lock};
+		m_stats_probe_results.emplace_back(file, info);
+	}
+	QMetaObject::invokeMethod(this, "applyStatsProbe", Qt::QueuedConnection);
+}
+
+void Tagger::applyStatsProbe()
+{
+	std::vector<std::pair<QString, ImageInfo>> results;
+	{
+		QMutexLocker _{&m_stats_probe_lock};
+		std::swap(results, m_stats_probe_results);
+	}
+
+	for(const auto& r : results) {
+		// NOTE: file may have been counted when it loaded meanwhile
+		if(!m_stats_probe_pending.remove(r.first) || !r.second.isValid())
+			continue;
+		if(r.first == currentFile()) {
+			if(r.first == m_stats_file)
+				continue;
+			m_stats_file = r.first;
+		}
+		TaggerStatistics::instance().fileOpened(r.first, r.second.orientedSize());
+	}
 }
 
 void Tagger::clear()
@@ -108,6 +236,8 @@ void Tagger::clear()
 	m_input.clearTagEditState();
 	m_input.setEnabled(true);
 	m_nav_direction = 0;
+	m_nav_pending = false;
+	m_nav_settle_timer.stop();
 	emit cleared();
 }
 
@@ -225,6 +355,8 @@ void Tagger::nextFile(RenameOptions options, SkipOptions skip_option)
 	} else {
 		m_file_queue.forward();
 		m_nav_direction = +1;
+		if(coalesceNavigation())
+			return;
 	}
 
 	loadCurrentFile();
@@ -249,6 +381,8 @@ void Tagger::prevFile(RenameOptions options, SkipOptions skip_option)
 	} else {
 		m_file_queue.backward();
 		m_nav_direction = -1;
+		if(coalesceNavigation())
+			return;
 	}
 
 	loadCurrentFile();
@@ -360,6 +494,22 @@ bool Tagger::openFileInQueue(size_t index)
 	return loadCurrentFile();
 }
 
+size_t Tagger::removeBrokenFiles()
+{
+	const auto current_file = currentFile();
+	if(m_file_queue.integrityScanner().isBroken(current_file) && rename() == RenameStatus::Cancelled)
+		return 0;
+
+	const auto removed = m_file_queue.eraseBroken();
+	if(m_file_queue.empty()) {
+		clear();
+	} else if(currentFile() != current_file) {
+		m_nav_direction = 0;
+		loadCurrentFile();
+	}
+	return removed;
+}
+
 void Tagger::deleteCurrentFile()
 {
 	const auto current_file = currentFile();
@@ -552,6 +702,9 @@ bool Tagger::fileModified() const
 	if(isEmpty()) // NOTE: to avoid FileQueue::current() returning invalid reference.
 		return false;
 
+	if(m_nav_pending) // NOTE: input is disabled and still holds tags of previously loaded file
+		return false;
+
 	auto current_fi = QFileInfo(m_file_queue.current());
 
 	switch (m_tag_storage) {
@@ -585,7 +738,7 @@ bool Tagger::mediaIsVideo() const
 
 bool Tagger::mediaIsAnimatedImage() const
 {
-	return m_picture.movie() != nullptr;
+	return m_picture.isAnimated();
 }
 
 bool Tagger::mediaIsPlaying() const
@@ -594,7 +747,7 @@ bool Tagger::mediaIsPlaying() const
 		return m_player.state() == QMediaPlayer::State::PlayingState;
 	}
 	if (mediaIsAnimatedImage()) {
-		return m_picture.movie()->state() == QMovie::MovieState::Running;
+		return m_picture.isPlaying();
 	}
 	return false;
 }
@@ -633,9 +786,7 @@ float Tagger::mediaFramerate() const
 	}
 
 	if (mediaIsAnimatedImage()) {
-		auto delay = m_picture.movie()->nextFrameDelay();
-		if (delay > 0.0f)
-			return 1000.0f / delay;
+		return m_picture.frameRate();
 	}
 
 	return 0.0f;
@@ -687,6 +838,48 @@ void Tagger::updateSettings()
 	if (thread_count) {
 		m_picture.cache.setMaxConcurrentTasks(thread_count);
 	}
+
+	// 0 disables coalescing of rapid navigation
+	m_nav_settle_ms = std::max(settings.value(QStringLiteral("performance/navigation_settle_ms"), 150).toInt(), 0);
+
+	m_picture.cache.setCompactEntries(settings.value(QStringLiteral("performance/compact_cache_entries"), true).toBool());
+
+	auto encoded_cache_mb = settings.value(QStringLiteral("performance/encoded_cache_size"), 256ull).toULongLong();
+	m_picture.cache.setEncodedBudget(static_cast<size_t>(encoded_cache_mb) * 1024 * 1024);
+
+	// 0 means a quarter of physical memory
+	auto budget_mb = settings.value(QStringLiteral("performance/memory_budget"), 0ull).toULongLong();
+	MemoryGovernor::instance().setBudget(budget_mb * 1024ull * 1024ull);
+
+	// 0 disables limit on bytes read per second
+	auto scan_mbps = settings.value(QStringLiteral("performance/integrity_scan_mbps"),
+	                                IntegrityScanner::default_bytes_per_second / (1024 * 1024)).toLongLong();
+	auto scan_busy = settings.value(QStringLiteral("performance/integrity_scan_busy_percent"),
+	                                IntegrityScanner::default_busy_percent).toInt();
+	m_file_queue.integrityScanner().setBudget(scan_mbps * 1024 * 1024, scan_busy);
+	m_file_queue.setIntegrityScanEnabled(settings.value(QStringLiteral("performance/integrity_scan_enabled"), true).toBool());
+}
+
+size_t Tagger::memoryUsage() const
+{
+	if (!m_video || !m_video->isVisible() || m_player.state() == QMediaPlayer::StoppedState)
+		return 0;
+
+	// decoder buffers are not accessible, estimate from frame size
+	auto resolution = m_player.metaData(QMediaMetaData::Resolution).toSize();
+	if (resolution.isEmpty())
+		resolution = m_video->size() * m_video->devicePixelRatioF();
+	return static_cast<size_t>(resolution.width()) * resolution.height() * 4 * m_video_buffered_frames;
+}
+
+MemoryConsumer::Priority Tagger::memoryPriority() const
+{
+	return Priority::Display;
+}
+
+void Tagger::setMemoryAllowance(size_t)
+{
+	// video memory is owned by media backend and can not be released
 }
 
 void Tagger::pauseMedia()
@@ -695,7 +888,7 @@ void Tagger::pauseMedia()
 		m_player.pause();
 
 	if (mediaIsAnimatedImage())
-		m_picture.movie()->setPaused(true);
+		m_picture.setPlaying(false);
 }
 
 void Tagger::setMediaPlaying(bool playing)
@@ -714,7 +907,7 @@ void Tagger::playMedia()
 	}
 
 	if (mediaIsAnimatedImage()) {
-		m_picture.movie()->setPaused(false);
+		m_picture.setPlaying(true);
 	}
 }
 
@@ -749,6 +942,34 @@ void Tagger::setUpscalingEnabled(bool enabled)
 	m_picture.setUpscalingEnabled(enabled);
 }
 
+void Tagger::setSlideShowEnabled(bool enabled, int interval_ms)
+{
+	if(!enabled) {
+		m_slideshow.stop();
+		return;
+	}
+	m_slideshow.setInterval(interval_ms);
+	m_slideshow.setViewport(m_picture.viewportSize(), m_picture.devicePixelRatioF(), m_picture.upscalingEnabled());
+	m_slideshow.start();
+	if(!isEmpty()) {
+		m_slideshow.shown(currentFile());
+		prefetchAround();
+	}
+}
+
+const SlideshowScheduler& Tagger::slideShow() const
+{
+	return m_slideshow;
+}
+
+void Tagger::setTagSuggestionsEnabled(bool enabled)
+{
+	m_file_queue.setTagSuggestionsEnabled(enabled);
+	m_input.setSuggestedTags({});
+	if(enabled && !isEmpty() && !mediaIsVideo())
+		m_file_queue.tagSuggester().requestSuggestions(currentFile());
+}
+
 void Tagger::rotateImage(bool clockwise)
 {
 	if (mediaIsVideo() || mediaIsAnimatedImage()) {
@@ -774,9 +995,14 @@ void Tagger::keyPressEvent(QKeyEvent * e)
 	QWidget::keyPressEvent(e);
 }
 
-void Tagger::timerEvent(QTimerEvent*)
+void Tagger::timerEvent(QTimerEvent* e)
 {
-	// timer is single shot
+	// timers are single shot
+	if(e->timerId() == m_nav_settle_timer.timerId()) {
+		m_nav_settle_timer.stop();
+		flushPendingNavigation();
+		return;
+	}
 	m_hide_request_timer.stop();
 }
 
@@ -1044,6 +1270,14 @@ void Tagger::updateNewTagsCounts()
 
 //------------------------------------------------------------------------------
 
+bool Tagger::isSkippedAsBroken(const QString& filename)
+{
+	// NOTE: truncated files are still opened, most of them can be shown partially
+	const auto status = m_file_queue.integrityScanner().status(filename);
+	return (status == MediaStatus::Empty || status == MediaStatus::Corrupt || status == MediaStatus::Unreadable)
+	    && m_file_queue.integrityScanner().isBroken(filename);
+}
+
 bool Tagger::loadFile(size_t index, bool silent)
 {
 	const auto filename = m_file_queue.select(index);
@@ -1075,6 +1309,12 @@ bool Tagger::loadFile(size_t index, bool silent)
 		return false;
 	}
 
+	if(isSkippedAsBroken(filename)) {
+		pdbg << "skipping" << util::media_status_name(m_file_queue.integrityScanner().status(filename))
+		     << "file" << filename;
+		return false;
+	}
+
 	if (QDir::match(util::supported_video_formats_namefilter(), f.fileName())) {
 
 		if (!loadVideo(f))
@@ -1083,6 +1323,7 @@ bool Tagger::loadFile(size_t index, bool silent)
 	} else {
 		hideVideo();
 		m_picture.setRotation(0);
+		m_stats_file.clear();
 		if(!m_picture.loadMedia(f.absoluteFilePath())) {
 			QMessageBox::critical(this,
 				tr("Error opening media"),
@@ -1146,9 +1387,11 @@ bool Tagger::loadVideo(const QFileInfo & file)
 		m_player.setVideoOutput(m_video);
 	}
 
+	m_picture.clear(); // also cancels pending image load
 	m_picture.hide();
 	m_video->show();
 	playMedia();
+	MemoryGovernor::instance().usageChanged();
 	return true;
 }
 
@@ -1157,6 +1400,7 @@ void Tagger::hideVideo()
 	if (m_video) {
 		stopVideo();
 		m_video->hide();
+		MemoryGovernor::instance().usageChanged();
 	}
 	m_picture.show();
 }
@@ -1167,15 +1411,65 @@ void Tagger::stopVideo()
 	m_playlist.clear();
 }
 
+/* Show only a preview of current file if previous navigation happened less than settle time ago.
+ * Current file is loaded fully once navigation settles. */
+bool Tagger::coalesceNavigation()
+{
+	if(m_nav_settle_ms <= 0)
+		return false;
+
+	const bool rapid = m_nav_settle_timer.isActive();
+	m_nav_settle_timer.start(m_nav_settle_ms, this);
+	if(!rapid || m_file_queue.empty())
+		return false;
+
+	m_nav_pending = true;
+	if(mediaIsVideo())
+		hideVideo();
+	m_picture.showPreview(currentFile());
+	m_input.setEnabled(false);
+
+	m_prefetch_planner.navigated(m_nav_direction);
+	prefetchAround();
+	return true;
+}
+
+/* Fully load current file if navigation was coalesced. */
+void Tagger::flushPendingNavigation()
+{
+	if(m_nav_pending)
+		loadCurrentFile();
+}
+
 /* just load picture into tagger */
 bool Tagger::loadCurrentFile()
 {
+	// steps of coalesced navigation are already known to prefetch planner
+	const bool coalesced = m_nav_pending;
+	m_nav_pending = false;
+
 	bool silent = false;
+	size_t skipped = 0;
 	while(!loadFile(m_file_queue.currentIndex(), silent) && !m_file_queue.empty()) {
+		silent = true;
+		if(isSkippedAsBroken(m_file_queue.current())) {
+			// NOTE: broken files stay in queue, so status filter can list them and menu action can remove them
+			const size_t count = m_file_queue.filteredEmpty() ? m_file_queue.size() : m_file_queue.filteredSize();
+			if(++skipped >= count) {
+				pdbg << "no file in queue can be opened";
+				hideVideo();
+				m_picture.clear();
+				return false;
+			}
+			if(m_nav_direction < 0)
+				m_file_queue.backward();
+			else
+				m_file_queue.forward();
+			continue;
+		}
 		pdbg << "erasing invalid file from queue:" << m_file_queue.current();
 		m_picture.cache.invalidate(m_file_queue.current());
 		m_file_queue.eraseCurrent();
-		silent = true;
 	}
 
 	if(m_file_queue.empty()) {
@@ -1184,38 +1478,97 @@ bool Tagger::loadCurrentFile()
 	}
 	emit fileOpened(currentFile());
 	findTagsFiles();
+	m_slideshow.shown(currentFile());
+	if(!coalesced) {
+		m_prefetch_planner.navigated(m_nav_direction);
+		prefetchAround();
+	}
+	return true;
+}
 
+void Tagger::prefetchAround()
+{
 	if(m_file_queue.size() < 2)
-		return true;
+		return;
 
 	QSettings settings;
 	if(!settings.value(QStringLiteral("performance/pixmap_precache_enabled"), true).toBool())
-		return true;
-
-	auto try_cache_file = [this](const auto& filepath) {
-		if (QDir::match(util::supported_image_formats_namefilter(),
-		                QFileInfo(filepath).fileName())) {
+		return;
 
-			m_picture.cache.addFile(filepath, m_picture.size(), m_picture.devicePixelRatioF());
+	auto is_image = [](const auto& filepath) {
+		return QDir::match(util::supported_image_formats_namefilter(),
+		                   QFileInfo(filepath).fileName());
+	};
+	QStringList prefetch;
+	auto queue_file = [&prefetch, &is_image](const auto& filepath) {
+		if (is_image(filepath)) {
+			prefetch.push_back(filepath);
 		}
 	};
 
 	int preloadcount = abs(settings.value(QStringLiteral("performance/pixmap_precache_count"), 1).toInt());
-	preloadcount = std::max(std::min(preloadcount, 16), 1);
-
-	size_t index = m_file_queue.currentIndex();
-	for (int i = 0; i < preloadcount; ++i) {
-		const auto& filepath = m_file_queue.next(index);
-		try_cache_file(filepath);
+	m_prefetch_planner.setBaseDepth(std::max(std::min(preloadcount, 16), 1));
+
+	const auto stats = m_picture.cache.statistics();
+	ImageCache::Histogram load_time{};
+	for(const auto& f : stats.formats) {
+		for(size_t i = 0; i < load_time.size(); ++i)
+			load_time[i] += f.decode_time[i] + f.scale_time[i];
+	}
+	const double load_ms = ImageCache::Statistics::percentile(load_time, 0.5);
+	m_prefetch_planner.setThroughput(load_ms > 0.0 ? stats.max_tasks * 1000.0 / load_ms : 0.0);
+
+	const double dpr = m_picture.devicePixelRatioF();
+	const size_t window_bytes = static_cast<size_t>(m_picture.width() * dpr) * static_cast<size_t>(m_picture.height() * dpr) * 4;
+	m_prefetch_planner.setMemory(stats.capacity, stats.entries > 0 ? stats.bytes / stats.entries : window_bytes);
+
+	int readahead_count = settings.value(QStringLiteral("performance/readahead_count"), 16).toInt();
+
+	// nearest files first, their reads are submitted together
+	const auto plan = m_prefetch_planner.plan();
+	size_t index_ahead = m_file_queue.currentIndex(), index_behind = index_ahead;
+
+	// cache evicts images furthest from current one, in queue order
+	const int window = std::min(ImageCache::queue_position_window, static_cast<int>(m_file_queue.size()) - 1);
+	QStringList around;
+	around.reserve(2 * window + 1);
+	for(int i = 0; i < window; ++i)
+		around.push_front(m_file_queue.prev(index_behind));
+	around.push_back(m_file_queue.current());
+	for(int i = 0; i < window; ++i)
+		around.push_back(m_file_queue.next(index_ahead));
+	m_picture.cache.setQueuePosition(around, window, plan.direction);
+	index_ahead = index_behind = m_file_queue.currentIndex();
+	if(m_slideshow.isActive()) {
+		// slides are prepared at display size by their deadlines instead
+		const int count = std::min(m_slideshow.lookahead(), static_cast<int>(m_file_queue.size()) - 1);
+		QStringList upcoming;
+		for(int i = 0; i < count; ++i)
+			upcoming.push_back(m_file_queue.next(index_ahead));
+		m_slideshow.schedule(upcoming);
+		readahead_count = std::max(readahead_count, 2 * count);
+	} else {
+		for(int i = 0; i < std::max(plan.ahead, plan.behind); ++i) {
+			if(i < plan.ahead)
+				queue_file(plan.direction > 0 ? m_file_queue.next(index_ahead) : m_file_queue.prev(index_ahead));
+			if(i < plan.behind)
+				queue_file(plan.direction > 0 ? m_file_queue.prev(index_behind) : m_file_queue.next(index_behind));
+		}
+		m_picture.cache.addFiles(prefetch, m_picture.size(), m_picture.devicePixelRatioF());
 	}
 
-	index = m_file_queue.currentIndex();
-	for(int i = 0; i < preloadcount; ++i) {
-		const auto& filepath = m_file_queue.prev(index);
-		try_cache_file(filepath);
+	// read files further ahead, so decoding them does not wait for slow storage
+	readahead_count = std::min(readahead_count, static_cast<int>(m_file_queue.size()) - 1);
+	QStringList readahead;
+	index_ahead = index_behind = m_file_queue.currentIndex();
+	for(int i = 0; i < readahead_count; ++i) {
+		const auto& filepath = plan.direction < 0 || (plan.direction == 0 && i % 2)
+		        ? m_file_queue.prev(index_behind)
+		        : m_file_queue.next(index_ahead);
+		if(is_image(filepath))
+			readahead.push_back(filepath);
 	}
-
-	return true;
+	m_picture.cache.readahead(readahead);
 }
 
 bool Tagger::isFileRenameable(const QFileInfo & fi)
@@ -20,6 +20,9 @@
 #include <QStringList>
 #include <QFileSystemWatcher>
 #include <QBasicTimer>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
 #include <memory>
 
 #include <QtMultimediaWidgets/QVideoWidget>
@@ -27,6 +30,9 @@
 #include <QtMultimedia/QMediaPlaylist>
 
 #include "util/unordered_map_qt.h"
+#include "util/memory_governor.h"
+#include "util/prefetch_planner.h"
+#include "util/slideshow_scheduler.h"
 #include "util/tag_fetcher.h"
 #include "picture.h"
 #include "input.h"
@@ -37,8 +43,10 @@
  * \brief Main widget of the application.
  *
  * Contains Picture viewer and TagInput.
+ *
+ * Reports estimated video decoding memory to \ref MemoryGovernor.
  */
-class Tagger : public QWidget
+class Tagger : public QWidget, public MemoryConsumer
 {
 	Q_OBJECT
 
@@ -46,7 +54,7 @@ public:
 
 	/// Constructs the Tagger widget.
 	explicit Tagger(QWidget *_parent = nullptr);
-	~Tagger() override = default;
+	~Tagger() override;
 
 	/// Open file, session or directory.
 	bool open(const QString& filename, bool recursive);
@@ -66,6 +74,14 @@ public:
 	/// Open file with specified index in queue.
 	bool openFileInQueue(size_t index = 0);
 
+	/*!
+	 * \brief Remove files found damaged in background from queue.
+	 * \return Number of removed files.
+	 *
+	 * Opens next file if current file was removed.
+	 */
+	size_t removeBrokenFiles();
+
 	/// Result of rename operation
 	enum class RenameStatus
 	{
@@ -271,6 +287,18 @@ public slots:
 	/// Upscale small images to fit the widget size
 	void setUpscalingEnabled(bool enabled);
 
+	/*!
+	 * \brief Prepare upcoming slides of slide show at display size, by their deadlines.
+	 * \param interval_ms Time between slides, or \c 0 if they are advanced by user.
+	 */
+	void setSlideShowEnabled(bool enabled, int interval_ms = 0);
+
+	/// Scheduler of slide show frames, see \ref setSlideShowEnabled().
+	const SlideshowScheduler& slideShow() const;
+
+	/// Suggest tags of visually similar images in tag input autocomplete.
+	void setTagSuggestionsEnabled(bool enabled);
+
 	/// Rotate image 90 degress clockwise (true) or counter-clockwise (false).
 	void rotateImage(bool clockwise);
 
@@ -281,6 +309,9 @@ signals:
 	/// Emitted when media display size has changed.
 	void mediaResized();
 
+	/// Emitted when media of current file has been loaded, possibly after \ref fileOpened().
+	void mediaLoaded();
+
 	/// Emitted when session file has been sucessfully opened.
 	void sessionOpened(const QString& sfile);
 
@@ -344,12 +375,20 @@ protected:
 	void timerEvent(QTimerEvent* e) override;
 	void focusInEvent(QFocusEvent* e) override;
 
+private slots:
+	void applyStatsProbe();
+
 private:
+	friend struct StatsProbeTask;
 	void findTagsFiles(bool force = false);
 	void reloadTagsContents();
 	bool loadCurrentFile();
+	bool coalesceNavigation();
+	void flushPendingNavigation();
+	void prefetchAround();
 	static bool isFileRenameable(const QFileInfo& fi);
 	bool selectWithFixableTags(int direction);
+	bool isSkippedAsBroken(const QString& filename);
 	bool loadFile(size_t index, bool silent = false);
 	bool loadVideo(const QFileInfo& file);
 	void hideVideo();
@@ -362,8 +401,14 @@ private:
 	RenameStatus updateCaption(RenameOptions options);
 	QString readCaptionFile(QFileInfo source_file) const;
 	bool writeCaptionFile(QFileInfo source_file, const QStringList &tags) const;
+	void statsProbeThreadFunc(const QString& file);
+
+	size_t   memoryUsage() const override;
+	Priority memoryPriority() const override;
+	void     setMemoryAllowance(size_t bytes) override;
 
 	static constexpr int m_tag_input_layout_margin = 10;
+	static constexpr int m_video_buffered_frames = 4;
 
 	QVBoxLayout     m_main_layout;
 	QVBoxLayout     m_tag_input_layout;
@@ -373,6 +418,7 @@ private:
 	TagInput        m_input;
 	TagFetcher      m_fetcher;
 	QBasicTimer     m_hide_request_timer;
+	QBasicTimer     m_nav_settle_timer;
 
 	FileQueue       m_file_queue;
 
@@ -381,6 +427,11 @@ private:
 	QMediaPlayer    m_player;
 
 	QString         m_previous_dir;
+	QString         m_stats_file;
+	QSet<QString>   m_stats_probe_pending; ///< Opened files not counted yet, header is probed in background.
+	QThreadPool     m_stats_probe_pool;
+	QMutex          m_stats_probe_lock;
+	std::vector<std::pair<QString, ImageInfo>> m_stats_probe_results; ///< Guarded by \p m_stats_probe_lock.
 	QStringList     m_current_tag_files;
 	QString         m_temp_tags;
 	QStringList     m_original_tags;
@@ -394,6 +445,10 @@ private:
 	std::unique_ptr<QFileSystemWatcher> m_fs_watcher;
 	unsigned    m_overall_new_tag_counts = 0u;
 	int         m_nav_direction = 0;
+	PrefetchPlanner m_prefetch_planner;
+	SlideshowScheduler m_slideshow;
+	int         m_nav_settle_ms = 150;
+	bool        m_nav_pending = false;
 
 	/*!
 	 * \brief Specifies where tags are stored
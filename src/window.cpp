@@ -64,6 +64,8 @@ namespace logging_category {
 #define SETT_EDIT_MODE          QStringLiteral("window/edit-mode")
 #define SETT_FIT_TO_SCREEN      QStringLiteral("window/fit-to-screen")
 #define SETT_NAVIGATE_BY_WHEEL  QStringLiteral("window/scroll-navigation")
+#define SETT_SUGGEST_TAGS       QStringLiteral("window/suggest-similar-tags")
+#define SETT_SLIDESHOW_INTERVAL QStringLiteral("window/slideshow-interval-ms")
 
 #define SETT_PLAY_MUTE          QStringLiteral("window/video_mute")
 
@@ -101,6 +103,8 @@ Window::Window(QWidget *_parent) : QMainWindow(_parent)
 	, a_next_fixable(    tr("Next fixable image"), nullptr)
 	, a_prev_fixable(    tr("Previous fixable image"), nullptr)
 	, a_go_to_number(    tr("&Go To File Number..."), nullptr)
+	, a_near_duplicates( tr("Show Near-&Duplicates..."), nullptr)
+	, a_remove_broken(   tr("Remove &Broken Files from Queue"), nullptr)
 	, a_open_session(    tr("Open Session"), nullptr)
 	, a_save_session(    tr("Save Session"), nullptr)
 	, a_fix_tags(        tr("&Apply Tag Fixes"), nullptr)
@@ -116,6 +120,7 @@ Window::Window(QWidget *_parent) : QMainWindow(_parent)
 	, a_tag_forcefirst(  tr("&Force Author Tags First"), nullptr)
 	, a_fit_to_screen(   tr("Fit to Screen"), nullptr)
 	, a_navigate_by_wheel(tr("Switch files with Mouse Wheel"))
+	, a_suggest_tags(    tr("Suggest Tags of Similar Images"))
 	, a_show_settings(   tr("P&references..."), nullptr)
 	, a_view_normal(     tr("Show &WiseTagger"), nullptr)
 	, a_view_minimal(    tr("Mi&nimal View"), nullptr)
@@ -132,6 +137,12 @@ Window::Window(QWidget *_parent) : QMainWindow(_parent)
 	, a_view_sort_size(  tr("By File &Size"), nullptr)
 	, a_view_sort_length(tr("By File Name &Length"), nullptr)
 	, a_view_sort_tagcnt(tr("By Tag &Count"), nullptr)
+	, a_view_sort_width( tr("By Image &Width"), nullptr)
+	, a_view_sort_height(tr("By Image &Height"), nullptr)
+	, a_view_sort_ratio( tr("By &Aspect Ratio"), nullptr)
+	, a_view_sort_pixels(tr("By &Pixel Count"), nullptr)
+	, a_view_sort_format(tr("By Image &Format"), nullptr)
+	, a_view_sort_dupes( tr("By Near-&Duplicates"), nullptr)
 	, a_play_pause(      tr("Play/Pause"))
 	, a_play_mute(       tr("Mute"))
 	, a_rotate_cw(       tr("Rotate Clockwise"))
@@ -350,6 +361,16 @@ void Window::updateStatusBarText()
 		                               matches ? QStringLiteral("|&nbsp;&nbsp;<span style=\"color: %3;\">%1 / %2</span>&nbsp;&nbsp;").arg(current).arg(qsize).arg(color.name()) : ""));
 	}
 
+	const auto& scanner = m_tagger.queue().integrityScanner();
+	if (scanner.isRunning() || scanner.brokenCount() > 0) {
+		QStringList integrity;
+		if (scanner.isRunning())
+			integrity.append(tr("Checking files: %1 / %2").arg(scanner.checkedCount()).arg(scanner.totalCount()));
+		if (scanner.brokenCount() > 0)
+			integrity.append(tr("%n broken file(s)", "", scanner.brokenCount()));
+		m_statusbar_label.setText(QStringLiteral("%1    %2").arg(integrity.join(QStringLiteral(", ")), m_statusbar_label.text()));
+	}
+
 	right = m_statusbar_label.text();
 
 	QSettings settings;
@@ -690,6 +711,7 @@ void Window::initSettings()
 	bool show_input  = settings.value(SETT_SHOW_INPUT,  true).toBool();
 	bool nav_wheel   = settings.value(SETT_NAVIGATE_BY_WHEEL, false).toBool();
 	bool fit_screen  = settings.value(SETT_FIT_TO_SCREEN, false).toBool();
+	bool suggest     = settings.value(SETT_SUGGEST_TAGS, false).toBool();
 
 	bool restored_geo   = restoreGeometry(settings.value(SETT_WINDOW_GEOMETRY).toByteArray());
 	bool restored_state = restoreState(settings.value(SETT_WINDOW_STATE).toByteArray());
@@ -713,6 +735,7 @@ void Window::initSettings()
 	a_view_menu.setChecked(show_menu);
 	a_view_input.setChecked(show_input);
 	a_navigate_by_wheel.setChecked(nav_wheel);
+	a_suggest_tags.setChecked(suggest);
 
 	a_play_mute.setChecked(settings.value(SETT_PLAY_MUTE, false).toBool());
 	m_tagger.setMediaMuted(a_play_mute.isChecked());
@@ -727,6 +750,7 @@ void Window::initSettings()
 	setEditMode(edit_mode);
 
 	m_tagger.setUpscalingEnabled(fit_screen);
+	m_tagger.setTagSuggestionsEnabled(suggest);
 
 	updateProxySettings();
 }
@@ -936,6 +960,18 @@ void Window::setSlideShow(bool slide_show)
 
 	QSettings settings;
 	m_tagger.setUpscalingEnabled(slide_show || settings.value(SETT_FIT_TO_SCREEN).toBool());
+
+	const bool was_running = m_tagger.slideShow().isActive();
+	m_tagger.setSlideShowEnabled(slide_show, settings.value(SETT_SLIDESHOW_INTERVAL, 0).toInt());
+	if(!slide_show && was_running) {
+		const auto stats = m_tagger.slideShow().statistics();
+		if(stats.missed > 0) {
+			addNotification(tr("Slide show"),
+			                tr("%n slide(s) were not ready in time.", "", stats.missed),
+			                tr("Slowest slide was ready %1 ms late. Slides are prepared further ahead "
+			                   "as they take longer to load.").arg(stats.max_late_ms));
+		}
+	}
 }
 
 #ifdef Q_OS_WIN
@@ -1232,6 +1268,12 @@ void Window::createActions()
 	a_view_sort_size.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_Z));
 	a_view_sort_length.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_L));
 	a_view_sort_tagcnt.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_C));
+	a_view_sort_width.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_W));
+	a_view_sort_height.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_H));
+	a_view_sort_ratio.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_A));
+	a_view_sort_pixels.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_P));
+	a_view_sort_format.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_F));
+	a_view_sort_dupes.setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_S, Qt::Key_U));
 
 	a_open_dir_recurse.setStatusTip(tr("Open all files in the folder and all subfolders."));
 	a_open_post.setStatusTip(     tr("Open imageboard post of this image."));
@@ -1249,6 +1291,7 @@ void Window::createActions()
 	a_tag_forcefirst.setCheckable(true);
 	a_fit_to_screen.setCheckable(true);
 	a_navigate_by_wheel.setCheckable(true);
+	a_suggest_tags.setCheckable(true);
 	a_view_statusbar.setCheckable(true);
 	a_view_fullscreen.setCheckable(true);
 	a_view_slideshow.setCheckable(true);
@@ -1323,6 +1366,7 @@ void Window::createActions()
 	connect(&a_stats,       &QAction::triggered,   &TaggerStatistics::instance(), &TaggerStatistics::showStatsDialog);
 	connect(&m_tagger,      &Tagger::tagsEdited,   this, &Window::updateWindowTitle);
 	connect(&m_tagger,      &Tagger::fileOpened,   this, &Window::updateMenus);
+	connect(&m_tagger,      &Tagger::mediaLoaded,  this, &Window::updateMenus);
 	connect(&m_tagger,      &Tagger::cleared,      this, &Window::updateMenus);
 	connect(&m_tagger,      &Tagger::fileOpened,   this, &Window::updateWindowTitle);
 	connect(&m_tagger,      &Tagger::cleared,      this, &Window::updateWindowTitle);
@@ -1330,6 +1374,9 @@ void Window::createActions()
 	connect(&m_tagger,      &Tagger::cleared,      this, &Window::updateStatusBarText);
 	connect(&m_tagger,      &Tagger::mediaResized, this, &Window::updateStatusBarText);
 	connect(&m_tagger.queue(), &FileQueue::newFilesAdded, this, &Window::updateStatusBarText);
+	connect(&m_tagger.queue(), &FileQueue::imageInfoUpdated, this, &Window::updateStatusBarText);
+	connect(&m_tagger.queue().integrityScanner(), &IntegrityScanner::progress, this, &Window::updateStatusBarText);
+	connect(&m_tagger.queue().integrityScanner(), &IntegrityScanner::finished, this, &Window::updateStatusBarText);
 	connect(&m_tagger.tag_fetcher(), &TagFetcher::hashing_progress, this, &Window::showFileHashingProgress);
 	connect(&m_tagger.tag_fetcher(), &TagFetcher::started, this, &Window::showTagFetchProgress);
 	connect(&m_tagger.tag_fetcher(), &TagFetcher::aborted, this, &Window::hideUploadProgress);
@@ -1440,6 +1487,11 @@ void Window::createActions()
 	connect(&a_navigate_by_wheel,  &QAction::triggered, [](bool checked)
 	{
 		QSettings settings; settings.setValue(SETT_NAVIGATE_BY_WHEEL, checked);
+	});
+	connect(&a_suggest_tags, &QAction::triggered, [this](bool checked)
+	{
+		QSettings settings; settings.setValue(SETT_SUGGEST_TAGS, checked);
+		m_tagger.setTagSuggestionsEnabled(checked);
 	});	
 	connect(&a_fit_to_screen,  &QAction::triggered, [this](bool checked)
 	{
@@ -1543,6 +1595,55 @@ void Window::createActions()
 			static_cast<int>(m_tagger.queue().size()));          // max
 		m_tagger.openFileInQueue(number-1);
 	});
+	connect(&a_near_duplicates, &QAction::triggered, this, [this]()
+	{
+		auto& queue = m_tagger.queue();
+		auto& duplicates = queue.duplicates();
+
+		// NOTE: results are partial until whole queue is hashed, hashing continues in background
+		std::vector<QString> files;
+		for(size_t i = 0; i < queue.size(); ++i) {
+			const auto& file = queue.nth(static_cast<ptrdiff_t>(i));
+			if(!duplicates.contains(file))
+				files.push_back(file);
+		}
+		if(!files.empty() && !duplicates.isRunning())
+			duplicates.hashFiles(files);
+
+		const auto matches = duplicates.nearDuplicates(m_tagger.currentFile());
+		if(matches.empty()) {
+			addNotification(files.empty() ? tr("No near-duplicates found")
+			                              : tr("No near-duplicates found yet, hashing images in background"));
+			return;
+		}
+
+		QStringList items;
+		for(const auto& m : matches) {
+			items.append(QStringLiteral("%1\t%2").arg(m.distance).arg(QDir::toNativeSeparators(m.file)));
+		}
+		bool ok = false;
+		const auto label = files.empty() ? tr("Near-duplicates of current image, by number of differing bits:")
+		                                 : tr("Near-duplicates found so far, hashing images in background:");
+		const auto item = QInputDialog::getItem(this, tr("Near-Duplicates"), label, items, 0, false, &ok);
+		if(!ok)
+			return;
+
+		const auto index = queue.find(matches[static_cast<size_t>(items.indexOf(item))].file);
+		if(index != FileQueue::npos)
+			m_tagger.openFileInQueue(index);
+	});
+	connect(&a_remove_broken, &QAction::triggered, this, [this]()
+	{
+		const bool running = m_tagger.queue().integrityScanner().isRunning();
+		const auto removed = m_tagger.removeBrokenFiles();
+		if (removed == 0) {
+			addNotification(running ? tr("No broken files found yet, checking files in background")
+			                        : tr("No broken files found"));
+			return;
+		}
+		addNotification(tr("Broken files removed"), tr("%n file(s) removed from queue.", "", static_cast<int>(removed)));
+		updateStatusBarText();
+	});
 	connect(&m_notification_display_timer, &QTimer::timeout, this, [this]()
 	{
 		static bool which = false;
@@ -1686,6 +1787,26 @@ void Window::createActions()
 			break;
 		case SortQueueBy::TagCount:
 			criteria_str = tr("Tag Count");
+			break;
+		case SortQueueBy::ImageWidth:
+			criteria_str = tr("Image Width");
+			break;
+		case SortQueueBy::ImageHeight:
+			criteria_str = tr("Image Height");
+			break;
+		case SortQueueBy::AspectRatio:
+			criteria_str = tr("Aspect Ratio");
+			break;
+		case SortQueueBy::PixelCount:
+			criteria_str = tr("Pixel Count");
+			break;
+		case SortQueueBy::ImageFormat:
+			criteria_str = tr("Image Format");
+			break;
+		case SortQueueBy::Duplicates:
+			criteria_str = tr("Near-Duplicates");
+			if(m_tagger.queue().duplicates().isRunning())
+				criteria_str += tr(", hashing images in background");
 		}
 
 		addNotification(tr("Queue Sorted by %1").arg(criteria_str));
@@ -1753,6 +1874,8 @@ void Window::createMenus()
 	add_action(menu_navigation, a_next_file);
 	add_action(menu_navigation, a_prev_file);
 	add_action(menu_navigation, a_go_to_number);
+	add_action(menu_navigation, a_near_duplicates);
+	add_action(menu_navigation, a_remove_broken);
 	add_separator(menu_navigation);
 	add_action(menu_navigation, a_save_next);
 	add_action(menu_navigation, a_save_prev);
@@ -1791,6 +1914,13 @@ void Window::createMenus()
 	add_action(menu_sort, a_view_sort_date);
 	add_action(menu_sort, a_view_sort_length);
 	add_action(menu_sort, a_view_sort_tagcnt);
+	add_separator(menu_sort);
+	add_action(menu_sort, a_view_sort_width);
+	add_action(menu_sort, a_view_sort_height);
+	add_action(menu_sort, a_view_sort_ratio);
+	add_action(menu_sort, a_view_sort_pixels);
+	add_action(menu_sort, a_view_sort_format);
+	add_action(menu_sort, a_view_sort_dupes);
 	a_view_sort_name.setCheckable(true);
 	a_view_sort_name.setChecked(true);
 	a_view_sort_type.setCheckable(true);
@@ -1798,18 +1928,36 @@ void Window::createMenus()
 	a_view_sort_date.setCheckable(true);
 	a_view_sort_length.setCheckable(true);
 	a_view_sort_tagcnt.setCheckable(true);
+	a_view_sort_width.setCheckable(true);
+	a_view_sort_height.setCheckable(true);
+	a_view_sort_ratio.setCheckable(true);
+	a_view_sort_pixels.setCheckable(true);
+	a_view_sort_format.setCheckable(true);
+	a_view_sort_dupes.setCheckable(true);
 	a_view_sort_name.setActionGroup(&ag_sort_criteria);
 	a_view_sort_type.setActionGroup(&ag_sort_criteria);
 	a_view_sort_size.setActionGroup(&ag_sort_criteria);
 	a_view_sort_date.setActionGroup(&ag_sort_criteria);
 	a_view_sort_length.setActionGroup(&ag_sort_criteria);
 	a_view_sort_tagcnt.setActionGroup(&ag_sort_criteria);
+	a_view_sort_width.setActionGroup(&ag_sort_criteria);
+	a_view_sort_height.setActionGroup(&ag_sort_criteria);
+	a_view_sort_ratio.setActionGroup(&ag_sort_criteria);
+	a_view_sort_pixels.setActionGroup(&ag_sort_criteria);
+	a_view_sort_format.setActionGroup(&ag_sort_criteria);
+	a_view_sort_dupes.setActionGroup(&ag_sort_criteria);
 	a_view_sort_name.setData(QVariant::fromValue(SortQueueBy::FileName));
 	a_view_sort_type.setData(QVariant::fromValue(SortQueueBy::FileType));
 	a_view_sort_size.setData(QVariant::fromValue(SortQueueBy::FileSize));
 	a_view_sort_date.setData(QVariant::fromValue(SortQueueBy::ModificationDate));
 	a_view_sort_length.setData(QVariant::fromValue(SortQueueBy::FileNameLength));
 	a_view_sort_tagcnt.setData(QVariant::fromValue(SortQueueBy::TagCount));
+	a_view_sort_width.setData(QVariant::fromValue(SortQueueBy::ImageWidth));
+	a_view_sort_height.setData(QVariant::fromValue(SortQueueBy::ImageHeight));
+	a_view_sort_ratio.setData(QVariant::fromValue(SortQueueBy::AspectRatio));
+	a_view_sort_pixels.setData(QVariant::fromValue(SortQueueBy::PixelCount));
+	a_view_sort_format.setData(QVariant::fromValue(SortQueueBy::ImageFormat));
+	a_view_sort_dupes.setData(QVariant::fromValue(SortQueueBy::Duplicates));
 
 	// Options menu actions
 	add_action(menu_options, a_edit_mode);
@@ -1819,6 +1967,7 @@ void Window::createMenus()
 	add_action(menu_options, a_fit_to_screen);
 	add_separator(menu_options);
 	add_action(menu_options, a_navigate_by_wheel);
+	add_action(menu_options, a_suggest_tags);
 	add_separator(menu_options);
 	add_action(menu_options, a_ib_replace);
 	add_action(menu_options, a_ib_restore);
@@ -1905,6 +2054,8 @@ void Window::updateMenus()
 	a_open_loc.setDisabled(val);
 	a_save_session.setDisabled(val);
 	a_go_to_number.setDisabled(val);
+	a_near_duplicates.setDisabled(val);
+	a_remove_broken.setDisabled(val);
 	a_edit_temp_tags.setDisabled(val);
 	menu_commands.setDisabled(val);
 	menu_context_commands.setDisabled(val);
@@ -155,6 +155,8 @@ private:
 	QAction a_next_fixable;
 	QAction a_prev_fixable;
 	QAction a_go_to_number;
+	QAction a_near_duplicates;
+	QAction a_remove_broken;
 	QAction a_open_session;
 	QAction a_save_session;
 	QAction a_fix_tags;
@@ -170,6 +172,7 @@ private:
 	QAction a_tag_forcefirst;
 	QAction a_fit_to_screen;
 	QAction a_navigate_by_wheel;
+	QAction a_suggest_tags;
 	QAction a_show_settings;
 	QAction a_view_normal;
 	QAction a_view_minimal;
@@ -186,6 +189,12 @@ private:
 	QAction a_view_sort_size;
 	QAction a_view_sort_length;
 	QAction a_view_sort_tagcnt;
+	QAction a_view_sort_width;
+	QAction a_view_sort_height;
+	QAction a_view_sort_ratio;
+	QAction a_view_sort_pixels;
+	QAction a_view_sort_format;
+	QAction a_view_sort_dupes;
 	QAction a_play_pause;
 	QAction a_play_mute;
 	QAction a_rotate_cw;
@@ -0,0 +1,301 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "batch_file_reader.h"
+#include <QFile>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QWaitCondition>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(WISETAGGER_HAVE_IO_URING) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define WISETAGGER_IO_URING 1
+#include <liburing.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace logging_category {Q_LOGGING_CATEGORY(batchreader, "BatchFileReader")}
+#define pdbg qCDebug(logging_category::batchreader)
+#define pwarn qCWarning(logging_category::batchreader)
+
+/// Largest file that fits into QByteArray.
+static qint64 clamp_file_size(qint64 max_file_size)
+{
+	return std::min<qint64>(max_file_size, std::numeric_limits<int>::max() - 1);
+}
+
+//------------------------------------------------------------------------------
+
+/// Files read by thread pool, waiting to be passed to the caller.
+struct BatchFileReader::Completions
+{
+	QMutex         lock;
+	QWaitCondition ready;
+	std::deque<std::pair<int, QByteArray>> files;
+};
+
+/// Task for reading a single file in a thread pool.
+struct ReadFileTask : public QRunnable
+{
+	ReadFileTask(BatchFileReader::Completions* c, int i, const QString& f, qint64 max) :
+	        completions(c), index(i), filename(f), max_file_size(max)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		QByteArray data;
+		QFile file(filename);
+		if(file.open(QIODevice::ReadOnly)) {
+			const qint64 size = file.size();
+			if(size > 0 && size <= max_file_size) {
+				data = file.readAll();
+				if(data.size() != size) // NOTE: file was modified while reading
+					data.clear();
+			}
+		}
+
+		QMutexLocker _{&completions->lock};
+		completions->files.emplace_back(index, std::move(data));
+		completions->ready.wakeOne();
+	}
+
+	BatchFileReader::Completions* completions;
+	int     index;
+	QString filename;
+	qint64  max_file_size;
+};
+
+void BatchFileReader::readWithThreads(const QStringList& files, qint64 max_file_size, const Callback& done,
+                                      const std::function<bool()>& cancelled)
+{
+	Completions completions;
+	int next = 0, in_flight = 0;
+	while(true) {
+		while(next < files.size() && in_flight < m_queue_depth && !(cancelled && cancelled())) {
+			m_thread_pool.start(new ReadFileTask(&completions, next, files[next], max_file_size));
+			++next;
+			++in_flight;
+		}
+		if(in_flight == 0)
+			break;
+
+		std::pair<int, QByteArray> file;
+		{
+			QMutexLocker _{&completions.lock};
+			while(completions.files.empty())
+				completions.ready.wait(&completions.lock);
+			file = std::move(completions.files.front());
+			completions.files.pop_front();
+		}
+		--in_flight;
+		done(file.first, std::move(file.second));
+	}
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef WISETAGGER_IO_URING
+
+struct BatchFileReader::Ring
+{
+	io_uring ring;
+};
+
+/// Read of a single file submitted to the ring.
+struct RingRequest
+{
+	int        index  = 0;
+	int        fd     = -1;
+	qint64     offset = 0;
+	QByteArray data;
+};
+
+/// Queue read of remaining part of \p r, returns false if the submission queue is full.
+static bool queue_read(io_uring* ring, RingRequest& r)
+{
+	io_uring_sqe* sqe = io_uring_get_sqe(ring);
+	if(!sqe)
+		return false;
+	io_uring_prep_read(sqe, r.fd, r.data.data() + r.offset,
+	                   static_cast<unsigned>(r.data.size() - r.offset), static_cast<__u64>(r.offset));
+	io_uring_sqe_set_data(sqe, &r);
+	return true;
+}
+
+void BatchFileReader::readWithRing(const QStringList& files, qint64 max_file_size, const Callback& done,
+                                   const std::function<bool()>& cancelled)
+{
+	io_uring* ring = &m_ring->ring;
+	// NOTE: buffers must stay in place while the kernel may write to them
+	auto requests = std::make_unique<std::vector<RingRequest>>(static_cast<size_t>(files.size()));
+
+	auto finish = [&done](RingRequest& r, bool ok) {
+		::close(r.fd);
+		r.fd = -1;
+		QByteArray data;
+		if(ok)
+			std::swap(data, r.data);
+		r.data = QByteArray();
+		done(r.index, std::move(data));
+	};
+
+	int next = 0, in_flight = 0;
+	while(true) {
+		int queued = 0;
+		while(next < files.size() && in_flight < m_queue_depth && !(cancelled && cancelled())) {
+			auto& r = (*requests)[static_cast<size_t>(next)];
+			r.index = next++;
+
+			const QByteArray path = QFile::encodeName(files[r.index]);
+			r.fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+			struct stat st;
+			if(r.fd < 0 || ::fstat(r.fd, &st) != 0 || !S_ISREG(st.st_mode)
+			   || st.st_size <= 0 || st.st_size > max_file_size)
+			{
+				if(r.fd >= 0)
+					::close(r.fd);
+				r.fd = -1;
+				done(r.index, QByteArray());
+				continue;
+			}
+
+			r.data = QByteArray(static_cast<int>(st.st_size), Qt::Uninitialized);
+			if(!queue_read(ring, r)) {
+				finish(r, false);
+				continue;
+			}
+			++in_flight;
+			++queued;
+		}
+		if(queued > 0)
+			io_uring_submit(ring);
+		if(in_flight == 0)
+			break;
+
+		io_uring_cqe* cqe = nullptr;
+		const int ret = io_uring_wait_cqe(ring, &cqe);
+		if(ret == -EINTR || ret == -EAGAIN)
+			continue;
+		if(ret < 0) {
+			pwarn << "waiting for completion failed:" << strerror(-ret) << ", falling back to threads";
+			// NOTE: reads may still complete into the buffers, leak them rather than free
+			auto leaked = requests.release();
+			for(auto& r : *leaked) {
+				if(r.fd >= 0) {
+					::close(r.fd);
+					done(r.index, QByteArray());
+				}
+			}
+			io_uring_queue_exit(ring);
+			m_ring.reset();
+
+			const int first = next;
+			readWithThreads(files.mid(first), max_file_size, [&done, first](int index, QByteArray&& data) {
+				done(first + index, std::move(data));
+			}, cancelled);
+			return;
+		}
+
+		auto& r = *static_cast<RingRequest*>(io_uring_cqe_get_data(cqe));
+		const int res = cqe->res;
+		io_uring_cqe_seen(ring, cqe);
+		--in_flight;
+
+		if(res > 0)
+			r.offset += res;
+
+		bool resubmit = false;
+		if(res == -EINTR || res == -EAGAIN) {
+			resubmit = true;
+		} else if(res <= 0) {
+			// read error, or file got shorter since fstat()
+			finish(r, false);
+		} else if(r.offset < r.data.size()) {
+			resubmit = true; // short read
+		} else {
+			finish(r, true);
+		}
+
+		if(resubmit) {
+			if(queue_read(ring, r)) {
+				++in_flight;
+				io_uring_submit(ring);
+			} else {
+				finish(r, false);
+			}
+		}
+	}
+}
+
+#else
+
+struct BatchFileReader::Ring {};
+
+void BatchFileReader::readWithRing(const QStringList& files, qint64 max_file_size, const Callback& done,
+                                   const std::function<bool()>& cancelled)
+{
+	readWithThreads(files, max_file_size, done, cancelled);
+}
+
+#endif // WISETAGGER_IO_URING
+
+//------------------------------------------------------------------------------
+
+BatchFileReader::BatchFileReader(int queue_depth) : m_queue_depth(std::max(queue_depth, 1))
+{
+	m_thread_pool.setMaxThreadCount(m_queue_depth);
+#ifdef WISETAGGER_IO_URING
+	auto ring = std::make_unique<Ring>();
+	const int ret = io_uring_queue_init(static_cast<unsigned>(m_queue_depth), &ring->ring, 0);
+	if(ret == 0) {
+		m_ring = std::move(ring);
+		pdbg << "using io_uring with queue depth" << m_queue_depth;
+	} else {
+		pwarn << "io_uring is not available:" << strerror(-ret) << ", falling back to threads";
+	}
+#endif
+}
+
+BatchFileReader::~BatchFileReader()
+{
+	m_thread_pool.waitForDone();
+#ifdef WISETAGGER_IO_URING
+	if(m_ring)
+		io_uring_queue_exit(&m_ring->ring);
+#endif
+}
+
+BatchFileReader::Backend BatchFileReader::backend() const
+{
+	return m_ring ? Backend::IoUring : Backend::Threads;
+}
+
+void BatchFileReader::read(const QStringList& files, qint64 max_file_size, const Callback& done,
+                           const std::function<bool()>& cancelled)
+{
+	if(files.isEmpty())
+		return;
+
+	max_file_size = clamp_file_size(max_file_size);
+	if(m_ring) {
+		readWithRing(files, max_file_size, done, cancelled);
+	} else {
+		readWithThreads(files, max_file_size, done, cancelled);
+	}
+}
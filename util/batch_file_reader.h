@@ -0,0 +1,86 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef BATCH_FILE_READER_H
+#define BATCH_FILE_READER_H
+
+/**
+ * \file batch_file_reader.h
+ * \brief Class \ref BatchFileReader
+ */
+
+#include <QByteArray>
+#include <QStringList>
+#include <QThreadPool>
+#include <functional>
+#include <memory>
+
+/*!
+ * \brief Reads whole files with many requests in flight.
+ *
+ * On Linux builds with \c liburing (\c WISETAGGER_HAVE_IO_URING), reads of
+ * a batch are submitted to a single \c io_uring, so a single thread keeps
+ * up to \p queue_depth reads in flight. Otherwise, or if the kernel refuses
+ * to set up the ring, files are read by a pool of \p queue_depth threads.
+ *
+ * In both cases completed files are handed to the caller in the thread that
+ * called \ref read(), in completion order.
+ *
+ * \note Not thread-safe, \ref read() must not be called concurrently.
+ */
+class BatchFileReader
+{
+public:
+	/// I/O backend in use.
+	enum class Backend
+	{
+		Threads, ///< Blocking reads in a thread pool.
+		IoUring, ///< Asynchronous reads submitted to io_uring.
+	};
+
+	/*!
+	 * \brief Called with index of file in batch and its contents.
+	 *
+	 * Contents are empty if the file could not be read or is too large.
+	 */
+	using Callback = std::function<void(int index, QByteArray&& data)>;
+
+	/// Construct reader keeping up to \p queue_depth reads in flight.
+	explicit BatchFileReader(int queue_depth = 16);
+	~BatchFileReader();
+
+	/// Backend used for reading.
+	Backend backend() const;
+
+	/*!
+	 * \brief Read \p files and pass their contents to \p done.
+	 * \param files Files to read, reads are started in this order.
+	 * \param max_file_size Larger files are not read, \p done gets empty contents for them.
+	 * \param done Called for each file once it is read.
+	 * \param cancelled Checked before starting each read, reads that did not start are skipped then.
+	 *
+	 * Blocks until all started reads are completed.
+	 */
+	void read(const QStringList& files, qint64 max_file_size, const Callback& done,
+	          const std::function<bool()>& cancelled = {});
+
+private:
+	struct Ring;
+	struct Completions;
+	friend struct ReadFileTask;
+
+	void readWithThreads(const QStringList& files, qint64 max_file_size, const Callback& done,
+	                     const std::function<bool()>& cancelled);
+	void readWithRing(const QStringList& files, qint64 max_file_size, const Callback& done,
+	                  const std::function<bool()>& cancelled);
+
+	int                   m_queue_depth;
+	QThreadPool           m_thread_pool;
+	std::unique_ptr<Ring> m_ring;
+};
+
+#endif // BATCH_FILE_READER_H
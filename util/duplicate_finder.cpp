@@ -0,0 +1,259 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "duplicate_finder.h"
+#include "util/imagecache.h"
+#include <QLoggingCategory>
+#include <QThread>
+#include <algorithm>
+#include <iterator>
+
+namespace logging_category {
+	Q_LOGGING_CATEGORY(duplicates, "DuplicateFinder")
+}
+#define pdbg qCDebug(logging_category::duplicates)
+#define pwarn qCWarning(logging_category::duplicates)
+
+constexpr int      DuplicateFinder::default_radius;
+constexpr uint32_t DuplicateFinder::not_an_image;
+
+/// Number of files hashed by single task.
+static constexpr size_t task_size = 64;
+
+/// Files are decoded at this size for hashing, decoders skip most of the work at reduced sizes.
+static constexpr int decode_size = 4 * util::phash_source_size;
+
+/// Task for hashing part of files in background.
+struct HashFilesTask : public QRunnable
+{
+	HashFilesTask(DuplicateFinder* f, uint64_t g, std::vector<QString>&& fl) :
+	        finder(f), generation(g), files(std::move(fl))
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		finder->hashThreadFunc(generation, files);
+	}
+
+	DuplicateFinder* finder;
+	uint64_t         generation;
+	std::vector<QString> files;
+};
+
+DuplicateFinder::DuplicateFinder()
+{
+	m_thread_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+DuplicateFinder::~DuplicateFinder()
+{
+	cancel();
+	m_thread_pool.waitForDone();
+}
+
+void DuplicateFinder::setImageCache(const ImageCache* cache)
+{
+	m_cache = cache;
+}
+
+void DuplicateFinder::hashFiles(const std::vector<QString>& files)
+{
+	cancel();
+
+	std::vector<QString> remaining;
+	for(const auto& f : files) {
+		if(!m_items.contains(f))
+			remaining.push_back(f);
+	}
+	if(remaining.empty())
+		return;
+
+	const auto generation = m_generation.load();
+	m_total = static_cast<int>(remaining.size());
+	m_hashed = 0;
+	m_running_tasks = 0;
+	for(size_t begin = 0; begin < remaining.size(); begin += task_size) {
+		const auto first = std::next(remaining.begin(), static_cast<ptrdiff_t>(begin));
+		const auto last = std::next(remaining.begin(), static_cast<ptrdiff_t>(std::min(begin + task_size, remaining.size())));
+		m_thread_pool.start(new HashFilesTask(this, generation, std::vector<QString>(first, last)));
+		++m_running_tasks;
+	}
+	pdbg << "hashing" << m_total << "files in" << m_running_tasks << "tasks";
+}
+
+void DuplicateFinder::cancel()
+{
+	++m_generation;
+	m_thread_pool.clear();
+	m_running_tasks = 0;
+
+	QMutexLocker _{&m_results_lock};
+	m_results.clear();
+	m_finished_tasks = 0;
+}
+
+void DuplicateFinder::clear()
+{
+	cancel();
+	m_items.clear();
+	m_files.clear();
+	m_hashes.clear();
+	m_parents.clear();
+	m_index.clear();
+}
+
+bool DuplicateFinder::isRunning() const
+{
+	return m_running_tasks != 0;
+}
+
+bool DuplicateFinder::contains(const QString& file) const
+{
+	return m_items.contains(file);
+}
+
+std::vector<DuplicateFinder::Match> DuplicateFinder::nearDuplicates(const QString& file, int radius)
+{
+	auto it = m_items.find(file);
+	if(it == m_items.end()) {
+		uint64_t hash = 0;
+		const bool valid = hashFile(file, &hash);
+		addHash(file, hash, valid);
+		it = m_items.find(file);
+	}
+	const auto item = it.value();
+	if(item == not_an_image)
+		return {};
+
+	std::vector<Match> res;
+	for(const auto& m : m_index.find(m_hashes[item], radius)) {
+		if(m.first != item)
+			res.push_back(Match{m_files[m.first], m.second});
+	}
+	std::sort(res.begin(), res.end(), [](const Match& a, const Match& b)
+	{
+		return a.distance < b.distance || (a.distance == b.distance && a.file < b.file);
+	});
+	return res;
+}
+
+std::vector<size_t> DuplicateFinder::groups(const std::vector<QString>& files) const
+{
+	// first file in files of each group root
+	QHash<uint32_t, size_t> first_of_group;
+	first_of_group.reserve(static_cast<int>(files.size()));
+
+	std::vector<size_t> res(files.size());
+	for(size_t i = 0; i < files.size(); ++i) {
+		res[i] = i;
+		const auto item = m_items.value(files[i], not_an_image);
+		if(item == not_an_image)
+			continue;
+
+		const auto found = first_of_group.find(group_of(item));
+		if(found == first_of_group.end())
+			first_of_group.insert(group_of(item), i);
+		else
+			res[i] = found.value();
+	}
+	return res;
+}
+
+void DuplicateFinder::hashThreadFunc(uint64_t generation, const std::vector<QString>& files)
+{
+	std::vector<HashResult> results;
+	results.reserve(files.size());
+	for(const auto& f : files) {
+		if(m_generation != generation)
+			return;
+		HashResult r{f, 0, false};
+		r.valid = hashFile(f, &r.hash);
+		results.push_back(std::move(r));
+	}
+
+	{
+		QMutexLocker _{&m_results_lock};
+		if(m_generation != generation)
+			return;
+		std::move(results.begin(), results.end(), std::back_inserter(m_results));
+		++m_finished_tasks;
+	}
+	QMetaObject::invokeMethod(this, "applyHashResults", Qt::QueuedConnection);
+}
+
+bool DuplicateFinder::hashFile(const QString& file, uint64_t* hash) const
+{
+	const QImage image = ImageCache::reducedImage(m_cache, file, QSize(util::phash_source_size, util::phash_source_size),
+	                                              QSize(decode_size, decode_size));
+	if(image.isNull())
+		return false;
+
+	*hash = util::phash(image);
+	return true;
+}
+
+void DuplicateFinder::addHash(const QString& file, uint64_t hash, bool valid)
+{
+	if(!valid) {
+		m_items.insert(file, not_an_image);
+		return;
+	}
+
+	const auto item = static_cast<uint32_t>(m_files.size());
+	m_items.insert(file, item);
+	m_files.push_back(file);
+	m_hashes.push_back(hash);
+	m_parents.push_back(item);
+
+	// NOTE: joining roots to the smaller one keeps first hashed file as root of each group
+	for(const auto& m : m_index.find(hash, default_radius)) {
+		auto a = group_of(item);
+		auto b = group_of(m.first);
+		if(a != b)
+			m_parents[std::max(a, b)] = std::min(a, b);
+	}
+	m_index.insert(hash, item);
+}
+
+uint32_t DuplicateFinder::group_of(uint32_t item) const
+{
+	// NOTE: path halving, keeps trees flat as groups are joined
+	while(m_parents[item] != item) {
+		m_parents[item] = m_parents[m_parents[item]];
+		item = m_parents[item];
+	}
+	return item;
+}
+
+void DuplicateFinder::applyHashResults()
+{
+	std::vector<HashResult> results;
+	int finished_tasks;
+	{
+		QMutexLocker _{&m_results_lock};
+		std::swap(results, m_results);
+		finished_tasks = m_finished_tasks;
+	}
+	if(m_running_tasks == 0)
+		return; // cancelled meanwhile
+
+	for(const auto& r : results) {
+		if(!m_items.contains(r.file))
+			addHash(r.file, r.hash, r.valid);
+	}
+	m_hashed += static_cast<int>(results.size());
+	if(!results.empty())
+		emit progress(m_hashed, m_total);
+
+	if(finished_tasks == m_running_tasks) {
+		pdbg << "hashed" << m_hashed << "files," << m_index.size() << "images";
+		m_running_tasks = 0;
+		emit finished();
+	}
+}
@@ -0,0 +1,144 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_DUPLICATE_FINDER_H
+#define UTIL_DUPLICATE_FINDER_H
+
+/**
+ * \file duplicate_finder.h
+ * \brief Class \ref DuplicateFinder
+ */
+
+#include "util/perceptual_hash.h"
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+
+class ImageCache;
+
+/*!
+ * \brief Finds near-duplicate images by their perceptual hash.
+ *
+ * Files are hashed in background by a thread pool, see \ref util::phash().
+ * Downscaled images already in \ref ImageCache are hashed instead of
+ * decoding the file again, other files are decoded at reduced size.
+ *
+ * Hashes are kept in a \ref HammingIndex, so queries for near-duplicates
+ * take about a millisecond even with a million files hashed.
+ *
+ * \note Member functions must be called from the thread the object lives in.
+ */
+class DuplicateFinder : public QObject
+{
+	Q_OBJECT
+public:
+	/// Default maximum number of differing hash bits of near-duplicates.
+	static constexpr int default_radius = 8;
+
+	/// Near-duplicate found by \ref nearDuplicates().
+	struct Match
+	{
+		QString file;
+		int     distance; ///< Number of differing hash bits.
+	};
+
+	DuplicateFinder();
+	~DuplicateFinder() override;
+
+	/// Use images cached in \p cache when available, may be null.
+	void setImageCache(const ImageCache* cache);
+
+	/*!
+	 * \brief Hash \p files in background.
+	 *
+	 * Files hashed before are skipped. Replaces files of previous call that
+	 * were not hashed yet.
+	 */
+	void hashFiles(const std::vector<QString>& files);
+
+	/// Stop hashing files, files hashed so far are kept.
+	void cancel();
+
+	/// Forget all hashes.
+	void clear();
+
+	/// Are files being hashed.
+	bool isRunning() const;
+
+	/// Was \p file hashed, including files that could not be decoded.
+	bool contains(const QString& file) const;
+
+	/*!
+	 * \brief Hashed files at most \p radius hash bits away from \p file.
+	 *
+	 * \p file is hashed right away if it was not hashed yet. Does not include
+	 * \p file itself. Sorted by distance, closest first.
+	 */
+	std::vector<Match> nearDuplicates(const QString& file, int radius = default_radius);
+
+	/*!
+	 * \brief Group \p files into near-duplicates.
+	 * \return Group of each file, as index of the first file in \p files that belongs to the same group.
+	 *
+	 * Files at most \ref default_radius bits apart are in the same group, transitively:
+	 * if A is near B and B is near C, all three are in the same group. Files that were
+	 * not hashed form their own group.
+	 *
+	 * Groups are maintained as files are hashed, so this takes linear time.
+	 */
+	std::vector<size_t> groups(const std::vector<QString>& files) const;
+
+signals:
+	/// Emitted as files are hashed.
+	void progress(int hashed, int total);
+
+	/// Emitted when all files passed to \ref hashFiles() are hashed.
+	void finished();
+
+private slots:
+	void applyHashResults();
+
+private:
+	friend struct HashFilesTask;
+
+	/// Hash of file computed by worker thread.
+	struct HashResult
+	{
+		QString  file;
+		uint64_t hash;
+		bool     valid; ///< Could the file be decoded.
+	};
+
+	void hashThreadFunc(uint64_t generation, const std::vector<QString>& files);
+	bool hashFile(const QString& file, uint64_t* hash) const;
+	void addHash(const QString& file, uint64_t hash, bool valid);
+	uint32_t group_of(uint32_t item) const;
+
+	static constexpr uint32_t not_an_image = UINT32_MAX;
+
+	QHash<QString, uint32_t> m_items;  ///< Index into \p m_files, or \p not_an_image.
+	std::vector<QString>     m_files;
+	std::vector<uint64_t>    m_hashes;
+	mutable std::vector<uint32_t> m_parents; ///< Union-find forest of groups, roots are the first item of each group.
+	HammingIndex             m_index;
+
+	const ImageCache*     m_cache = nullptr;
+	std::atomic<uint64_t> m_generation{0};
+	int                   m_total = 0;
+	int                   m_hashed = 0;
+	int                   m_running_tasks = 0;
+
+	QMutex      m_results_lock;
+	std::vector<HashResult> m_results;  ///< Guarded by \p m_results_lock.
+	int         m_finished_tasks = 0;   ///< Guarded by \p m_results_lock.
+	QThreadPool m_thread_pool;
+};
+
+#endif // UTIL_DUPLICATE_FINDER_H
@@ -0,0 +1,200 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "encoded_file_cache.h"
+#include "util/misc.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QStorageInfo>
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace logging_category {Q_LOGGING_CATEGORY(encodedcache, "EncodedFileCache")}
+#define pdbg qCDebug(logging_category::encodedcache)
+#define pwarn qCWarning(logging_category::encodedcache)
+
+/// Default budget for cached file contents.
+static constexpr size_t default_budget = size_t{256} * 1024 * 1024;
+
+/// Number of concurrent reads, network reads are latency bound.
+static constexpr int read_threads = 2;
+
+/// Task for reading a file ahead in a thread pool.
+struct ReadaheadTask : public QRunnable
+{
+	ReadaheadTask(EncodedFileCache* c, const QString& f) : cache(c), filename(f)
+	{
+		setAutoDelete(true);
+	}
+
+	/// Also called when the task is dropped from the queue.
+	~ReadaheadTask() override
+	{
+		QMutexLocker _{&cache->m_lock};
+		cache->m_pending.erase(filename);
+	}
+
+	void run() override
+	{
+		if(!cache->m_shutting_down.load(std::memory_order_acquire))
+			cache->readThreadFunc(filename);
+	}
+
+	EncodedFileCache* cache;
+	QString           filename;
+};
+
+EncodedFileCache::EncodedFileCache()
+{
+	m_thread_pool.setMaxThreadCount(read_threads);
+	setBudget(default_budget);
+}
+
+EncodedFileCache::~EncodedFileCache()
+{
+	m_shutting_down.store(true, std::memory_order_release);
+	m_thread_pool.clear();
+	m_thread_pool.waitForDone();
+}
+
+void EncodedFileCache::setBudget(size_t bytes)
+{
+	QMutexLocker _{&m_lock};
+	const auto max_cost = static_cast<int>(std::min(bytes, static_cast<size_t>(std::numeric_limits<int>::max())));
+	if(max_cost != m_entries.maxCost())
+		m_entries.setMaxCost(max_cost);
+}
+
+size_t EncodedFileCache::memoryUsage() const
+{
+	QMutexLocker _{&m_lock};
+	return static_cast<size_t>(m_entries.totalCost());
+}
+
+void EncodedFileCache::readahead(const QStringList& files)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+
+	// drop requests that did not start yet, they may be out of date
+	m_thread_pool.clear();
+
+	for(const auto& filename : files) {
+		{
+			QMutexLocker _{&m_lock};
+			if(m_entries.contains(filename) || !m_pending.insert(filename).second)
+				continue;
+		}
+		m_thread_pool.start(new ReadaheadTask(this, filename));
+	}
+}
+
+QByteArray EncodedFileCache::data(const QString& filename)
+{
+	QByteArray res;
+	uint64_t file_id = 0;
+	{
+		QMutexLocker _{&m_lock};
+		const auto entry = m_entries.object(filename);
+		if(!entry)
+			return res;
+		res = entry->data;
+		file_id = entry->file_id;
+	}
+
+	if(util::get_file_identifier(filename) != file_id) {
+		pdbg << "file modified since read ahead:" << filename;
+		QMutexLocker _{&m_lock};
+		m_entries.remove(filename);
+		return QByteArray();
+	}
+	return res;
+}
+
+void EncodedFileCache::clear()
+{
+	m_thread_pool.clear();
+	QMutexLocker _{&m_lock};
+	m_entries.clear();
+}
+
+bool EncodedFileCache::isNetworkPath(const QString& path)
+{
+	const auto dir = QFileInfo(path).absolutePath();
+	{
+		QMutexLocker _{&m_lock};
+		const auto it = m_network_dirs.find(dir);
+		if(it != m_network_dirs.end())
+			return it->second;
+	}
+
+	bool network = false;
+	const auto native = QDir::toNativeSeparators(dir);
+	if(native.startsWith(QStringLiteral("\\\\"))) { // NOTE: UNC path on Windows
+		network = true;
+	} else {
+		const QStorageInfo storage(dir);
+		const auto fs = storage.fileSystemType().toLower();
+		static const char* const network_fs[] = {
+			"nfs", "nfs4", "cifs", "smb", "smbfs", "smb2", "smb3", "afs", "9p",
+			"fuse.sshfs", "fuse.rclone", "davfs", "ncpfs", "ceph", "glusterfs",
+		};
+		network = std::any_of(std::begin(network_fs), std::end(network_fs),
+		                      [&fs](const char* name) { return fs == QLatin1String(name); });
+#ifdef Q_OS_WIN
+		// NOTE: mapped network drives report the remote filesystem type
+		network = network || storage.device().startsWith(QByteArrayLiteral("\\\\"));
+#endif
+	}
+
+	QMutexLocker _{&m_lock};
+	m_network_dirs.emplace(dir, network);
+	return network;
+}
+
+void EncodedFileCache::readThreadFunc(const QString& filename)
+{
+	if(!isNetworkPath(filename)) {
+#ifdef Q_OS_LINUX
+		// let the kernel read the file into page cache
+		QFile file(filename);
+		if(file.open(QIODevice::ReadOnly))
+			posix_fadvise(file.handle(), 0, 0, POSIX_FADV_WILLNEED);
+#endif
+		return;
+	}
+
+	const auto file_id = util::get_file_identifier(filename);
+	QFile file(filename);
+	if(file_id == 0 || !file.open(QIODevice::ReadOnly))
+		return;
+
+	const qint64 size = file.size();
+	{
+		QMutexLocker _{&m_lock};
+		// NOTE: a single file should not evict everything else
+		if(size <= 0 || size > m_entries.maxCost() / 4)
+			return;
+	}
+
+	auto entry = std::make_unique<Entry>();
+	entry->data = file.readAll();
+	entry->file_id = file_id;
+	if(entry->data.size() != size || m_shutting_down.load(std::memory_order_acquire))
+		return;
+
+	pdbg << "read ahead" << size / 1024 << "KiB of" << filename;
+	QMutexLocker _{&m_lock};
+	m_entries.insert(filename, entry.release(), static_cast<int>(size));
+}
@@ -0,0 +1,85 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef ENCODED_FILE_CACHE_H
+#define ENCODED_FILE_CACHE_H
+
+/**
+ * \file encoded_file_cache.h
+ * \brief Class \ref EncodedFileCache
+ */
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include "util/unordered_map_qt.h"
+
+/*!
+ * \brief Cache of encoded file contents read ahead of time.
+ *
+ * Files on network mounts are read in background threads and kept in
+ * memory within a byte budget, so they can be decoded without waiting on
+ * the network. For files on local storage, the kernel is asked to read
+ * them into page cache instead (\c posix_fadvise(WILLNEED) where available),
+ * nothing is kept in process memory.
+ *
+ * Member functions of this class are thread-safe.
+ */
+class EncodedFileCache
+{
+public:
+	EncodedFileCache();
+	~EncodedFileCache();
+
+	/// Set maximum size of cached file contents in bytes.
+	void       setBudget(size_t bytes);
+
+	/// Current size of cached file contents in bytes.
+	size_t     memoryUsage() const;
+
+	/*!
+	 * \brief Read \p files ahead, in order of their importance.
+	 *
+	 * Replaces read requests queued by previous calls that did not start yet.
+	 */
+	void       readahead(const QStringList& files);
+
+	/// Cached contents of \p filename, or empty array if not cached or modified since.
+	QByteArray data(const QString& filename);
+
+	/// Remove all cached file contents.
+	void       clear();
+
+	/// Is \p path located on a network filesystem.
+	bool       isNetworkPath(const QString& path);
+
+private:
+	friend struct ReadaheadTask;
+
+	void readThreadFunc(const QString& filename);
+
+	/// Cached file contents.
+	struct Entry
+	{
+		QByteArray data;
+		uint64_t   file_id;
+	};
+
+	mutable QMutex          m_lock;
+	QCache<QString, Entry>  m_entries;
+	std::unordered_set<QString> m_pending;
+	std::unordered_map<QString, bool> m_network_dirs;
+	QThreadPool             m_thread_pool;
+	std::atomic_bool        m_shutting_down{false};
+};
+
+#endif // ENCODED_FILE_CACHE_H
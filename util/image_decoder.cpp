@@ -0,0 +1,504 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "image_decoder.h"
+#include "util/scaled_read.h"
+#include <QBuffer>
+#include <QFile>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QLoggingCategory>
+#include <QTransform>
+#include <algorithm>
+#include <cstring>
+
+#ifdef WISETAGGER_HAVE_LIBJPEG
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+
+#ifdef WISETAGGER_HAVE_LIBPNG
+#include <png.h>
+#endif
+
+#ifdef WISETAGGER_HAVE_LIBWEBP
+#include <webp/decode.h>
+#endif
+
+namespace logging_category {Q_LOGGING_CATEGORY(decoder, "ImageDecoder")}
+#define pdbg qCDebug(logging_category::decoder)
+#define pwarn qCWarning(logging_category::decoder)
+
+ImageFormat util::detect_image_format(const QByteArray& header)
+{
+	const auto starts_with = [&header](int offset, const char* magic, int size) {
+		return header.size() >= offset + size && std::memcmp(header.constData() + offset, magic, size) == 0;
+	};
+
+	if(starts_with(0, "\xFF\xD8\xFF", 3))
+		return ImageFormat::Jpeg;
+	if(starts_with(0, "\x89PNG\r\n\x1A\n", 8))
+		return ImageFormat::Png;
+	if(starts_with(0, "GIF87a", 6) || starts_with(0, "GIF89a", 6))
+		return ImageFormat::Gif;
+	if(starts_with(0, "RIFF", 4) && starts_with(8, "WEBP", 4))
+		return ImageFormat::Webp;
+	if(starts_with(0, "BM", 2))
+		return ImageFormat::Bmp;
+	if(starts_with(0, "II*\0", 4) || starts_with(0, "MM\0*", 4))
+		return ImageFormat::Tiff;
+	return ImageFormat::Unknown;
+}
+
+QByteArray util::image_format_name(ImageFormat format)
+{
+	switch(format) {
+	case ImageFormat::Jpeg: return QByteArrayLiteral("jpeg");
+	case ImageFormat::Png:  return QByteArrayLiteral("png");
+	case ImageFormat::Gif:  return QByteArrayLiteral("gif");
+	case ImageFormat::Webp: return QByteArrayLiteral("webp");
+	case ImageFormat::Bmp:  return QByteArrayLiteral("bmp");
+	case ImageFormat::Tiff: return QByteArrayLiteral("tiff");
+	case ImageFormat::Unknown: break;
+	}
+	return QByteArray();
+}
+
+/// Size of \p size fitted into \p target, never larger than \p size.
+static QSize fit(QSize size, QSize target)
+{
+	if(size.width() <= target.width() && size.height() <= target.height())
+		return size;
+	return size.scaled(target, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+}
+
+/// Applies EXIF \p transformation to \p image the same way QImageReader does.
+static QImage transformed(QImage image, QImageIOHandler::Transformations transformation)
+{
+	if(transformation == QImageIOHandler::TransformationNone)
+		return image;
+
+	if(transformation == QImageIOHandler::TransformationRotate270) {
+		return image.transformed(QTransform().rotate(270));
+	}
+	image = image.mirrored(transformation & QImageIOHandler::TransformationMirror,
+	                       transformation & QImageIOHandler::TransformationFlip);
+	if(transformation & QImageIOHandler::TransformationRotate90)
+		image = image.transformed(QTransform().rotate(90));
+	return image;
+}
+
+//------------------------------------------------------------------------------
+
+/// Decoder using QImageReader plugins, supports every format.
+class QtImageDecoder : public ImageDecoder
+{
+public:
+	const char* name() const override { return "qt"; }
+
+	bool supports(ImageFormat) const override { return true; }
+
+	QImage decode(const QByteArray& data, ImageFormat format, QSize target_size) const override
+	{
+		QBuffer buffer;
+		buffer.setData(data);
+		if(!buffer.open(QIODevice::ReadOnly))
+			return QImage();
+
+		QImageReader reader(&buffer, util::image_format_name(format));
+		reader.setAutoTransform(false); // NOTE: applied by registry
+		auto image = util::read_scaled(reader, target_size);
+		if(image.hasAlphaChannel() && image.format() != QImage::Format_ARGB32_Premultiplied)
+			image = std::move(image).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		return image;
+	}
+};
+
+//------------------------------------------------------------------------------
+
+#ifdef WISETAGGER_HAVE_LIBJPEG
+
+/// libjpeg error manager that returns control to decoder instead of exiting.
+struct JpegErrorManager
+{
+	jpeg_error_mgr pub;
+	std::jmp_buf   jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+	auto err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+	std::longjmp(err->jump, 1);
+}
+
+static void jpeg_emit_message(j_common_ptr, int) { }
+
+/*!
+ * Decodes JPEG \p data into \p image at the smallest DCT scale covering \p target_size.
+ * NOTE: no objects with destructors may live in this function because of longjmp.
+ */
+static bool read_jpeg(const QByteArray& data, QSize target_size, QImage* image)
+{
+	jpeg_decompress_struct cinfo;
+	JpegErrorManager jerr;
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit   = jpeg_error_exit;
+	jerr.pub.emit_message = jpeg_emit_message;
+
+	if(setjmp(jerr.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char*>(const_cast<char*>(data.constData())),
+	             static_cast<unsigned long>(data.size()));
+	jpeg_read_header(&cinfo, TRUE);
+
+	if(cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+		jpeg_destroy_decompress(&cinfo); // NOTE: left to Qt, which handles inverted Adobe CMYK
+		return false;
+	}
+
+	if(target_size.isValid()) {
+		const QSize full(static_cast<int>(cinfo.image_width), static_cast<int>(cinfo.image_height));
+		const QSize needed = fit(full, target_size);
+		for(unsigned denom = 8; denom > 1; denom /= 2) {
+			const int w = static_cast<int>((cinfo.image_width + denom - 1) / denom);
+			const int h = static_cast<int>((cinfo.image_height + denom - 1) / denom);
+			if(w >= needed.width() && h >= needed.height()) {
+				cinfo.scale_num   = 1;
+				cinfo.scale_denom = denom;
+				break;
+			}
+		}
+	}
+
+#ifdef JCS_EXTENSIONS // libjpeg-turbo converts straight into 32-bit pixels
+	cinfo.out_color_space = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? JCS_EXT_BGRX : JCS_EXT_XRGB;
+#else
+	cinfo.out_color_space = JCS_RGB;
+#endif
+	cinfo.dct_method = JDCT_ISLOW;
+
+	jpeg_start_decompress(&cinfo);
+	*image = QImage(static_cast<int>(cinfo.output_width), static_cast<int>(cinfo.output_height),
+	                QImage::Format_RGB32);
+	if(image->isNull()) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	while(cinfo.output_scanline < cinfo.output_height) {
+		const int y = static_cast<int>(cinfo.output_scanline);
+		JSAMPROW row = image->scanLine(y);
+		jpeg_read_scanlines(&cinfo, &row, 1);
+#ifndef JCS_EXTENSIONS
+		// expand packed RGB in place, last pixel first
+		auto line = reinterpret_cast<QRgb*>(row);
+		for(int x = image->width() - 1; x >= 0; --x)
+			line[x] = qRgb(row[x * 3], row[x * 3 + 1], row[x * 3 + 2]);
+#endif
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return true;
+}
+
+/// JPEG decoder using libjpeg(-turbo) with DCT scaling.
+class JpegImageDecoder : public ImageDecoder
+{
+public:
+	const char* name() const override { return "libjpeg"; }
+
+	bool supports(ImageFormat format) const override { return format == ImageFormat::Jpeg; }
+
+	QImage decode(const QByteArray& data, ImageFormat, QSize target_size) const override
+	{
+		QImage image;
+		if(!read_jpeg(data, target_size, &image))
+			return QImage();
+		return image;
+	}
+};
+
+#endif // WISETAGGER_HAVE_LIBJPEG
+
+//------------------------------------------------------------------------------
+
+#ifdef WISETAGGER_HAVE_LIBPNG
+
+/// State of progressive PNG read.
+struct PngReadState
+{
+	QImage* image;
+	bool    done;
+};
+
+static void png_error_silent(png_structp png, png_const_charp)
+{
+	png_longjmp(png, 1);
+}
+
+static void png_warning_silent(png_structp, png_const_charp) { }
+
+static void png_info_callback(png_structp png, png_infop info)
+{
+	auto state = static_cast<PngReadState*>(png_get_progressive_ptr(png));
+
+	const int color_type = png_get_color_type(png, info);
+	const bool alpha = (color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(png, info, PNG_INFO_tRNS);
+
+	png_set_expand(png);
+	png_set_strip_16(png);
+	png_set_gray_to_rgb(png);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	png_set_bgr(png); // NOTE: 32-bit QImage pixels are BGRA in memory
+	if(!alpha)
+		png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+#else
+	if(alpha)
+		png_set_swap_alpha(png);
+	else
+		png_set_filler(png, 0xff, PNG_FILLER_BEFORE);
+#endif
+	png_set_interlace_handling(png);
+	png_read_update_info(png, info);
+
+	*state->image = QImage(static_cast<int>(png_get_image_width(png, info)),
+	                       static_cast<int>(png_get_image_height(png, info)),
+	                       alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+	if(state->image->isNull())
+		png_error(png, "out of memory");
+}
+
+static void png_row_callback(png_structp png, png_bytep new_row, png_uint_32 row_num, int)
+{
+	auto state = static_cast<PngReadState*>(png_get_progressive_ptr(png));
+	if(new_row && row_num < static_cast<png_uint_32>(state->image->height()))
+		png_progressive_combine_row(png, state->image->scanLine(static_cast<int>(row_num)), new_row);
+}
+
+static void png_end_callback(png_structp png, png_infop)
+{
+	static_cast<PngReadState*>(png_get_progressive_ptr(png))->done = true;
+}
+
+/*!
+ * Decodes PNG \p data into \p image, rows are stored as libpng produces them.
+ * NOTE: no objects with destructors may live in this function because of longjmp.
+ */
+static bool read_png(const QByteArray& data, QImage* image)
+{
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, png_error_silent, png_warning_silent);
+	if(!png)
+		return false;
+	png_infop info = png_create_info_struct(png);
+	if(!info) {
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		return false;
+	}
+
+	PngReadState state{image, false};
+	if(setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, nullptr);
+		return false;
+	}
+
+	png_set_progressive_read_fn(png, &state, png_info_callback, png_row_callback, png_end_callback);
+
+	// NOTE: feeding data in chunks keeps libpng's row buffers warm in cache
+	const size_t chunk_size = 64 * 1024;
+	const auto bytes = reinterpret_cast<png_bytep>(const_cast<char*>(data.constData()));
+	const size_t size = static_cast<size_t>(data.size());
+	for(size_t offset = 0; offset < size && !state.done; offset += chunk_size)
+		png_process_data(png, info, bytes + offset, std::min(chunk_size, size - offset));
+
+	png_destroy_read_struct(&png, &info, nullptr);
+	return state.done;
+}
+
+/// PNG decoder using libpng progressive reader.
+class PngImageDecoder : public ImageDecoder
+{
+public:
+	const char* name() const override { return "libpng"; }
+
+	bool supports(ImageFormat format) const override { return format == ImageFormat::Png; }
+
+	QImage decode(const QByteArray& data, ImageFormat, QSize) const override
+	{
+		QImage image;
+		if(!read_png(data, &image))
+			return QImage();
+		// NOTE: libpng rows have straight alpha, premultiplying them as they arrive would break interlaced images
+		if(image.format() == QImage::Format_ARGB32)
+			image = std::move(image).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		return image;
+	}
+};
+
+#endif // WISETAGGER_HAVE_LIBPNG
+
+//------------------------------------------------------------------------------
+
+#ifdef WISETAGGER_HAVE_LIBWEBP
+
+/// WebP decoder using libwebp with multithreaded decoding and scaling.
+class WebpImageDecoder : public ImageDecoder
+{
+public:
+	const char* name() const override { return "libwebp"; }
+
+	bool supports(ImageFormat format) const override { return format == ImageFormat::Webp; }
+
+	QImage decode(const QByteArray& data, ImageFormat, QSize target_size) const override
+	{
+		WebPDecoderConfig config;
+		if(!WebPInitDecoderConfig(&config))
+			return QImage();
+
+		const auto bytes = reinterpret_cast<const uint8_t*>(data.constData());
+		const size_t size = static_cast<size_t>(data.size());
+		if(WebPGetFeatures(bytes, size, &config.input) != VP8_STATUS_OK || config.input.has_animation)
+			return QImage();
+
+		QSize out_size(config.input.width, config.input.height);
+		if(target_size.isValid()) {
+			const QSize fitted = fit(out_size, target_size);
+			if(fitted != out_size) {
+				config.options.use_scaling   = 1;
+				config.options.scaled_width  = fitted.width();
+				config.options.scaled_height = fitted.height();
+				out_size = fitted;
+			}
+		}
+		config.options.use_threads = 1;
+
+		const bool alpha = config.input.has_alpha;
+		QImage image(out_size, alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+		if(image.isNull())
+			return QImage();
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+		config.output.colorspace = alpha ? MODE_bgrA : MODE_BGRA;
+#else
+		config.output.colorspace = alpha ? MODE_Argb : MODE_ARGB;
+#endif
+		config.output.is_external_memory = 1;
+		config.output.u.RGBA.rgba   = image.bits();
+		config.output.u.RGBA.stride = image.bytesPerLine();
+		config.output.u.RGBA.size   = static_cast<size_t>(image.bytesPerLine()) * image.height();
+
+		const auto status = WebPDecode(bytes, size, &config);
+		WebPFreeDecBuffer(&config.output);
+		if(status != VP8_STATUS_OK)
+			return QImage();
+		return image;
+	}
+};
+
+#endif // WISETAGGER_HAVE_LIBWEBP
+
+//------------------------------------------------------------------------------
+
+DecoderRegistry::DecoderRegistry() : m_fallback(std::make_unique<QtImageDecoder>())
+{
+#ifdef WISETAGGER_HAVE_LIBJPEG
+	add(std::make_unique<JpegImageDecoder>());
+#endif
+#ifdef WISETAGGER_HAVE_LIBPNG
+	add(std::make_unique<PngImageDecoder>());
+#endif
+#ifdef WISETAGGER_HAVE_LIBWEBP
+	add(std::make_unique<WebpImageDecoder>());
+#endif
+}
+
+DecoderRegistry& DecoderRegistry::instance()
+{
+	static DecoderRegistry registry;
+	return registry;
+}
+
+void DecoderRegistry::add(std::unique_ptr<ImageDecoder> decoder)
+{
+	pdbg << "registered decoder" << decoder->name();
+	m_decoders.push_back(std::move(decoder));
+}
+
+std::vector<const ImageDecoder*> DecoderRegistry::decoders(ImageFormat format) const
+{
+	std::vector<const ImageDecoder*> res;
+	if(format != ImageFormat::Unknown) {
+		for(const auto& decoder : m_decoders) {
+			if(decoder->supports(format))
+				res.push_back(decoder.get());
+		}
+	}
+	res.push_back(m_fallback.get());
+	return res;
+}
+
+QImage DecoderRegistry::decode(const QByteArray& data, QSize target_size, QSize* original_size,
+                               const ImageDecoder** used) const
+{
+	const auto format = util::detect_image_format(data.left(util::image_magic_size));
+	for(const auto decoder : decoders(format)) {
+		auto image = decodeWith(*decoder, data, target_size, original_size);
+		if(!image.isNull()) {
+			if(used)
+				*used = decoder;
+			return image;
+		}
+		pdbg << "decoder" << decoder->name() << "failed on" << util::image_format_name(format) << "image";
+	}
+	return QImage();
+}
+
+QImage DecoderRegistry::decodeFile(const QString& filename, QSize target_size) const
+{
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly))
+		return QImage();
+
+	if(util::detect_image_format(file.peek(util::image_magic_size)) == ImageFormat::Unknown)
+		return QImage();
+
+	return decode(file.readAll(), target_size);
+}
+
+QImage DecoderRegistry::decodeWith(const ImageDecoder& decoder, const QByteArray& data, QSize target_size,
+                                   QSize* original_size) const
+{
+	const auto format = util::detect_image_format(data.left(util::image_magic_size));
+
+	// NOTE: only the header is read here, for size and EXIF orientation
+	QBuffer buffer;
+	buffer.setData(data);
+	buffer.open(QIODevice::ReadOnly);
+	QImageReader header(&buffer, util::image_format_name(format));
+	header.setAutoTransform(true);
+	const QSize raw_size = header.size();
+	const auto transformation = header.transformation();
+	const bool transposed = transformation & QImageIOHandler::TransformationRotate90;
+
+	// decoders work before orientation is applied
+	const QSize raw_target = raw_size.isValid() && target_size.isValid()
+	        ? (transposed ? target_size.transposed() : target_size)
+	        : QSize();
+	auto image = decoder.decode(data, format, raw_target);
+	if(image.isNull())
+		return image;
+
+	image = transformed(std::move(image), transformation);
+	if(original_size)
+		*original_size = raw_size.isValid() ? (transposed ? raw_size.transposed() : raw_size) : image.size();
+	return image;
+}
@@ -0,0 +1,133 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+/**
+ * \file image_decoder.h
+ * \brief Classes \ref ImageDecoder and \ref DecoderRegistry
+ */
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <memory>
+#include <vector>
+
+/// Image file format detected from file contents.
+enum class ImageFormat
+{
+	Unknown,
+	Jpeg,
+	Png,
+	Gif,
+	Webp,
+	Bmp,
+	Tiff,
+};
+
+namespace util {
+
+/// Number of leading bytes needed by \ref detect_image_format().
+constexpr int image_magic_size = 12;
+
+/// Format of image starting with \p header bytes, detected by its magic bytes.
+ImageFormat detect_image_format(const QByteArray& header);
+
+/// Format name of \p format as used by QImageReader, empty for \a ImageFormat::Unknown.
+QByteArray  image_format_name(ImageFormat format);
+
+} // namespace util
+
+/*!
+ * \brief Interface of image decoding backends.
+ *
+ * Decoders only decode still images from memory. EXIF orientation is
+ * applied by \ref DecoderRegistry, not by the decoder.
+ *
+ * Member functions must be thread-safe.
+ */
+class ImageDecoder
+{
+public:
+	virtual ~ImageDecoder() = default;
+
+	/// Short name of the decoder backend.
+	virtual const char* name() const = 0;
+
+	/// Can \p format be decoded.
+	virtual bool supports(ImageFormat format) const = 0;
+
+	/*!
+	 * \brief Decode image \p data of \p format.
+	 * \param target_size If valid, image may be decoded at a reduced size,
+	 *        as long as it still covers \p target_size fitted to the image.
+	 * \return Image with alpha channel in \c ARGB32_Premultiplied format, which is painted
+	 *         without conversion, or null image on failure.
+	 */
+	virtual QImage decode(const QByteArray& data, ImageFormat format, QSize target_size) const = 0;
+};
+
+/*!
+ * \brief Registry of image decoders.
+ *
+ * Native decoders built in (libjpeg-turbo, libpng, libwebp) are registered
+ * first, QImageReader is always registered last as the fallback for every
+ * format. Decoders are tried in order of registration.
+ *
+ * \note Decoders must be added before images are decoded from other threads.
+ */
+class DecoderRegistry
+{
+public:
+	/// Registry with built-in decoders.
+	static DecoderRegistry& instance();
+
+	/// Add \p decoder, it is preferred over decoders added later except the fallback.
+	void add(std::unique_ptr<ImageDecoder> decoder);
+
+	/// Decoders supporting \p format, in order of preference.
+	std::vector<const ImageDecoder*> decoders(ImageFormat format) const;
+
+	/*!
+	 * \brief Decode \p data with the most preferred decoder that succeeds.
+	 * \param data Encoded image.
+	 * \param target_size Size in device pixels after orientation the image is displayed in, or invalid size.
+	 * \param original_size Set to size of the full image after orientation, if not null.
+	 * \param used Set to decoder that decoded the image, if not null.
+	 * \return Decoded image with EXIF orientation applied, or null image on failure.
+	 *
+	 * The Qt fallback decodes huge images at reduced size, see \ref util::read_scaled().
+	 */
+	QImage decode(const QByteArray& data, QSize target_size, QSize* original_size = nullptr,
+	              const ImageDecoder** used = nullptr) const;
+
+	/*!
+	 * \brief Decode \p data with \p decoder only.
+	 *
+	 * Same as \ref decode() otherwise, for comparing decoders.
+	 */
+	QImage decodeWith(const ImageDecoder& decoder, const QByteArray& data, QSize target_size,
+	                  QSize* original_size = nullptr) const;
+
+	/*!
+	 * \brief Read and decode \p filename, see \ref decode().
+	 * \return Decoded image, or null image if the file could not be read or decoded.
+	 *
+	 * Files that are not images by contents, \em e.g. videos, are not read whole.
+	 */
+	QImage decodeFile(const QString& filename, QSize target_size) const;
+
+private:
+	DecoderRegistry();
+
+	std::vector<std::unique_ptr<ImageDecoder>> m_decoders;
+	std::unique_ptr<ImageDecoder>              m_fallback;
+};
+
+#endif // IMAGE_DECODER_H
@@ -0,0 +1,128 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "image_filter.h"
+#include <QRegularExpression>
+#include <cmath>
+
+/// Sign of orientation: -1 for portrait, 0 for square, 1 for landscape.
+static int orientation_sign(QSize size)
+{
+	return (size.width() > size.height()) - (size.width() < size.height());
+}
+
+/// Fractional values are compared with as many decimals as users type, \em e.g. \c ratio=1.78 for 16:9.
+static double equal_tolerance(ImagePredicate::Property property)
+{
+	switch(property) {
+	case ImagePredicate::Property::AspectRatio: return 0.005;
+	case ImagePredicate::Property::Megapixels:  return 0.05;
+	default: return 0.5;
+	}
+}
+
+static bool parse_format(QString name, ImageFormat* format)
+{
+	if(name == QStringLiteral("jpg"))
+		name = QStringLiteral("jpeg");
+	if(name == QStringLiteral("tif"))
+		name = QStringLiteral("tiff");
+
+	for(auto f : {ImageFormat::Jpeg, ImageFormat::Png, ImageFormat::Gif,
+	              ImageFormat::Webp, ImageFormat::Bmp, ImageFormat::Tiff})
+	{
+		if(name == QString::fromLatin1(util::image_format_name(f))) {
+			*format = f;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ImagePredicate::parse(const QString& str, ImagePredicate* predicate)
+{
+	static const QRegularExpression re(QStringLiteral("^(width|height|ratio|mp|format|orientation)(<=|>=|<|>|=)(.+)$"),
+	                                   QRegularExpression::CaseInsensitiveOption);
+	const auto match = re.match(str);
+	if(!match.hasMatch())
+		return false;
+
+	const auto property = match.captured(1).toLower();
+	const auto comparison = match.captured(2);
+	const auto value = match.captured(3).toLower();
+
+	ImagePredicate res;
+	if(comparison == QStringLiteral("<"))       res.m_comparison = Comparison::Less;
+	else if(comparison == QStringLiteral("<=")) res.m_comparison = Comparison::LessEqual;
+	else if(comparison == QStringLiteral(">=")) res.m_comparison = Comparison::GreaterEqual;
+	else if(comparison == QStringLiteral(">"))  res.m_comparison = Comparison::Greater;
+	else                                        res.m_comparison = Comparison::Equal;
+
+	if(property == QStringLiteral("format") || property == QStringLiteral("orientation")) {
+		if(res.m_comparison != Comparison::Equal)
+			return false;
+
+		if(property == QStringLiteral("format")) {
+			res.m_property = Property::Format;
+			if(!parse_format(value, &res.m_format))
+				return false;
+		} else {
+			res.m_property = Property::Orientation;
+			if(value == QStringLiteral("portrait"))       res.m_value = -1;
+			else if(value == QStringLiteral("square"))    res.m_value = 0;
+			else if(value == QStringLiteral("landscape")) res.m_value = 1;
+			else return false;
+		}
+	} else {
+		bool ok = false;
+		res.m_value = value.toDouble(&ok);
+		if(!ok)
+			return false;
+
+		if(property == QStringLiteral("width"))       res.m_property = Property::Width;
+		else if(property == QStringLiteral("height")) res.m_property = Property::Height;
+		else if(property == QStringLiteral("ratio"))  res.m_property = Property::AspectRatio;
+		else                                          res.m_property = Property::Megapixels;
+	}
+
+	*predicate = res;
+	return true;
+}
+
+bool ImagePredicate::matches(const ImageInfo& info) const
+{
+	if(!info.isValid())
+		return false;
+
+	const QSize size = info.orientedSize();
+	switch(m_property) {
+	case Property::Format:
+		return info.format == m_format;
+	case Property::Orientation:
+		return orientation_sign(size) == static_cast<int>(m_value);
+	default:
+		break;
+	}
+
+	double value = 0;
+	switch(m_property) {
+	case Property::Width:       value = size.width(); break;
+	case Property::Height:      value = size.height(); break;
+	case Property::AspectRatio: value = size.width() / static_cast<double>(size.height()); break;
+	case Property::Megapixels:  value = size.width() * static_cast<double>(size.height()) / 1e6; break;
+	default: break;
+	}
+
+	switch(m_comparison) {
+	case Comparison::Less:         return value <  m_value;
+	case Comparison::LessEqual:    return value <= m_value;
+	case Comparison::Equal:        return std::abs(value - m_value) < equal_tolerance(m_property);
+	case Comparison::GreaterEqual: return value >= m_value;
+	case Comparison::Greater:      return value >  m_value;
+	}
+	return false;
+}
@@ -0,0 +1,75 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_IMAGE_FILTER_H
+#define UTIL_IMAGE_FILTER_H
+
+/**
+ * \file image_filter.h
+ * \brief Class \ref ImagePredicate
+ */
+
+#include "util/image_probe.h"
+#include <QString>
+
+/*!
+ * \brief Condition on image properties, used in queue filter.
+ *
+ * Written as \c property, comparison and value without spaces:
+ *
+ * | Predicate               | Matches                                 |
+ * |-------------------------|-----------------------------------------|
+ * | \c width<1000           | images narrower than 1000 pixels        |
+ * | \c height>=2160         | images at least 2160 pixels high        |
+ * | \c ratio>1.5            | images wider than 3:2                   |
+ * | \c mp<=12               | images of at most 12 megapixels         |
+ * | \c format=png           | PNG images, by contents                 |
+ * | \c orientation=portrait | \c portrait, \c landscape or \c square  |
+ *
+ * Dimensions are compared after EXIF orientation is applied.
+ */
+class ImagePredicate
+{
+public:
+	/// Image property compared.
+	enum class Property
+	{
+		Width,
+		Height,
+		AspectRatio,
+		Megapixels,
+		Format,
+		Orientation,
+	};
+
+	/// Comparison of property with value.
+	enum class Comparison
+	{
+		Less,
+		LessEqual,
+		Equal,
+		GreaterEqual,
+		Greater,
+	};
+
+	/*!
+	 * \brief Parse predicate from \p str.
+	 * \return True if \p str is a valid predicate, \p predicate is set then.
+	 */
+	static bool parse(const QString& str, ImagePredicate* predicate);
+
+	/// Does image described by \p info match, images with unknown dimensions never match.
+	bool matches(const ImageInfo& info) const;
+
+private:
+	Property    m_property   = Property::Width;
+	Comparison  m_comparison = Comparison::Equal;
+	double      m_value      = 0;
+	ImageFormat m_format     = ImageFormat::Unknown;
+};
+
+#endif // UTIL_IMAGE_FILTER_H
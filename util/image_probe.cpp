@@ -0,0 +1,319 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "image_probe.h"
+#include <QFile>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+/// Limit on reads from file, so corrupted headers cannot make probing slow.
+constexpr int max_probe_reads = 16;
+
+/// Limit on JPEG segments skipped before SOF.
+constexpr int max_jpeg_segments = 256;
+
+/// Limit on TIFF IFD entries examined.
+constexpr int max_tiff_entries = 512;
+
+/// Files probed by a thread at once in \ref util::probe_image_files().
+constexpr size_t probe_chunk_size = 64;
+
+inline uint32_t le16(const uchar* p) { return p[0] | (p[1] << 8); }
+inline uint32_t le24(const uchar* p) { return le16(p) | (p[2] << 16); }
+inline uint32_t le32(const uchar* p) { return le24(p) | (uint32_t(p[3]) << 24); }
+inline uint32_t be16(const uchar* p) { return (p[0] << 8) | p[1]; }
+inline uint32_t be32(const uchar* p) { return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+/// Size from header fields, invalid if out of range.
+QSize checked_size(uint32_t width, uint32_t height)
+{
+	const uint32_t max = std::numeric_limits<int>::max();
+	if(width == 0 || height == 0 || width > max || height > max)
+		return QSize();
+	return QSize(static_cast<int>(width), static_cast<int>(height));
+}
+
+/*!
+ * \brief Random access to probed data, through a window read from file on demand.
+ */
+class ProbeSource
+{
+public:
+	explicit ProbeSource(const QByteArray& data) : m_window(data) { }
+
+	explicit ProbeSource(QIODevice* device) : m_device(device) { }
+
+	/// Pointer to \p size bytes at \p offset, or null if they are past the end of data.
+	const uchar* get(qint64 offset, int size)
+	{
+		if(offset < 0 || size < 0)
+			return nullptr;
+		if(!contains(offset, size)) {
+			if(!m_device || m_reads >= max_probe_reads || !m_device->seek(offset))
+				return nullptr;
+			++m_reads;
+			m_window = m_device->read(std::max(size, util::image_probe_size));
+			m_window_offset = offset;
+			if(!contains(offset, size))
+				return nullptr;
+		}
+		return reinterpret_cast<const uchar*>(m_window.constData() + (offset - m_window_offset));
+	}
+
+private:
+	bool contains(qint64 offset, int size) const
+	{
+		return offset >= m_window_offset && offset + size <= m_window_offset + m_window.size();
+	}
+
+	QIODevice* m_device = nullptr;
+	QByteArray m_window;
+	qint64     m_window_offset = 0;
+	int        m_reads = 0;
+};
+
+/*!
+ * \brief Read dimensions and orientation from IFD0 of TIFF structure starting at \p base.
+ * \return False if the TIFF header is invalid.
+ */
+bool read_tiff_ifd0(ProbeSource& src, qint64 base, uint32_t* width, uint32_t* height, int* orientation)
+{
+	const auto header = src.get(base, 8);
+	if(!header)
+		return false;
+
+	bool big_endian;
+	if(header[0] == 'I' && header[1] == 'I') {
+		big_endian = false;
+	} else if(header[0] == 'M' && header[1] == 'M') {
+		big_endian = true;
+	} else {
+		return false;
+	}
+	const auto rd16 = big_endian ? be16 : le16;
+	const auto rd32 = big_endian ? be32 : le32;
+	if(rd16(header + 2) != 42)
+		return false;
+
+	const qint64 ifd = base + rd32(header + 4);
+	const auto count_ptr = src.get(ifd, 2);
+	if(!count_ptr)
+		return false;
+	const int count = std::min(static_cast<int>(rd16(count_ptr)), max_tiff_entries);
+
+	for(int i = 0; i < count; ++i) {
+		const auto entry = src.get(ifd + 2 + i * 12, 12);
+		if(!entry)
+			return false;
+
+		uint32_t value;
+		switch(rd16(entry + 2)) {
+		case 3:  value = rd16(entry + 8); break; // SHORT
+		case 4:  value = rd32(entry + 8); break; // LONG
+		default: continue;
+		}
+
+		switch(rd16(entry)) {
+		case 256: if(width)  *width  = value; break;
+		case 257: if(height) *height = value; break;
+		case 274:
+			if(orientation && value >= 1 && value <= 8)
+				*orientation = static_cast<int>(value);
+			break;
+		}
+	}
+	return true;
+}
+
+bool is_jpeg_sof(uchar marker)
+{
+	// SOF0-SOF15, except DHT, JPG and DAC
+	return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+void probe_jpeg(ProbeSource& src, ImageInfo* info)
+{
+	qint64 pos = 2;
+	for(int segments = 0; segments < max_jpeg_segments; ++segments) {
+		const auto p = src.get(pos, 4);
+		if(!p || p[0] != 0xFF)
+			return;
+
+		const uchar marker = p[1];
+		if(marker == 0xFF) { // fill byte
+			++pos;
+			continue;
+		}
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) { // markers without length
+			pos += 2;
+			continue;
+		}
+		if(marker == 0xD9 || marker == 0xDA) // EOI or SOS before any SOF
+			return;
+
+		const uint32_t length = be16(p + 2);
+		if(length < 2)
+			return;
+
+		if(is_jpeg_sof(marker)) {
+			const auto sof = src.get(pos + 4, 5);
+			if(sof)
+				info->size = checked_size(be16(sof + 3), be16(sof + 1));
+			return;
+		}
+		if(marker == 0xE1 && length >= 16) {
+			const auto exif = src.get(pos + 4, 6);
+			if(exif && std::memcmp(exif, "Exif\0\0", 6) == 0)
+				read_tiff_ifd0(src, pos + 10, nullptr, nullptr, &info->orientation);
+		}
+		pos += 2 + length;
+	}
+}
+
+void probe_png(ProbeSource& src, ImageInfo* info)
+{
+	const auto p = src.get(0, 24);
+	if(p && std::memcmp(p + 12, "IHDR", 4) == 0)
+		info->size = checked_size(be32(p + 16), be32(p + 20));
+}
+
+void probe_gif(ProbeSource& src, ImageInfo* info)
+{
+	const auto p = src.get(0, 10);
+	if(p)
+		info->size = checked_size(le16(p + 6), le16(p + 8));
+}
+
+void probe_webp(ProbeSource& src, ImageInfo* info)
+{
+	const auto p = src.get(0, 30);
+	if(!p)
+		return;
+
+	if(std::memcmp(p + 12, "VP8 ", 4) == 0) {
+		// lossy: key frame start code, then 14-bit dimensions and 2-bit scale
+		if(p[23] == 0x9D && p[24] == 0x01 && p[25] == 0x2A)
+			info->size = checked_size(le16(p + 26) & 0x3FFF, le16(p + 28) & 0x3FFF);
+	} else if(std::memcmp(p + 12, "VP8L", 4) == 0) {
+		// lossless: signature, then 14-bit width - 1 and height - 1
+		if(p[20] == 0x2F) {
+			const uint32_t bits = le32(p + 21);
+			info->size = checked_size((bits & 0x3FFF) + 1, ((bits >> 14) & 0x3FFF) + 1);
+		}
+	} else if(std::memcmp(p + 12, "VP8X", 4) == 0) {
+		// extended: 24-bit canvas width - 1 and height - 1
+		info->size = checked_size(le24(p + 24) + 1, le24(p + 27) + 1);
+	}
+}
+
+void probe_bmp(ProbeSource& src, ImageInfo* info)
+{
+	const auto p = src.get(0, 26);
+	if(!p)
+		return;
+
+	if(le32(p + 14) == 12) { // OS/2 BITMAPCOREHEADER
+		info->size = checked_size(le16(p + 18), le16(p + 20));
+	} else {
+		// NOTE: negative height means rows are stored top-down
+		const auto height = static_cast<int32_t>(le32(p + 22));
+		info->size = checked_size(le32(p + 18), height < 0 ? 0u - static_cast<uint32_t>(height)
+		                                                   : static_cast<uint32_t>(height));
+	}
+}
+
+void probe_tiff(ProbeSource& src, ImageInfo* info)
+{
+	uint32_t width = 0, height = 0;
+	if(read_tiff_ifd0(src, 0, &width, &height, &info->orientation))
+		info->size = checked_size(width, height);
+}
+
+ImageInfo probe(ProbeSource& src)
+{
+	ImageInfo info;
+	const auto magic = src.get(0, util::image_magic_size);
+	if(!magic)
+		return info;
+
+	info.format = util::detect_image_format(
+		QByteArray::fromRawData(reinterpret_cast<const char*>(magic), util::image_magic_size));
+	switch(info.format) {
+	case ImageFormat::Jpeg: probe_jpeg(src, &info); break;
+	case ImageFormat::Png:  probe_png(src, &info);  break;
+	case ImageFormat::Gif:  probe_gif(src, &info);  break;
+	case ImageFormat::Webp: probe_webp(src, &info); break;
+	case ImageFormat::Bmp:  probe_bmp(src, &info);  break;
+	case ImageFormat::Tiff: probe_tiff(src, &info); break;
+	case ImageFormat::Unknown: break;
+	}
+	return info;
+}
+
+} // namespace
+
+ImageInfo util::probe_image(const QByteArray& data)
+{
+	ProbeSource src(data);
+	return probe(src);
+}
+
+ImageInfo util::probe_image_file(const QString& filename)
+{
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+		return ImageInfo();
+
+	ProbeSource src(&file);
+	return probe(src);
+}
+
+std::vector<ImageInfo> util::probe_image_files(const std::vector<QString>& files, int threads)
+{
+	std::vector<ImageInfo> res(files.size());
+	std::atomic<size_t> next_chunk{0};
+
+	// NOTE: threads take chunks as they go, file access times vary a lot
+	auto worker = [&files, &res, &next_chunk]() {
+		while(true) {
+			const size_t begin = next_chunk.fetch_add(probe_chunk_size);
+			if(begin >= files.size())
+				break;
+			const size_t end = std::min(begin + probe_chunk_size, files.size());
+			for(size_t i = begin; i < end; ++i)
+				res[i] = probe_image_file(files[i]);
+		}
+	};
+
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+	const size_t chunks = (files.size() + probe_chunk_size - 1) / probe_chunk_size;
+	threads = static_cast<int>(std::min<size_t>(std::max(threads, 1), std::max<size_t>(chunks, 1)));
+
+	std::vector<std::thread> workers;
+	for(int i = 1; i < threads; ++i) {
+		try {
+			workers.emplace_back(worker);
+		} catch(const std::system_error&) {
+			// could not start a thread, remaining threads share the work
+			break;
+		}
+	}
+	worker();
+
+	for(auto& t : workers)
+		t.join();
+	return res;
+}
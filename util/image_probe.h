@@ -0,0 +1,68 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_IMAGE_PROBE_H
+#define UTIL_IMAGE_PROBE_H
+
+/**
+ * \file image_probe.h
+ * \brief Reading image format and dimensions from file headers
+ */
+
+#include "util/image_decoder.h"
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+#include <vector>
+
+/// Image metadata read from file headers, without decoding.
+struct ImageInfo
+{
+	ImageFormat format = ImageFormat::Unknown;
+	QSize       size;            ///< Dimensions as stored in file.
+	int         orientation = 1; ///< EXIF orientation, 1 to 8.
+
+	/// Was format and size recognized.
+	bool isValid() const { return format != ImageFormat::Unknown && size.isValid(); }
+
+	/// Dimensions after applying EXIF orientation.
+	QSize orientedSize() const { return orientation >= 5 ? size.transposed() : size; }
+};
+
+namespace util {
+
+/// Number of bytes read from file at once while probing.
+constexpr int image_probe_size = 4096;
+
+/*!
+ * \brief Probe image \p data in memory.
+ *
+ * Parses JPEG SOF, PNG IHDR, GIF logical screen descriptor, WebP VP8/VP8L/VP8X,
+ * BMP and TIFF headers, and EXIF orientation of JPEG and TIFF.
+ *
+ * \return Image info, invalid if \p data is not a supported image or is truncated.
+ */
+ImageInfo probe_image(const QByteArray& data);
+
+/*!
+ * \brief Probe image file \p filename.
+ *
+ * Reads the first \ref image_probe_size bytes, and more only when headers
+ * point further into the file (JPEG with large metadata segments, TIFF).
+ */
+ImageInfo probe_image_file(const QString& filename);
+
+/*!
+ * \brief Probe image \p files in parallel.
+ * \param threads Number of threads to use, or 0 to use ideal thread count.
+ * \return Image info of each file in order of \p files.
+ */
+std::vector<ImageInfo> probe_image_files(const std::vector<QString>& files, int threads = 0);
+
+} // namespace util
+
+#endif // UTIL_IMAGE_PROBE_H
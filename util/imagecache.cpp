@@ -6,29 +6,213 @@
  */
 
 #include "imagecache.h"
+#include "util/image_decoder.h"
 #include "util/misc.h"
+#include "util/resample.h"
+#include "util/scaled_read.h"
+#include <QBuffer>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QImageReader>
+#include <QJsonArray>
 #include <QLoggingCategory>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <limits>
 
 
-static uint64_t get_image_identifier(const QString& filename, QSize size)
-{
-	uint64_t file_id = util::get_file_identifier(filename), image_id = 0u;
-	if(file_id != 0) {
-		image_id = file_id ^ (qHash(size.width(), 0x34ba7cf0) * qHash(size.height(), 0x98015dea));
-	}
-	return image_id;
-}
-
 namespace logging_category {Q_LOGGING_CATEGORY(imagecache, "ImageCache")}
 #define pdbg qCDebug(logging_category::imagecache)
 #define pwarn qCWarning(logging_category::imagecache)
 
 #define DEFAULT_CACHE_SIZE_KB 64*1024
 
+constexpr int ImageCache::queue_position_window;
+
+/// Pyramid levels are not generated below this size (in pixels, larger dimension).
+static constexpr int min_level_size = 256;
+
+/// Maximum number of pyramid levels per image, including the largest one.
+static constexpr size_t max_levels = 5;
+
+/// Number of file reads kept in flight by batched prefetch.
+static constexpr int batch_queue_depth = 16;
+
+/// Number of recently loaded entries remembered for counting eviction misses.
+static constexpr size_t max_loaded_ids = 4096;
+
+/// Larger files are not read by batched prefetch, they are decoded while being read instead.
+static constexpr qint64 batch_max_file_size = 64 * 1024 * 1024;
+
+/// Size of \p original fitted into \p target_size, never larger than \p original.
+static QSize fit_size(QSize original, QSize target_size)
+{
+	if(original.width() <= target_size.width() && original.height() <= target_size.height())
+		return original;
+	return original.scaled(target_size, Qt::KeepAspectRatio);
+}
+
+/// Number of 90 degree clockwise steps of \p rotation, in range [0, 3].
+static int rotation_steps(int rotation)
+{
+	return ((rotation % 4) + 4) % 4;
+}
+
+/// Cache key of image \p unique_id rotated by \p rotation steps.
+static uint64_t variant_key(uint64_t unique_id, int rotation)
+{
+	const auto steps = static_cast<uint64_t>(rotation_steps(rotation));
+	return steps ? unique_id ^ (steps * 0x9E3779B97F4A7C15ull) : unique_id;
+}
+
+/// Cache key of display frame of image \p unique_id, unlike any rotation of \ref variant_key().
+static uint64_t frame_key(uint64_t unique_id)
+{
+	return unique_id ^ (4 * 0x9E3779B97F4A7C15ull);
+}
+
+/// Keys of all cache entries of image \p unique_id: rotated variants and display frame.
+static std::array<uint64_t, 5> entry_keys(uint64_t unique_id)
+{
+	return {{variant_key(unique_id, 0), variant_key(unique_id, 1), variant_key(unique_id, 2),
+	         variant_key(unique_id, 3), frame_key(unique_id)}};
+}
+
+/// Size image of \p original size is displayed at in \p viewport.
+static QSize frame_size(QSize original, QSize viewport, bool upscale)
+{
+	return upscale ? original.scaled(viewport, Qt::KeepAspectRatio) : fit_size(original, viewport);
+}
+
+/// \p image in a format that is painted without conversion.
+static QImage display_format(QImage&& image)
+{
+	if(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)
+		return std::move(image);
+	return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+	                                                     : QImage::Format_RGB32);
+}
+
+/// \p image rotated by \p rotation steps clockwise, device pixel ratio is preserved.
+static QImage rotated(const QImage& image, int rotation)
+{
+	QTransform t;
+	t.rotate(90.0 * rotation_steps(rotation));
+	auto res = image.transformed(t, Qt::FastTransformation);
+	res.setDevicePixelRatio(image.devicePixelRatio());
+	return res;
+}
+
+/// Size of \p image data in bytes.
+static qint64 image_bytes(const QImage& image)
+{
+#if (QT_VERSION < QT_VERSION_CHECK(5, 10, 0)) // NOTE: deprecated since Qt 5.10
+	return image.byteCount();
+#else
+	return image.sizeInBytes();
+#endif
+}
+
+size_t ImageCache::Animation::bytes() const
+{
+	size_t total = static_cast<size_t>(encoded.size());
+	for(const auto& frame : frames)
+		total += static_cast<size_t>(image_bytes(frame));
+	return total;
+}
+
+bool ImageCache::Entry::covers(QSize window_size) const
+{
+	if(animation && animation->frames.empty())
+		return true; // played from encoded data at any size
+
+	if(!animation && levels.empty())
+		return false;
+
+	const auto& largest = animation ? animation->frames.front() : levels.front();
+	if(largest.size() == original_size)
+		return true; // full resolution, nothing better to load
+
+	const auto target = fit_size(original_size, window_size * largest.devicePixelRatio());
+	// allow one pixel of rounding error
+	return largest.width() + 1 >= target.width() && largest.height() + 1 >= target.height();
+}
+
+QImage ImageCache::Entry::levelFor(QSize window_size) const
+{
+	if(!covers(window_size))
+		return QImage{};
+
+	const auto target = fit_size(original_size, window_size * levels.front().devicePixelRatio());
+	auto it = std::find_if(levels.rbegin(), levels.rend(), [target](const QImage& level)
+	{
+		return level.width() + 1 >= target.width() && level.height() + 1 >= target.height();
+	});
+	Q_ASSERT(it != levels.rend());
+	return *it;
+}
+
+ImageCache::Entry::~Entry()
+{
+	if(counters && state == State::Ready && !used.load(std::memory_order_relaxed))
+		counters->prefetch_wasted.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// Are all pixels of \p image opaque.
+static bool is_opaque(const QImage& image)
+{
+	if(!image.hasAlphaChannel())
+		return true;
+	if(image.format() != QImage::Format_ARGB32_Premultiplied && image.format() != QImage::Format_ARGB32)
+		return false; // NOTE: resampled images are always in one of these formats
+
+	for(int y = 0; y < image.height(); ++y) {
+		const auto line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+		for(int x = 0; x < image.width(); ++x) {
+			if(qAlpha(line[x]) != 255)
+				return false;
+		}
+	}
+	return true;
+}
+
+/*!
+ * Converts opaque \p levels to 24-bit RGB, or to 8-bit grayscale if they
+ * have no color, without losing any pixel data.
+ */
+static void compact_levels(std::vector<QImage>& levels)
+{
+	if(levels.empty() || !is_opaque(levels.front()))
+		return;
+
+	// NOTE: halvings of gray image are gray too
+	const auto format = levels.front().allGray() ? QImage::Format_Grayscale8 : QImage::Format_RGB888;
+	for(auto& level : levels) {
+		level = level.convertToFormat(format);
+	}
+}
+
+/// Builds image pyramid: \p image followed by its halvings.
+static std::vector<QImage> make_levels(QImage&& image)
+{
+	std::vector<QImage> levels;
+	levels.push_back(std::move(image));
+
+	while(levels.size() < max_levels) {
+		const auto& prev = levels.back();
+		const QSize half(prev.width() / 2, prev.height() / 2);
+		if(std::max(half.width(), half.height()) < min_level_size || half.isEmpty())
+			break;
+
+		auto level = util::resample::scaled(prev, half, util::resample::Filter::Box, 1);
+		if(level.isNull())
+			break;
+		levels.push_back(std::move(level));
+	}
+	return levels;
+}
+
 /// Task for loading and resizing an image in a thread pool.
 struct LoadResizeImageTask : public QRunnable
 {
@@ -44,12 +228,28 @@ struct LoadResizeImageTask : public QRunnable
 	/// Window device pixel ratio.
 	double      device_pixel_ratio = 1.0;
 
+	/// Image rotation in 90 degree increments clockwise.
+	int         rotation = 0;
+
+	/// Cache key reserved for the image by batched prefetch, zero otherwise.
+	uint64_t    image_id = 0;
+
+	/// File contents read by batched prefetch, the file is read by the task if empty.
+	QByteArray  encoded;
+
 	/// Constructs the task.
-	LoadResizeImageTask(ImageCache* cache_, const QString& filename_, QSize window_size_, double dpr_) :
-	        cache(cache_), filename(filename_), window_size(window_size_), device_pixel_ratio(dpr_)
+	LoadResizeImageTask(ImageCache* cache_, const QString& filename_, QSize window_size_, double dpr_, int rotation_) :
+	        cache(cache_), filename(filename_), window_size(window_size_), device_pixel_ratio(dpr_), rotation(rotation_)
 	{
 		Q_ASSERT(cache);
 		setAutoDelete(true);
+		cache->m_counters.tasks_in_flight.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Destroys the task after it has run or was rejected by thread pool.
+	~LoadResizeImageTask() override
+	{
+		cache->m_counters.tasks_in_flight.fetch_sub(1, std::memory_order_relaxed);
 	}
 
 	/// Called when task is started in a thread.
@@ -62,22 +262,65 @@ struct LoadResizeImageTask : public QRunnable
 			return;
 
 		filename.detach();
+		if(image_id != 0) {
+			auto loadResizeThreadFn = &ImageCache::loadResizeThreadFunc;
+			(cache->*loadResizeThreadFn)(filename, image_id, window_size, device_pixel_ratio, rotation, encoded);
+			return;
+		}
 		auto addFileThreadFn = &ImageCache::addFileThreadFunc;
-		(cache->*addFileThreadFn)(filename, window_size, device_pixel_ratio);
+		(cache->*addFileThreadFn)(filename, window_size, device_pixel_ratio, rotation);
 	}
 };
 
-ImageCache::ImageCache()
+/// Task for reading a batch of files and handing them to decoding tasks.
+struct BatchLoadTask : public QRunnable
 {
+	/// Constructs the task.
+	BatchLoadTask(ImageCache* cache_, const QStringList& files_, QSize window_size_, double dpr_,
+	              uint64_t generation_) :
+	        cache(cache_), files(files_), window_size(window_size_), device_pixel_ratio(dpr_),
+	        generation(generation_)
+	{
+		Q_ASSERT(cache);
+		setAutoDelete(true);
+	}
+
+	/// Called when task is started in a thread.
+	void run() override
+	{
+		if(cache->m_shutting_down.load(std::memory_order_acquire))
+			return;
+
+		auto batchLoadThreadFn = &ImageCache::batchLoadThreadFunc;
+		(cache->*batchLoadThreadFn)(files, window_size, device_pixel_ratio, generation);
+	}
+
+	ImageCache* cache;
+	QStringList files;
+	QSize       window_size;
+	double      device_pixel_ratio;
+	uint64_t    generation;
+};
+
+ImageCache::ImageCache() : m_batch_reader(batch_queue_depth)
+{
+	m_io_pool.setMaxThreadCount(1);
 	m_file_id_cache.reserve(DEFAULT_CACHE_SIZE_KB / 512);
-	m_image_cache.setMaxCost(DEFAULT_CACHE_SIZE_KB * 1024);
+	m_memory_limit = DEFAULT_CACHE_SIZE_KB * 1024;
+	m_memory_allowance = std::numeric_limits<size_t>::max();
+	m_encoded_budget = size_t{256} * 1024 * 1024;
+	updateMaxCost();
 	m_shutting_down.store(false, std::memory_order_relaxed);
+	MemoryGovernor::instance().registerConsumer(this);
 }
 
 ImageCache::~ImageCache()
 {
+	MemoryGovernor::instance().unregisterConsumer(this);
 	m_shutting_down.store(true, std::memory_order_release);
 	pdbg << "waiting on remaining tasks...";
+	m_io_pool.clear();
+	m_io_pool.waitForDone();
 	m_thread_pool.clear();
 	m_thread_pool.waitForDone();
 	pdbg << "waiting on remaining tasks completed.";
@@ -99,8 +342,104 @@ void ImageCache::setMemoryLimitKiB(size_t size_in_kb)
 	}
 	{
 		QWriteLocker _{&m_image_cache_lock};
-		m_image_cache.setMaxCost(size_in_kb * 1024);
+		m_memory_limit = size_in_kb * 1024;
+		updateMaxCost();
+	}
+}
+
+size_t ImageCache::memoryUsage() const
+{
+	QReadLocker _{&m_image_cache_lock};
+	return static_cast<size_t>(m_image_cache.totalCost()) + m_encoded.memoryUsage();
+}
+
+MemoryConsumer::Priority ImageCache::memoryPriority() const
+{
+	return Priority::Prefetch;
+}
+
+void ImageCache::setMemoryAllowance(size_t bytes)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+
+	QWriteLocker _{&m_image_cache_lock};
+	if(m_memory_allowance == bytes)
+		return;
+	m_memory_allowance = bytes;
+	updateMaxCost();
+}
+
+void ImageCache::readahead(const QStringList& files)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+	m_encoded.readahead(files);
+}
+
+void ImageCache::setEncodedBudget(size_t bytes)
+{
+	QWriteLocker _{&m_image_cache_lock};
+	m_encoded_budget = bytes;
+	updateMaxCost();
+}
+
+QByteArray ImageCache::encodedData(const QString& filename)
+{
+	return m_encoded.data(filename);
+}
+
+void ImageCache::setQueuePosition(const QStringList& files, int current, int direction)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+
+	// NOTE: small queues wrap around, the nearer side wins
+	std::unordered_map<QString, int> file_offsets;
+	file_offsets.reserve(static_cast<size_t>(files.size()));
+	for(int i = 0; i < files.size(); ++i) {
+		const int offset = i - current;
+		auto it = file_offsets.emplace(files[i], offset).first;
+		if(std::abs(offset) < std::abs(it->second))
+			it->second = offset;
+	}
+
+	// files without id are not cached yet, their entries are positioned when reserved
+	std::unordered_map<uint64_t, int> key_offsets;
+	key_offsets.reserve(file_offsets.size() * 5);
+	{
+		QReadLocker _{&m_file_id_cache_lock};
+		for(const auto& f : file_offsets) {
+			auto id_it = m_file_id_cache.find(f.first);
+			if(id_it == m_file_id_cache.end())
+				continue;
+			for(auto key : entry_keys(id_it->second))
+				key_offsets.emplace(key, f.second);
+		}
 	}
+
+	QWriteLocker _{&m_image_cache_lock};
+	m_queue_offsets = std::move(file_offsets);
+	m_image_cache.setPositions(std::move(key_offsets), direction);
+}
+
+/// Applies the smaller of user limit and memory governor allowance. Requires write lock.
+void ImageCache::updateMaxCost()
+{
+	// read ahead file contents may take up to a quarter of the allowance
+	m_encoded.setBudget(std::min(m_encoded_budget, m_memory_allowance / 4));
+
+	const size_t max_cost = std::min({m_memory_limit, m_memory_allowance,
+	                                  static_cast<size_t>(std::numeric_limits<int>::max())});
+	if(static_cast<int>(max_cost) != m_image_cache.maxCost()) {
+		pdbg << "cache capacity:" << max_cost / 1024 << "KiB";
+		m_image_cache.setMaxCost(static_cast<int>(max_cost));
+	}
+}
+
+void ImageCache::setCompactEntries(bool enabled)
+{
+	m_compact_entries.store(enabled, std::memory_order_relaxed);
 }
 
 void ImageCache::setMaxConcurrentTasks(int num)
@@ -115,17 +454,30 @@ void ImageCache::setMaxConcurrentTasks(int num)
 	}
 }
 
-void ImageCache::addFile(const QString& filename, QSize window_size, double device_pixel_ratio)
+void ImageCache::addFile(const QString& filename, QSize window_size, double device_pixel_ratio, int rotation)
 {
 	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
 		return;
 
-	auto task = std::make_unique<LoadResizeImageTask>(this, filename, window_size, device_pixel_ratio);
+	auto task = std::make_unique<LoadResizeImageTask>(this, filename, window_size, device_pixel_ratio, rotation);
 	if(m_thread_pool.tryStart(task.get())) {
 		(void)task.release();
+	} else {
+		m_counters.tasks_rejected.fetch_add(1, std::memory_order_relaxed);
 	}
 }
 
+void ImageCache::addFiles(const QStringList& files, QSize window_size, double device_pixel_ratio)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)) || files.isEmpty())
+		return;
+
+	// cancel previous batch, it is out of date
+	const auto generation = m_batch_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+	m_io_pool.clear();
+	m_io_pool.start(new BatchLoadTask(this, files, window_size, device_pixel_ratio, generation));
+}
+
 void ImageCache::invalidate(const QString &filename)
 {
 	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
@@ -137,7 +489,7 @@ void ImageCache::invalidate(const QString &filename)
 	}
 }
 
-ImageCache::QueryResult ImageCache::getImage(const QString& filename, QSize window_size, uint64_t unique_id) const
+ImageCache::QueryResult ImageCache::getImage(const QString& filename, QSize window_size, uint64_t unique_id, int rotation) const
 {
 	QueryResult res;
 	res.result = State::Invalid;
@@ -158,7 +510,7 @@ ImageCache::QueryResult ImageCache::getImage(const QString& filename, QSize wind
 			 * Hopefully OS does a better job caching file metadata
 			 * than me :/
 			 */
-			res.unique_id = get_image_identifier(filename, window_size);
+			res.unique_id = util::get_file_identifier(filename);
 		}
 		unique_id = res.unique_id;
 	} else {
@@ -169,76 +521,385 @@ ImageCache::QueryResult ImageCache::getImage(const QString& filename, QSize wind
 		return res;
 	}
 
+	const auto key = variant_key(unique_id, rotation);
 	QReadLocker _{&m_image_cache_lock};
-	auto entry = m_image_cache.object(unique_id);
+	auto entry = m_image_cache.object(key);
 	if(entry) {
 		// only query cache if we know image was loaded at some point
-		if(entry->state == State::Ready) {
-			if(entry->image.isNull()) {
+		if(entry->state == State::Ready && entry->animation) {
+			if(entry->covers(window_size)) {
+				res.animation = entry->animation;
+				res.original_size = entry->original_size;
+				res.result = State::Ready;
+				if(!entry->used.exchange(true, std::memory_order_relaxed))
+					m_counters.prefetch_used.fetch_add(1, std::memory_order_relaxed);
+			} else {
+				pdbg << "cached frames too small for" << window_size << filename;
+			}
+		} else if(entry->state == State::Ready) {
+			if(entry->levels.empty()) {
 				pdbg << "state is ready but image is null";
 				entry->state = State::Invalid;
 			} else {
-				res.original_size = entry->original_size;
-				res.image = entry->image;
-				res.result = State::Ready;
+				res.image = entry->levelFor(window_size);
+				if(!res.image.isNull()) {
+					res.original_size = entry->original_size;
+					res.result = State::Ready;
+					if(!entry->used.exchange(true, std::memory_order_relaxed))
+						m_counters.prefetch_used.fetch_add(1, std::memory_order_relaxed);
+				} else {
+					pdbg << "cached levels too small for" << window_size << filename;
+				}
 			}
 		} else {
 			res.result = entry->state;
 		}
-	} else {
+	} else if(m_loaded_ids.count(key)) {
 		pdbg << "evicted miss" << filename;
+		m_counters.eviction_misses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// NOTE: loading state is polled repeatedly, count only the final outcome
+	if(res.result == State::Ready) {
+		m_counters.hits.fetch_add(1, std::memory_order_relaxed);
+	} else if(res.result == State::Invalid) {
+		m_counters.misses.fetch_add(1, std::memory_order_relaxed);
 	}
 	return res;
 }
 
-void ImageCache::addFileThreadFunc(const QString& filename, QSize window_size, double device_pixel_ratio)
+QImage ImageCache::cachedImage(const QString& filename, QSize min_size) const
 {
-	auto image_id = getUniqueImageID(filename, window_size);
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return QImage();
 
-	{	// check if other thread began to load image before locking for write
-		QReadLocker _{&m_image_cache_lock};
-		if(m_image_cache.contains(image_id))
-			return;
+	uint64_t unique_id;
+	{
+		QReadLocker _{&m_file_id_cache_lock};
+		auto id_it = m_file_id_cache.find(filename);
+		if(id_it == m_file_id_cache.end())
+			return QImage();
+		unique_id = id_it->second;
 	}
 
+	QReadLocker _{&m_image_cache_lock};
+	auto entry = m_image_cache.object(variant_key(unique_id, 0));
+	if(!entry || entry->state != State::Ready || entry->levels.empty())
+		return QImage();
+
+	auto it = std::find_if(entry->levels.rbegin(), entry->levels.rend(), [min_size](const QImage& level)
 	{
-		if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
-			return;
+		return level.width() >= min_size.width() && level.height() >= min_size.height();
+	});
+	return it != entry->levels.rend() ? *it : entry->levels.front();
+}
 
-		// reserve entry in cache for this image to indicate that this thread is already loading it
-		auto entry = std::make_unique<Entry>(QImage{}, QSize{}, State::Loading);
+QImage ImageCache::reducedImage(const ImageCache* cache, const QString& filename, QSize min_size, QSize decode_size)
+{
+	// NOTE: images shown recently are still in cache, already decoded at reduced size
+	QImage image;
+	if(cache)
+		image = cache->cachedImage(filename, min_size);
+	if(image.isNull())
+		image = DecoderRegistry::instance().decodeFile(filename, decode_size);
+	return image;
+}
+
+ImageCache::QueryResult ImageCache::getFrame(const QString& filename, QSize viewport, bool upscale) const
+{
+	QueryResult res;
+	res.result = State::Invalid;
+	res.unique_id = 0u;
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return res;
+
+	{
+		// NOTE: frames are only prepared for files that have an id already
+		QReadLocker _{&m_file_id_cache_lock};
+		auto id_it = m_file_id_cache.find(filename);
+		if(id_it == m_file_id_cache.end())
+			return res;
+		res.unique_id = id_it->second;
+	}
+
+	QReadLocker _{&m_image_cache_lock};
+	auto entry = m_image_cache.object(frame_key(res.unique_id));
+	if(!entry || entry->state != State::Ready || entry->levels.empty()
+	   || entry->levels.front().size() != frame_size(entry->original_size, viewport, upscale))
+		return res;
+
+	res.image = entry->levels.front();
+	res.original_size = entry->original_size;
+	res.result = State::Ready;
+	m_counters.hits.fetch_add(1, std::memory_order_relaxed);
+	if(!entry->used.exchange(true, std::memory_order_relaxed))
+		m_counters.prefetch_used.fetch_add(1, std::memory_order_relaxed);
+	return res;
+}
+
+bool ImageCache::prepareFrame(const QString& filename, QSize viewport, double device_pixel_ratio, bool upscale)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)) || viewport.isEmpty())
+		return false;
+
+	const auto unique_id = getUniqueImageID(filename);
+	if(unique_id == 0)
+		return false;
 
+	QImage source;
+	QSize original_size;
+	{
+		QReadLocker _{&m_image_cache_lock};
+		auto frame = m_image_cache.object(frame_key(unique_id));
+		if(frame && frame->state == State::Ready && !frame->levels.empty()
+		   && frame->levels.front().size() == frame_size(frame->original_size, viewport, upscale))
+			return true;
+
+		// scale cached level instead of decoding the file again, if it is large enough
+		auto base = m_image_cache.object(unique_id);
+		if(base && base->state == State::Ready && !base->animation && !base->levels.empty()) {
+			const auto& largest = base->levels.front();
+			const auto target = frame_size(base->original_size, viewport, upscale);
+			if(largest.size() == base->original_size
+			   || (largest.width() + 1 >= target.width() && largest.height() + 1 >= target.height())) {
+				source = largest;
+				original_size = base->original_size;
+			}
+		}
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	qint64 decode_ns = 0;
+	ImageFormat format = ImageFormat::Unknown;
+	if(source.isNull()) {
+		QByteArray bytes = m_encoded.data(filename);
+		if(bytes.isEmpty()) {
+			QFile file(filename);
+			if(!file.open(QIODevice::ReadOnly))
+				return false;
+			bytes = file.readAll();
+		}
+
+		// NOTE: animations are played from their own cache entries
+		format = util::detect_image_format(bytes.left(util::image_magic_size));
+		if(format == ImageFormat::Gif || format == ImageFormat::Webp) {
+			QBuffer buffer(&bytes);
+			buffer.open(QIODevice::ReadOnly);
+			QImageReader reader(&buffer, util::image_format_name(format));
+			if(reader.supportsAnimation() && reader.imageCount() > 1)
+				return false;
+		}
+
+		source = DecoderRegistry::instance().decode(bytes, viewport, &original_size);
+		if(source.isNull())
+			return false;
+		decode_ns = timer.nsecsElapsed();
+		timer.restart();
+	}
+
+	const QSize size = frame_size(original_size, viewport, upscale);
+	QImage frame = display_format(source.size() == size ? std::move(source) : util::resample::scaled(source, size));
+	if(frame.isNull())
+		return false;
+	frame.setDevicePixelRatio(device_pixel_ratio);
+	if(decode_ns)
+		recordLoadTimes(util::image_format_name(format), decode_ns, timer.nsecsElapsed());
+
+	pdbg << "prepared frame of" << filename.mid(filename.lastIndexOf('/')+1) << "/" << unique_id << "of" << size;
+
+	{
 		QWriteLocker _{&m_image_cache_lock};
-		if(m_image_cache.contains(image_id)) // recheck
-			return;
+		positionEntry(frame_key(unique_id), filename);
+	}
+	std::vector<QImage> levels;
+	levels.push_back(std::move(frame));
+	insertResizedImage(frame_key(unique_id), std::move(levels), original_size);
+	return true;
+}
 
-		if(m_image_cache.insert(image_id, entry.get())) {
-			(void)entry.release();
-		} else {
-			pdbg << "failed to insert empty entry into cache:" << filename;
+void ImageCache::addFileThreadFunc(const QString& filename, QSize window_size, double device_pixel_ratio, int rotation)
+{
+	const auto file_id = getUniqueImageID(filename);
+	if(file_id == 0)
+		return;
+
+	rotation = rotation_steps(rotation);
+	const auto image_id = variant_key(file_id, rotation);
+	if(!reserveEntry(image_id, window_size, filename))
+		return;
+
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+
+	if(rotation && rotateCachedImage(file_id, image_id, window_size, rotation))
+		return;
+
+	loadResizeThreadFunc(filename, image_id, window_size, device_pixel_ratio, rotation, QByteArray());
+}
+
+void ImageCache::batchLoadThreadFunc(const QStringList& files, QSize window_size, double device_pixel_ratio,
+                                     uint64_t generation)
+{
+	const auto cancelled = [this, generation]() {
+		return m_shutting_down.load(std::memory_order_acquire)
+		    || m_batch_generation.load(std::memory_order_acquire) != generation;
+	};
+	auto start_task = [&](const QString& filename, uint64_t image_id, QByteArray&& encoded) {
+		auto task = std::make_unique<LoadResizeImageTask>(this, filename, window_size, device_pixel_ratio, 0);
+		task->image_id = image_id;
+		task->encoded  = std::move(encoded);
+		m_thread_pool.start(task.release());
+	};
+
+	QStringList to_read;
+	std::vector<uint64_t> to_read_ids;
+	for(const auto& filename : files) {
+		if(cancelled())
+			break;
+
+		const auto image_id = getUniqueImageID(filename);
+		if(image_id == 0 || !reserveEntry(image_id, window_size, filename))
+			continue;
+
+		auto encoded = m_encoded.data(filename);
+		if(!encoded.isEmpty()) {
+			start_task(filename, image_id, std::move(encoded));
+			continue;
+		}
+		to_read.push_back(filename);
+		to_read_ids.push_back(image_id);
+	}
+
+	std::vector<bool> started(to_read_ids.size(), false);
+	m_batch_reader.read(to_read, batch_max_file_size, [&](int index, QByteArray&& data) {
+		// NOTE: files of a stale batch would delay loading the files of the new one
+		const auto i = static_cast<size_t>(index);
+		if(cancelled())
 			return;
+		start_task(to_read[index], to_read_ids[i], std::move(data));
+		started[i] = true;
+
+		// keep read buffers from piling up in front of busy decoders
+		while(m_counters.tasks_in_flight.load(std::memory_order_relaxed) > 2 * m_thread_pool.maxThreadCount()
+		      && !cancelled())
+		{
+			QThread::msleep(5);
 		}
+	}, cancelled);
+
+	// NOTE: reserved entries would be polled by display until they time out
+	for(size_t i = 0; i < started.size(); ++i) {
+		if(!started[i])
+			releaseEntry(to_read_ids[i]);
 	}
+}
 
+/// Reserves cache entry \p image_id for loading. Returns false if the image is already loaded or being loaded.
+bool ImageCache::reserveEntry(uint64_t image_id, QSize window_size, const QString& filename)
+{
 	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return false;
+
+	QWriteLocker _{&m_image_cache_lock};
+	positionEntry(image_id, filename);
+	auto existing = m_image_cache.object(image_id);
+	if(existing) { // check if other thread began to load image
+		if(existing->state != State::Ready || existing->reloading || existing->covers(window_size))
+			return false;
+
+		// keep serving smaller levels while the larger one is being loaded
+		existing->reloading = true;
+	} else {
+		// reserve entry in cache for this image to indicate that this thread is already loading it
+		auto entry = std::make_unique<Entry>(std::vector<QImage>{}, QSize{}, State::Loading, &m_counters);
+		if(!m_image_cache.insert(image_id, entry.release())) {
+			pdbg << "not caching" << filename << "- cache is full of images nearer to current one";
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Releases entry \p image_id reserved by \ref reserveEntry() that is not going to be loaded.
+void ImageCache::releaseEntry(uint64_t image_id)
+{
+	QWriteLocker _{&m_image_cache_lock};
+	auto entry = m_image_cache.object(image_id);
+	if(!entry)
 		return;
+	if(entry->state == State::Loading) {
+		m_image_cache.remove(image_id);
+	} else {
+		entry->reloading = false; // keep serving smaller levels
+	}
+}
+
+/// Sets queue position of entry \p key of \p filename, if it is known. Requires write lock.
+void ImageCache::positionEntry(uint64_t key, const QString& filename)
+{
+	const auto it = m_queue_offsets.find(filename);
+	if(it != m_queue_offsets.end())
+		m_image_cache.setPosition(key, it->second);
+}
+
+void ImageCache::loadResizeThreadFunc(const QString& filename, uint64_t image_id, QSize window_size,
+                                      double device_pixel_ratio, int rotation, const QByteArray& data)
+{
+	QElapsedTimer timer;
+	timer.start();
 
+	// file contents may have been read ahead from slow storage or by batched prefetch
 	QFile file(filename);
-	if(!file.open(QIODevice::ReadOnly)) {
+	QBuffer buffer;
+	QIODevice* device = &file;
+	const auto encoded = data.isEmpty() ? m_encoded.data(filename) : data;
+	if(!encoded.isEmpty()) {
+		buffer.setData(encoded);
+		device = &buffer;
+	}
+	if(!device->open(QIODevice::ReadOnly)) {
 		setFileInvalid(image_id);
 		return;
 	}
 
-	auto format = util::guess_image_format(filename);
+	// detect format by contents, extensions may be wrong
+	auto format = util::image_format_name(util::detect_image_format(device->peek(util::image_magic_size)));
+	if(format.isEmpty())
+		format = util::guess_image_format(filename);
 
-	QImageReader reader(&file, format);
-	if(!reader.canRead() || reader.supportsAnimation()) { // NOTE: to prevent caching of animated images
+	QImageReader reader(device, format);
+	if(!reader.canRead()) {
 		setFileInvalid(image_id);
 		return;
 	}
 
-	auto image = reader.read();
-	file.close();
+	if(reader.supportsAnimation() && reader.imageCount() > 1) {
+		if(rotation) { // NOTE: rotation is not supported for animations
+			setFileInvalid(image_id);
+			return;
+		}
+		loadAnimation(image_id, *device, filename, reader.format(), window_size, device_pixel_ratio);
+		return;
+	}
+
+	const QSize rotated_window = (rotation % 2) ? window_size.transposed() : window_size;
+	QSize full_size;
+	QImage image;
+	if(encoded.isEmpty() && file.size() > batch_max_file_size) {
+		// large files are decoded while being read, so they are never buffered whole
+		reader.setAutoTransform(true);
+		image = util::read_scaled(reader, rotated_window * device_pixel_ratio, &full_size);
+	} else {
+		// decode with the fastest decoder for the format, which may decode at reduced size
+		QByteArray bytes = encoded;
+		if(bytes.isEmpty() && device->seek(0))
+			bytes = device->readAll();
+		image = DecoderRegistry::instance().decode(bytes, rotated_window * device_pixel_ratio, &full_size);
+	}
+	device->close();
+	const auto decode_ns = timer.nsecsElapsed();
+	timer.restart();
 
 	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
 		return;
@@ -248,75 +909,299 @@ void ImageCache::addFileThreadFunc(const QString& filename, QSize window_size, d
 		return;
 	}
 
-	QSize original_size = image.size();
-	window_size *= device_pixel_ratio;
-	float ratio = std::min(window_size.width() / static_cast<float>(image.width()),
-	                       window_size.height() / static_cast<float>(image.height()));
-
-	QSize new_size(image.width() * ratio, image.height() * ratio);
+	// resize first, rotating the smaller image is cheaper
+	const QSize decoded_size = image.size();
+	const QSize new_size = fit_size(decoded_size, rotated_window * device_pixel_ratio);
+	const QSize original_size = (rotation % 2) ? full_size.transposed() : full_size;
 
 	QImage resimage;
-	if(ratio < 1.0f) {
-		resimage = image.scaled(new_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	if(new_size != decoded_size) {
+		// single-threaded, thread pool already runs a task per core
+		resimage = util::resample::scaled(image, new_size, 1);
 	} else {
-		resimage = image;
+		resimage = std::move(image);
+	}
+	if(resimage.isNull()) {
+		setFileInvalid(image_id);
+		return;
 	}
 	resimage.setDevicePixelRatio(device_pixel_ratio);
-	pdbg << "loaded" << (ratio < 1.0f ? "and resized" : "")
-	     << "image for" << filename.mid(filename.lastIndexOf('/')+1) << "/" << image_id << "of" << new_size;
+	if(rotation)
+		resimage = rotated(resimage, rotation);
+	auto levels = make_levels(std::move(resimage));
+	if(m_compact_entries.load(std::memory_order_relaxed))
+		compact_levels(levels);
+	recordLoadTimes(reader.format(), decode_ns, timer.nsecsElapsed());
+
+	pdbg << "loaded" << (new_size != decoded_size ? "and resized" : "") << (rotation ? "and rotated" : "")
+	     << "image for" << filename.mid(filename.lastIndexOf('/')+1) << "/" << image_id << "of" << new_size
+	     << "with" << levels.size() << "levels";
 
-	insertResizedImage(image_id, std::move(resimage), original_size);
+	insertResizedImage(image_id, std::move(levels), original_size);
 }
 
-void ImageCache::insertResizedImage(uint64_t unique_id, QImage&& image, QSize original_size)
+/* Produces rotated variant from cached levels of unrotated image. */
+bool ImageCache::rotateCachedImage(uint64_t unique_id, uint64_t key, QSize window_size, int rotation)
 {
-	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+	std::vector<QImage> levels;
+	QSize original_size;
+	{
+		QWriteLocker _{&m_image_cache_lock};
+		auto base = m_image_cache.object(unique_id);
+		// rotated image fits into window if the unrotated one fits into transposed window
+		const QSize base_window = (rotation % 2) ? window_size.transposed() : window_size;
+		if(!base || base->state != State::Ready || base->animation || !base->covers(base_window))
+			return false;
+		levels = base->levels; // NOTE: shallow copies
+		original_size = base->original_size;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	for(auto& level : levels)
+		level = rotated(level, rotation);
+	if(rotation % 2)
+		original_size.transpose();
+
+	pdbg << "rotated cached image" << unique_id << "by" << rotation * 90 << "degrees in" << timer.elapsed() << "ms";
+	insertResizedImage(key, std::move(levels), original_size);
+	return true;
+}
+
+void ImageCache::loadAnimation(uint64_t unique_id, QIODevice& device, const QString& filename, const QByteArray& format,
+                               QSize window_size, double dpr)
+{
+	QElapsedTimer timer;
+	timer.start();
+	qint64 scale_ns = 0;
+
+	auto animation = std::make_shared<Animation>();
+	animation->format = format;
+	if(!device.seek(0)) {
+		setFileInvalid(unique_id);
 		return;
+	}
+	animation->encoded = device.readAll();
+	device.close();
 
-#if (QT_VERSION < QT_VERSION_CHECK(5, 10, 0)) // NOTE: deprecated since Qt 5.10
-	int cost = image.byteCount();
-#else
-	auto size = image.sizeInBytes();
-	int cost = std::min(size, static_cast<decltype(size)>(std::numeric_limits<int>::max()));
-#endif
-	bool need_realloc = false;
-	std::unique_ptr<Entry> entry;
+	QBuffer buffer(&animation->encoded);
+	buffer.open(QIODevice::ReadOnly);
+	QImageReader reader(&buffer, format);
+	animation->loop_count = reader.loopCount();
 
-	if (cost > m_image_cache.maxCost()) {
-		pwarn << "Image size exceeds cache capacity, skipping...";
+	size_t frames_cap = 0;
+	{
+		QReadLocker _{&m_image_cache_lock};
+		frames_cap = static_cast<size_t>(m_image_cache.maxCost()) / 2;
+	}
+
+	QSize original_size;
+	size_t frames_bytes = 0;
+	const int frame_count = reader.imageCount();
+	for(int i = 0; i < frame_count; ++i) {
+		if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+			return;
+
+		auto frame = reader.read();
+		if(frame.isNull())
+			break;
+
+		const int delay = reader.nextImageDelay();
+		if(original_size.isEmpty())
+			original_size = frame.size();
+
+		QElapsedTimer scale_timer;
+		scale_timer.start();
+		const auto new_size = fit_size(frame.size(), window_size * dpr);
+		if(new_size != frame.size())
+			frame = util::resample::scaled(frame, new_size, 1);
+		frame.setDevicePixelRatio(dpr);
+		scale_ns += scale_timer.nsecsElapsed();
+
+		frames_bytes += static_cast<size_t>(image_bytes(frame));
+		if(frames_bytes > frames_cap) {
+			pdbg << "animation frames do not fit into" << frames_cap / 1024 << "KiB, keeping encoded data only";
+			animation->frames.clear();
+			animation->delays.clear();
+			break;
+		}
+		animation->frames.push_back(std::move(frame));
+		animation->delays.push_back(delay);
+	}
+
+	if(original_size.isEmpty()) {
+		setFileInvalid(unique_id);
 		return;
 	}
+	recordLoadTimes(format, timer.nsecsElapsed() - scale_ns, scale_ns);
 
-	{ // fast path
-		QWriteLocker _{&m_image_cache_lock};
-		entry.reset(m_image_cache.take(unique_id));
-		if(entry) {
-			entry->image = std::move(image);
-			entry->original_size = original_size;
-			entry->state = State::Ready;
-			if(m_image_cache.insert(unique_id, entry.get(), cost)) {
-				(void)entry.release();
-			}
+	pdbg << "loaded animation" << filename.mid(filename.lastIndexOf('/')+1) << "/" << unique_id
+	     << "with" << animation->frames.size() << "of" << frame_count << "frames";
+
+	insertResizedImage(unique_id, std::vector<QImage>{}, original_size, std::move(animation));
+}
+
+void ImageCache::insertResizedImage(uint64_t unique_id, std::vector<QImage>&& levels, QSize original_size,
+                                    AnimationPtr animation)
+{
+	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
+		return;
+
+	qint64 total_size = animation ? static_cast<qint64>(animation->bytes()) : 0;
+	for(const auto& level : levels) {
+		total_size += image_bytes(level);
+	}
+	int cost = static_cast<int>(std::min(total_size, static_cast<qint64>(std::numeric_limits<int>::max())));
+
+	QWriteLocker _{&m_image_cache_lock};
+	if (cost > m_image_cache.maxCost()) {
+		pwarn << "Image size exceeds cache capacity, skipping...";
+		// NOTE: capacity may grow back later, so do not mark the file invalid
+		auto existing = m_image_cache.object(unique_id);
+		if(existing && existing->state == State::Ready) {
+			existing->reloading = false; // keep serving smaller levels
 		} else {
-			need_realloc = true;
+			m_image_cache.remove(unique_id);
 		}
+		return;
 	}
 
-	if(need_realloc) { // slow path
-		if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
-			return;
+	std::unique_ptr<Entry> entry{m_image_cache.take(unique_id)};
+	if(entry) { // fast path
+		entry->levels = std::move(levels);
+		entry->animation = std::move(animation);
+		entry->original_size = original_size;
+		entry->state = State::Ready;
+		entry->reloading = false;
+	} else { // slow path
 		pdbg << "realloc required, slow path";
-		entry = std::make_unique<Entry>(std::move(image), original_size, State::Ready);
-		Q_ASSERT(entry);
-		QWriteLocker _{&m_image_cache_lock};
-		if(m_image_cache.insert(unique_id,entry.get(),cost)) {
-			(void)entry.release();
+		entry = std::make_unique<Entry>(std::move(levels), original_size, State::Ready, &m_counters);
+		entry->animation = std::move(animation);
+	}
+	// NOTE: cache takes ownership even if insertion fails
+	if(!m_image_cache.insert(unique_id, entry.release(), cost)) {
+		pdbg << "not caching" << unique_id << "- cache is full of images nearer to current one";
+		return;
+	}
+	if(m_loaded_ids.insert(unique_id).second) {
+		m_loaded_order.push_back(unique_id);
+		if(m_loaded_order.size() > max_loaded_ids) {
+			m_loaded_ids.erase(m_loaded_order.front());
+			m_loaded_order.pop_front();
 		}
 	}
 }
 
+/// Histogram bucket for duration of \p ns nanoseconds.
+static size_t histogram_bucket(qint64 ns, size_t bucket_count)
+{
+	const double ms = ns / 1e6;
+	if(ms < 1.0)
+		return 0;
+	return std::min(static_cast<size_t>(std::log2(ms)) + 1, bucket_count - 1);
+}
 
-uint64_t ImageCache::getUniqueImageID(const QString& filename, QSize size)
+void ImageCache::recordLoadTimes(const QByteArray& format, qint64 decode_ns, qint64 scale_ns)
+{
+	QMutexLocker _{&m_format_stats_lock};
+	auto it = std::find_if(m_format_stats.begin(), m_format_stats.end(), [&format](const auto& s)
+	{
+		return s.format == format;
+	});
+	if(it == m_format_stats.end()) {
+		m_format_stats.emplace_back();
+		it = std::prev(m_format_stats.end());
+		it->format = format;
+	}
+	++it->decoded;
+	++it->decode_time[histogram_bucket(decode_ns, it->decode_time.size())];
+	++it->scale_time[histogram_bucket(scale_ns, it->scale_time.size())];
+}
+
+ImageCache::Statistics ImageCache::statistics() const
+{
+	Statistics s;
+	s.hits            = m_counters.hits.load(std::memory_order_relaxed);
+	s.misses          = m_counters.misses.load(std::memory_order_relaxed);
+	s.eviction_misses = m_counters.eviction_misses.load(std::memory_order_relaxed);
+	s.prefetch_used   = m_counters.prefetch_used.load(std::memory_order_relaxed);
+	s.prefetch_wasted = m_counters.prefetch_wasted.load(std::memory_order_relaxed);
+	s.tasks_rejected  = m_counters.tasks_rejected.load(std::memory_order_relaxed);
+	s.queue_depth     = m_counters.tasks_in_flight.load(std::memory_order_relaxed);
+	s.max_tasks       = m_thread_pool.maxThreadCount();
+	{
+		QReadLocker _{&m_image_cache_lock};
+		s.bytes    = static_cast<size_t>(m_image_cache.totalCost());
+		s.capacity = static_cast<size_t>(m_image_cache.maxCost());
+		s.entries  = m_image_cache.count();
+	}
+	s.encoded_bytes = m_encoded.memoryUsage();
+	{
+		QMutexLocker _{&m_format_stats_lock};
+		s.formats = m_format_stats;
+	}
+	return s;
+}
+
+double ImageCache::Statistics::percentile(const Histogram& histogram, double fraction)
+{
+	uint64_t total = 0;
+	for(auto n : histogram)
+		total += n;
+	if(total == 0)
+		return 0.0;
+
+	const double target = fraction * total;
+	uint64_t sum = 0;
+	for(size_t i = 0; i < histogram.size(); ++i) {
+		sum += histogram[i];
+		if(sum >= target)
+			return std::ldexp(1.0, static_cast<int>(i));
+	}
+	return std::ldexp(1.0, static_cast<int>(histogram.size() - 1));
+}
+
+/// Histogram as JSON array of bucket counts.
+static QJsonArray histogram_to_json(const ImageCache::Histogram& histogram)
+{
+	QJsonArray arr;
+	for(auto n : histogram)
+		arr.append(static_cast<qint64>(n));
+	return arr;
+}
+
+QJsonObject ImageCache::Statistics::toJson() const
+{
+	QJsonArray formats_arr;
+	for(const auto& f : formats) {
+		formats_arr.append(QJsonObject{
+			{QStringLiteral("format"),         QString::fromLatin1(f.format)},
+			{QStringLiteral("decoded"),        static_cast<qint64>(f.decoded)},
+			{QStringLiteral("decode_time_ms"), histogram_to_json(f.decode_time)},
+			{QStringLiteral("scale_time_ms"),  histogram_to_json(f.scale_time)},
+		});
+	}
+
+	return QJsonObject{
+		{QStringLiteral("hits"),            static_cast<qint64>(hits)},
+		{QStringLiteral("misses"),          static_cast<qint64>(misses)},
+		{QStringLiteral("eviction_misses"), static_cast<qint64>(eviction_misses)},
+		{QStringLiteral("prefetch_used"),   static_cast<qint64>(prefetch_used)},
+		{QStringLiteral("prefetch_wasted"), static_cast<qint64>(prefetch_wasted)},
+		{QStringLiteral("tasks_rejected"),  static_cast<qint64>(tasks_rejected)},
+		{QStringLiteral("bytes"),           static_cast<qint64>(bytes)},
+		{QStringLiteral("capacity"),        static_cast<qint64>(capacity)},
+		{QStringLiteral("encoded_bytes"),   static_cast<qint64>(encoded_bytes)},
+		{QStringLiteral("entries"),         entries},
+		{QStringLiteral("queue_depth"),     queue_depth},
+		{QStringLiteral("max_tasks"),       max_tasks},
+		{QStringLiteral("histogram_buckets_ms"), QStringLiteral("<1, <2, <4, ... <2^(n-1), rest")},
+		{QStringLiteral("formats"),         formats_arr},
+	};
+}
+
+
+uint64_t ImageCache::getUniqueImageID(const QString& filename)
 {
 	uint64_t image_id = 0;
 	{ // look for file id in cache first
@@ -329,7 +1214,7 @@ uint64_t ImageCache::getUniqueImageID(const QString& filename, QSize size)
 
 	// could not find id in cache, have to query the filesystem
 	if(image_id == 0) {
-		image_id = get_image_identifier(filename, size);
+		image_id = util::get_file_identifier(filename);
 		if(image_id) {
 			QWriteLocker _{&m_file_id_cache_lock};
 			m_file_id_cache.insert(std::make_pair(filename, image_id));
@@ -341,11 +1226,20 @@ uint64_t ImageCache::getUniqueImageID(const QString& filename, QSize size)
 void ImageCache::setFileInvalid(uint64_t unique_id)
 {
 	QWriteLocker _{&m_image_cache_lock};
+	auto existing = m_image_cache.object(unique_id);
+	if(existing && existing->state == State::Ready && existing->reloading) {
+		// larger version failed to load, keep serving the levels loaded before
+		existing->reloading = false;
+		return;
+	}
+
 	auto entry = m_image_cache.take(unique_id);
 	if(entry) {
 		entry->state = State::Invalid;
-		entry->image = QImage{};
+		entry->levels.clear();
+		entry->animation = nullptr;
 		entry->original_size = QSize{};
+		entry->reloading = false;
 		m_image_cache.insert(unique_id, entry);
 	}
 }
@@ -355,6 +1249,7 @@ void ImageCache::clear()
 	if(Q_UNLIKELY(m_shutting_down.load(std::memory_order_acquire)))
 		return;
 
+	m_io_pool.clear();
 	{
 		QWriteLocker _{&m_file_id_cache_lock};
 		m_file_id_cache.clear();
@@ -362,5 +1257,8 @@ void ImageCache::clear()
 	{
 		QWriteLocker _{&m_image_cache_lock};
 		m_image_cache.clear();
+		m_loaded_ids.clear();
+		m_loaded_order.clear();
+		m_encoded.clear();
 	}
 }
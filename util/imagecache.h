@@ -13,30 +13,64 @@
  * \brief Class \ref ImageCache
  */
 
-#include <QCache>
 #include <QImage>
+#include <QJsonObject>
+#include <QMutex>
 #include <QReadWriteLock>
 #include <QThreadPool>
+#include <array>
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include "util/batch_file_reader.h"
+#include "util/encoded_file_cache.h"
+#include "util/memory_governor.h"
+#include "util/queue_aware_cache.h"
 #include "util/unordered_map_qt.h"
 
+class QIODevice;
+
 /*!
  * \brief Threaded image prefetcher and resizer.
  *
  * Class \ref ImageCache provides multi-threaded image file preloading and resizing
  * to requested display size.
  *
+ * Each image is kept as a small pyramid of levels: the largest decoded size
+ * followed by its halvings. Entries are keyed by file identity only, so a
+ * different window size can be served from the nearest level without
+ * reading the file again.
+ *
+ * Images are decoded with EXIF orientation applied. Rotated variants of an
+ * image are cached under their own keys and are produced by rotating the
+ * already resized levels of the unrotated image when possible.
+ *
+ * Opaque images are stored as 24-bit RGB, or as 8-bit grayscale if they have
+ * no color, which keeps up to four times as many images in the same memory.
+ *
+ * Animated images are kept as encoded file data together with all frames
+ * decoded and fitted to window size, unless the frames exceed half of cache
+ * capacity.
+ *
  * After an image file has been added to cache, users can query if that file is
  * ready for use, or decide to wait until it is ready otherwise.
  *
+ * Cached images count as prefetched memory for \ref MemoryGovernor, so the
+ * effective cache capacity is the smaller of user limit and governor allowance.
+ *
+ * When capacity is exceeded, images furthest from current position in queue
+ * are evicted first, see \ref setQueuePosition().
+ *
  * Member functions of this class are thread-safe unless noted othewise.
  */
-class ImageCache
+class ImageCache : public MemoryConsumer
 {
 
 public:
 	ImageCache();
-	~ImageCache();
+	~ImageCache() override;
 
 	/// State of cache query
 	enum class State
@@ -46,12 +80,50 @@ public:
 		Ready,   ///< Image is ready for use.
 	};
 
+	/// Animated image loaded by cache.
+	struct Animation
+	{
+		/// Encoded file contents.
+		QByteArray          encoded;
+
+		/// Image format of \p encoded.
+		QByteArray          format;
+
+		/*!
+		 * \brief Decoded frames fitted to window size.
+		 *
+		 * Empty if frames did not fit into memory, \p encoded data
+		 * should be decoded during playback then.
+		 */
+		std::vector<QImage> frames;
+
+		/// Delay in ms after each of \p frames.
+		std::vector<int>    delays;
+
+		/// Number of times to repeat the animation, \c -1 to repeat forever.
+		int                 loop_count = -1;
+
+		/// Approximate memory used by animation in bytes.
+		size_t bytes() const;
+	};
+
+	/// Shared pointer to immutable \ref Animation.
+	using AnimationPtr = std::shared_ptr<const Animation>;
+
 	/// Results of cache query
 	struct QueryResult
 	{
-		/// Valid image if \p result is \a State::Ready, null image otherwise.
+		/*!
+		 * \brief Valid image if \p result is \a State::Ready, null image otherwise.
+		 *
+		 * This is the smallest pyramid level that is not smaller than
+		 * requested size, so it may need to be scaled down for display.
+		 */
 		QImage            image;
 
+		/// Animation data if the file is animated and \p result is \a State::Ready, \p image is null then.
+		AnimationPtr      animation;
+
 		/// Original size of image if \p result is \a State::Ready, invalid size otherwise.
 		QSize             original_size;
 
@@ -62,12 +134,91 @@ public:
 		ImageCache::State result;
 	};
 
+	/*!
+	 * \brief Histogram of durations with power of two buckets.
+	 *
+	 * Bucket \c 0 counts durations below 1 ms, bucket \c i counts
+	 * durations in range [2^(i-1), 2^i) ms, last bucket counts the rest.
+	 */
+	using Histogram = std::array<uint64_t, 14>;
+
+	/// Decoding statistics of single image format.
+	struct FormatStatistics
+	{
+		/// Image format as reported by QImageReader.
+		QByteArray format;
+
+		/// Number of decoded images.
+		uint64_t   decoded = 0;
+
+		/// Time spent reading and decoding image file.
+		Histogram  decode_time{};
+
+		/// Time spent resizing image and building its pyramid.
+		Histogram  scale_time{};
+	};
+
+	/// Snapshot of cache counters.
+	struct Statistics
+	{
+		/// Queries answered with an image.
+		uint64_t hits = 0;
+
+		/// Queries for files that were not cached, failed to load or were cached too small.
+		uint64_t misses = 0;
+
+		/// Part of \p misses for files that were cached before but got evicted, among the last 4096 loaded.
+		uint64_t eviction_misses = 0;
+
+		/// Loaded images that were used at least once.
+		uint64_t prefetch_used = 0;
+
+		/// Loaded images that were dropped without being used.
+		uint64_t prefetch_wasted = 0;
+
+		/// Load requests dropped because all threads were busy.
+		uint64_t tasks_rejected = 0;
+
+		/// Current size of cached images in bytes.
+		size_t   bytes = 0;
+
+		/// Current cache capacity in bytes.
+		size_t   capacity = 0;
+
+		/// Current size of file contents read ahead in bytes.
+		size_t   encoded_bytes = 0;
+
+		/// Current number of cache entries.
+		int      entries = 0;
+
+		/// Number of load tasks queued or running.
+		int      queue_depth = 0;
+
+		/// Maximum number of concurrent load tasks.
+		int      max_tasks = 0;
+
+		/// Decoding statistics, per image format.
+		std::vector<FormatStatistics> formats;
+
+		/// Upper bound in ms of bucket that contains \p fraction of all samples in \p histogram.
+		static double percentile(const Histogram& histogram, double fraction);
+
+		/// Counters as JSON object, histograms are stored as arrays of bucket counts.
+		QJsonObject toJson() const;
+	};
+
+	/// Number of files on each side of current one passed to \ref setQueuePosition().
+	static constexpr int queue_position_window = 64;
+
 	/// Clear cache.
 	void    clear();
 
 	/// Set maximum amount of memory in KiB for the whole image cache system.
 	void    setMemoryLimitKiB(size_t size_in_kb);
 
+	/// Store opaque images in compact pixel formats, enabled by default.
+	void    setCompactEntries(bool enabled);
+
 	/*!
 	 * \brief Set maximum number of concurrent image load tasks.
 	 *
@@ -80,20 +231,58 @@ public:
 	 * \param filename File to preload
 	 * \param window_size Used to determine the resulting size of image.
 	 * \param device_pixel_ratio Used to calculate image size with respect to Hi-DPI scaling.
+	 * \param rotation Image rotation in 90 degree increments clockwise.
 	 *
 	 * Schedules image load/resize task in a thread pool.
 	 *
-	 * \note You can safely issue multiple calls with same \p filename if
-	 * \p window_size remains unchanged for all calls.
+	 * \note You can safely issue multiple calls with same \p filename.
+	 * The file is reloaded only if the largest cached level is too small
+	 * for \p window_size.
+	 */
+	void    addFile(const QString& filename, QSize window_size, double device_pixel_ratio, int rotation = 0);
+
+	/*!
+	 * \brief Schedule \p files for preloading, reading them in a single batch.
+	 *
+	 * Reads of all files are kept in flight at once by \ref BatchFileReader,
+	 * each file is decoded as soon as it has been read. Unlike \ref addFile(),
+	 * no file is dropped when all threads are busy.
 	 *
-	 * \note Otherwise, the cache will be polluted with multiple versions of
-	 * the same image. Increasing the size generally requires complete reload
-	 * anyway (for image quality), so you should \ref clear() the cache on
-	 * any size change.
+	 * Cancels the batch of previous call, its files that were not read yet
+	 * are not loaded.
 	 */
-	void    addFile(const QString& filename, QSize window_size, double device_pixel_ratio);
+	void    addFiles(const QStringList& files, QSize window_size, double device_pixel_ratio);
 
 
+	/*!
+	 * \brief Read \p files ahead, most important first.
+	 *
+	 * Contents of files on network mounts are kept in memory, so that
+	 * decoding them later does not wait on the network.
+	 */
+	void    readahead(const QStringList& files);
+
+	/// Set maximum size of file contents read ahead in bytes.
+	void    setEncodedBudget(size_t bytes);
+
+	/// Contents of \p filename if it was read ahead, empty array otherwise.
+	QByteArray encodedData(const QString& filename);
+
+	/*!
+	 * \brief Set files around current one in queue, used to choose images to evict.
+	 * \param files Files in queue order, up to \ref queue_position_window on each side of current one.
+	 * \param current Index of current file in \p files.
+	 * \param direction Direction of navigation, \c +1 forward, \c -1 backward or \c 0 if unknown.
+	 *
+	 * Images are evicted by their distance from current file, files behind the
+	 * direction of navigation count as twice as far. Current file and its immediate
+	 * neighbours are kept over any other file, files not in \p files go first.
+	 * See \ref QueueAwareCache.
+	 *
+	 * \note Must be called from main thread only!
+	 */
+	void    setQueuePosition(const QStringList& files, int current, int direction);
+
 	/*!
 	 * \brief Invalidate cached data for file \p filename.
 	 * \param filename File to invalidate.
@@ -105,49 +294,174 @@ public:
 	 * \param filename Image file path.
 	 * \param window_size Expected image size.
 	 * \param unique_id If non-zero, used to avoid filename lookup as optimization.
+	 * \param rotation Image rotation in 90 degree increments clockwise.
+	 *
+	 * If cached levels are too small for \p window_size, the query result
+	 * is \a State::Invalid and the file should be loaded directly.
+	 */
+	QueryResult getImage(const QString& filename, QSize window_size, uint64_t unique_id = 0, int rotation = 0) const;
+
+	/*!
+	 * \brief Smallest cached level of \p filename at least \p min_size large.
+	 * \return Cached image, its largest level if all are smaller, or null image if it is not cached.
+	 *
+	 * Unlike \ref getImage(), does not count as cache query and does not touch the file.
+	 * Used by background jobs that only need a downscaled version of the image.
+	 *
+	 * \note Thread-safe.
+	 */
+	QImage  cachedImage(const QString& filename, QSize min_size) const;
+
+	/*!
+	 * \brief Downscaled version of \p filename for background jobs such as hashing.
+	 * \param cache Cache to look for level at least \p min_size large in first, may be null.
+	 * \param decode_size File is decoded at reduced size that still covers this size.
+	 * \return Cached level or decoded image, null image if file is not an image.
+	 *
+	 * \note Thread-safe.
+	 */
+	static QImage reducedImage(const ImageCache* cache, const QString& filename, QSize min_size, QSize decode_size);
+
+	/*!
+	 * \brief Decode \p filename and scale it to exactly the size it is displayed at.
+	 * \param viewport Size of display area in device pixels.
+	 * \param device_pixel_ratio Device pixel ratio set to the frame.
+	 * \param upscale Are images smaller than \p viewport scaled up to fit it.
+	 * \return False if the file could not be decoded or is animated.
+	 *
+	 * Frames are cached apart from pyramid levels, in the pixel format images
+	 * are painted in, so they are shown without any scaling or conversion,
+	 * see \ref getFrame(). Pyramid level already in cache is scaled instead of
+	 * decoding the file again if it is large enough.
+	 *
+	 * Blocks until the frame is ready, called from threads of \ref SlideshowScheduler.
+	 *
+	 * \note Thread-safe.
+	 */
+	bool    prepareFrame(const QString& filename, QSize viewport, double device_pixel_ratio, bool upscale);
+
+	/*!
+	 * \brief Frame of \p filename prepared by \ref prepareFrame() with the same \p viewport and \p upscale.
+	 *
+	 * Query result is \a State::Invalid if there is no such frame, the image is
+	 * exactly of display size otherwise.
 	 */
-	QueryResult getImage(const QString& filename, QSize window_size, uint64_t unique_id = 0) const;
+	QueryResult getFrame(const QString& filename, QSize viewport, bool upscale) const;
+
+	/// Total size of cached images and file contents in bytes.
+	size_t   memoryUsage() const override;
+
+	/// Cached images are always \a Priority::Prefetch.
+	Priority memoryPriority() const override;
+
+	/*!
+	 * \brief Limit cache capacity to \p bytes, evicting images furthest from current position in queue.
+	 *
+	 * \note Must be called from main thread only!
+	 */
+	void     setMemoryAllowance(size_t bytes) override;
+
+	/// Snapshot of cache counters collected since construction.
+	Statistics statistics() const;
 
 
 private:
 	friend struct LoadResizeImageTask;
+	friend struct BatchLoadTask;
 
-	void addFileThreadFunc(const QString & filename, QSize window_size, double dpr);
+	void addFileThreadFunc(const QString & filename, QSize window_size, double dpr, int rotation);
+	void batchLoadThreadFunc(const QStringList& files, QSize window_size, double dpr, uint64_t generation);
+	bool reserveEntry(uint64_t image_id, QSize window_size, const QString& filename);
+	void releaseEntry(uint64_t image_id);
+	void positionEntry(uint64_t key, const QString& filename);
+	void loadResizeThreadFunc(const QString& filename, uint64_t image_id, QSize window_size, double dpr,
+	                          int rotation, const QByteArray& data);
+	bool rotateCachedImage(uint64_t unique_id, uint64_t key, QSize window_size, int rotation);
 	void setFileInvalid(uint64_t unique_id);
-	void insertResizedImage(uint64_t unique_id, QImage&& image, QSize original_size);
+	void insertResizedImage(uint64_t unique_id, std::vector<QImage>&& levels, QSize original_size,
+	                        AnimationPtr animation = nullptr);
+	void loadAnimation(uint64_t unique_id, QIODevice& device, const QString& filename, const QByteArray& format,
+	                   QSize window_size, double dpr);
+
+	uint64_t getUniqueImageID(const QString& filename);
+	void updateMaxCost();
+	void recordLoadTimes(const QByteArray& format, qint64 decode_ns, qint64 scale_ns);
 
-	uint64_t getUniqueImageID(const QString& filename, QSize size);
+	/// Cache counters updated concurrently.
+	struct Counters
+	{
+		std::atomic<uint64_t> hits{0};
+		std::atomic<uint64_t> misses{0};
+		std::atomic<uint64_t> eviction_misses{0};
+		std::atomic<uint64_t> prefetch_used{0};
+		std::atomic<uint64_t> prefetch_wasted{0};
+		std::atomic<uint64_t> tasks_rejected{0};
+		std::atomic<int>      tasks_in_flight{0};
+	};
 
 	/// Cache entry.
 	struct Entry
 	{
-		Entry(QImage&& img, QSize size, State st) : image(std::move(img)), original_size(size), state(st) { }
+		Entry(std::vector<QImage>&& lvls, QSize size, State st, Counters* c) :
+		        levels(std::move(lvls)), original_size(size), state(st), counters(c) { }
+
+		/// Counts the entry as wasted prefetch if it was never used.
+		~Entry();
 
-		// disable copy
+		// disable copy and move
 		Entry(const Entry&) = delete;
 		Entry& operator=(const Entry&) = delete;
 
-		// default move
-		Entry(Entry&&) noexcept = default;
-		Entry& operator=(Entry&&) noexcept = default;
+		/// Does the largest level or animation frame have enough pixels for \p window_size.
+		bool covers(QSize window_size) const;
 
-		/// Resized image.
-		QImage image;
+		/// Smallest level not smaller than \p window_size, or null image.
+		QImage levelFor(QSize window_size) const;
+
+		/// Resized image pyramid, largest level first.
+		std::vector<QImage> levels;
+
+		/// Animation data, \p levels are empty if set.
+		AnimationPtr animation;
 		/// Original image size
 		QSize  original_size;
 
 		/// Cache entry state.
 		State  state;
+
+		/// Larger version of the image is currently being loaded by some thread.
+		bool   reloading = false;
+
+		/// Image was returned by query at least once.
+		std::atomic_bool used{false};
+
+		/// Counters of owning cache.
+		Counters* counters;
 	};
 
 	using FilenameIdCache = std::unordered_map<QString, uint64_t>;
 
+	mutable Counters       m_counters; // NOTE: must outlive m_image_cache
+	mutable QMutex         m_format_stats_lock;
+	std::vector<FormatStatistics> m_format_stats;
+	std::unordered_set<uint64_t>  m_loaded_ids;   ///< Recently loaded entries, to tell eviction misses.
+	std::deque<uint64_t>          m_loaded_order; ///< Of \p m_loaded_ids, oldest first.
+
 	QThreadPool            m_thread_pool;
+	QThreadPool            m_io_pool;
+	BatchFileReader        m_batch_reader;
 	FilenameIdCache        m_file_id_cache;
-	QCache<uint64_t,Entry> m_image_cache;
+	QueueAwareCache<uint64_t,Entry> m_image_cache;
+	std::unordered_map<QString,int> m_queue_offsets; ///< Guarded by \p m_image_cache_lock.
 	mutable QReadWriteLock m_file_id_cache_lock;
 	mutable QReadWriteLock m_image_cache_lock;
+	size_t                 m_memory_limit;
+	size_t                 m_memory_allowance;
+	size_t                 m_encoded_budget;
+	mutable EncodedFileCache m_encoded;
+	std::atomic_bool       m_compact_entries{true};
 	std::atomic_bool       m_shutting_down;
+	std::atomic<uint64_t>  m_batch_generation{0};
 };
 
 #endif // IMAGECACHE_H
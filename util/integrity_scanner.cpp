@@ -0,0 +1,655 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "integrity_scanner.h"
+#include "util/image_decoder.h"
+#include "util/misc.h"
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace logging_category {
+	Q_LOGGING_CATEGORY(integrity, "IntegrityScanner")
+}
+#define pdbg qCDebug(logging_category::integrity)
+#define pwarn qCWarning(logging_category::integrity)
+
+constexpr qint64 IntegrityScanner::default_bytes_per_second;
+constexpr int    IntegrityScanner::default_busy_percent;
+
+namespace {
+
+/// Images are decoded at this size for checking, decoders skip most of the work at reduced sizes.
+constexpr int check_decode_size = 256;
+
+/// Number of leading bytes of video files examined for container format.
+constexpr int video_header_size = 256;
+
+/// Limit on top-level MP4 boxes walked, fragmented files have a pair of boxes per fragment.
+constexpr int max_mp4_boxes = 100000;
+
+/// Results are posted at least this often, and after this many files.
+constexpr qint64 batch_interval_ms = 250;
+constexpr size_t batch_size = 64;
+
+/// Longest sleep between checks of cancellation while throttled.
+constexpr qint64 max_sleep_ms = 50;
+
+constexpr qint64 ts_packet_size = 188;
+constexpr qint64 m2ts_packet_size = 192;
+
+inline uint32_t le32(const uchar* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+inline uint64_t le64(const uchar* p) { return le32(p) | (uint64_t(le32(p + 4)) << 32); }
+inline uint32_t be16(const uchar* p) { return (p[0] << 8) | p[1]; }
+inline uint32_t be24(const uchar* p) { return (p[0] << 16) | (p[1] << 8) | p[2]; }
+inline uint32_t be32(const uchar* p) { return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+inline uint64_t be64(const uchar* p) { return (uint64_t(be32(p)) << 32) | be32(p + 4); }
+
+inline bool is_restart_marker(uchar marker) { return marker >= 0xD0 && marker <= 0xD7; }
+
+//------------------------------------------------------------------------------
+// NOTE: image walkers only tell whether the data ends where the format says it does,
+//       images that can not be decoded are already found corrupt by then
+
+MediaStatus check_jpeg(const uchar* d, qint64 n)
+{
+	qint64 pos = 2; // after SOI
+	while(pos + 2 <= n) {
+		if(d[pos] != 0xFF) { // NOTE: garbage between segments is skipped by decoders as well
+			++pos;
+			continue;
+		}
+		const uchar marker = d[pos + 1];
+		if(marker == 0xFF) { // fill byte
+			++pos;
+			continue;
+		}
+		if(marker == 0xD9) // EOI
+			return MediaStatus::Ok;
+
+		pos += 2;
+		if(marker == 0x01 || is_restart_marker(marker)) // markers without length
+			continue;
+		if(pos + 2 > n)
+			return MediaStatus::Truncated;
+		pos += be16(d + pos);
+
+		if(marker == 0xDA) { // SOS, entropy coded data ends at first marker except stuffed bytes and restarts
+			while(pos + 1 < n) {
+				const auto ff = static_cast<const uchar*>(std::memchr(d + pos, 0xFF, static_cast<size_t>(n - pos - 1)));
+				if(!ff) {
+					pos = n;
+					break;
+				}
+				pos = ff - d;
+				if(d[pos + 1] != 0x00 && !is_restart_marker(d[pos + 1]))
+					break;
+				pos += 2;
+			}
+		}
+	}
+	return MediaStatus::Truncated;
+}
+
+MediaStatus check_png(const uchar* d, qint64 n)
+{
+	qint64 pos = 8; // after signature
+	while(pos + 8 <= n) {
+		if(std::memcmp(d + pos + 4, "IEND", 4) == 0)
+			return MediaStatus::Ok;
+		pos += 12 + static_cast<qint64>(be32(d + pos)); // length, type, data and CRC
+	}
+	return MediaStatus::Truncated;
+}
+
+MediaStatus check_gif(const uchar* d, qint64 n)
+{
+	if(n < 13)
+		return MediaStatus::Truncated;
+
+	qint64 pos = 13; // after header and logical screen descriptor
+	if(d[10] & 0x80)
+		pos += 3 << ((d[10] & 7) + 1); // global color table
+
+	auto skip_sub_blocks = [d, n, &pos]()
+	{
+		while(pos < n) {
+			const uchar length = d[pos++];
+			if(length == 0)
+				return true;
+			pos += length;
+		}
+		return false;
+	};
+
+	while(pos < n) {
+		switch(d[pos++]) {
+		case 0x3B: // trailer
+			return MediaStatus::Ok;
+		case 0x21: // extension label and data
+			++pos;
+			if(!skip_sub_blocks())
+				return MediaStatus::Truncated;
+			break;
+		case 0x2C: // image descriptor, local color table, LZW code size and data
+			if(pos + 10 > n)
+				return MediaStatus::Truncated;
+			if(d[pos + 8] & 0x80)
+				pos += 3 << ((d[pos + 8] & 7) + 1);
+			pos += 10;
+			if(!skip_sub_blocks())
+				return MediaStatus::Truncated;
+			break;
+		default: // NOTE: decoders stop at unknown blocks and show frames before them
+			return MediaStatus::Truncated;
+		}
+	}
+	return MediaStatus::Truncated;
+}
+
+MediaStatus check_image(const QByteArray& data)
+{
+	const QImage image = DecoderRegistry::instance().decode(data, QSize(check_decode_size, check_decode_size));
+	if(image.isNull())
+		return MediaStatus::Corrupt;
+
+	const auto d = reinterpret_cast<const uchar*>(data.constData());
+	const qint64 n = data.size();
+	switch(util::detect_image_format(data.left(util::image_magic_size))) {
+	case ImageFormat::Jpeg:
+		return check_jpeg(d, n);
+	case ImageFormat::Png:
+		return check_png(d, n);
+	case ImageFormat::Gif:
+		return check_gif(d, n);
+	case ImageFormat::Webp:
+		return le32(d + 4) + 8ull > static_cast<quint64>(n) ? MediaStatus::Truncated : MediaStatus::Ok;
+	case ImageFormat::Bmp:
+		// NOTE: some writers leave file size in header zero
+		return n >= 6 && le32(d + 2) > static_cast<quint64>(n) ? MediaStatus::Truncated : MediaStatus::Ok;
+	default:
+		return MediaStatus::Ok;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+MediaStatus check_mp4(QFile& file, qint64 size, qint64* bytes_read)
+{
+	bool has_moov = false;
+	qint64 pos = 0;
+	for(int boxes = 0; pos < size; ++boxes) {
+		if(boxes >= max_mp4_boxes)
+			return MediaStatus::Unknown;
+		if(!file.seek(pos))
+			return MediaStatus::Unreadable;
+		const QByteArray header = file.read(16);
+		*bytes_read += header.size();
+		if(header.size() < 8)
+			return MediaStatus::Truncated;
+
+		const auto h = reinterpret_cast<const uchar*>(header.constData());
+		for(int i = 4; i < 8; ++i) {
+			if(h[i] < 0x20 || h[i] > 0x7E) // box types are printable
+				return MediaStatus::Corrupt;
+		}
+
+		quint64 box_size = be32(h);
+		if(box_size == 1) { // 64-bit size follows type
+			if(header.size() < 16)
+				return MediaStatus::Truncated;
+			box_size = be64(h + 8);
+		} else if(box_size == 0) { // box extends to end of file
+			box_size = static_cast<quint64>(size - pos);
+		}
+		if(box_size < 8)
+			return MediaStatus::Corrupt;
+		if(box_size > static_cast<quint64>(size - pos))
+			return MediaStatus::Truncated;
+
+		has_moov = has_moov || std::memcmp(h + 4, "moov", 4) == 0;
+		pos += static_cast<qint64>(box_size);
+	}
+	// NOTE: recordings that were interrupted have no index, players can not open them
+	return has_moov ? MediaStatus::Ok : MediaStatus::Corrupt;
+}
+
+/// Read EBML variable length integer at \p pos, sets \p unknown if all value bits are set.
+bool read_ebml_vint(const uchar* d, int n, int& pos, quint64* value, bool* unknown)
+{
+	if(pos >= n || d[pos] == 0)
+		return false;
+	int length = 1;
+	while(!(d[pos] & (0x80 >> (length - 1))))
+		++length;
+	if(pos + length > n)
+		return false;
+
+	const uchar mask = static_cast<uchar>(0xFF >> length);
+	quint64 res = d[pos] & mask;
+	bool all_ones = (d[pos] & mask) == mask;
+	for(int i = 1; i < length; ++i) {
+		res = (res << 8) | d[pos + i];
+		all_ones = all_ones && d[pos + i] == 0xFF;
+	}
+	pos += length;
+	*value = res;
+	*unknown = all_ones;
+	return true;
+}
+
+MediaStatus check_matroska(const QByteArray& header, qint64 size)
+{
+	const auto d = reinterpret_cast<const uchar*>(header.constData());
+	const int n = header.size();
+
+	// EBML header element, followed by Segment element with all the data
+	int pos = 4;
+	quint64 length;
+	bool unknown;
+	if(!read_ebml_vint(d, n, pos, &length, &unknown) || unknown || length > static_cast<quint64>(n - pos))
+		return n < video_header_size ? MediaStatus::Truncated : MediaStatus::Corrupt;
+	pos += static_cast<int>(length);
+
+	if(pos + 4 > n)
+		return n < video_header_size ? MediaStatus::Truncated : MediaStatus::Corrupt;
+	if(be32(d + pos) != 0x18538067)
+		return MediaStatus::Corrupt;
+	pos += 4;
+	if(!read_ebml_vint(d, n, pos, &length, &unknown))
+		return n < video_header_size ? MediaStatus::Truncated : MediaStatus::Corrupt;
+
+	// NOTE: live recordings have segment of unknown size
+	if(unknown)
+		return MediaStatus::Ok;
+	return length > static_cast<quint64>(size - pos) ? MediaStatus::Truncated : MediaStatus::Ok;
+}
+
+MediaStatus check_flv(QFile& file, qint64 size, qint64* bytes_read)
+{
+	// NOTE: each tag is followed by its size, so the last tag can be found from the end of file
+	if(size < 13 + 4 || !file.seek(size - 4))
+		return MediaStatus::Truncated;
+	const QByteArray tail = file.read(4);
+	*bytes_read += tail.size();
+	if(tail.size() < 4)
+		return MediaStatus::Unreadable;
+
+	const qint64 last_tag_size = be32(reinterpret_cast<const uchar*>(tail.constData()));
+	if(last_tag_size == 0) // no tags
+		return MediaStatus::Corrupt;
+	if(last_tag_size < 11 || last_tag_size > size - 13 - 4 || !file.seek(size - 4 - last_tag_size))
+		return MediaStatus::Truncated;
+
+	const QByteArray tag = file.read(4);
+	*bytes_read += tag.size();
+	if(tag.size() < 4)
+		return MediaStatus::Unreadable;
+	const auto t = reinterpret_cast<const uchar*>(tag.constData());
+	const uchar type = t[0] & 0x1F;
+	if((type != 8 && type != 9 && type != 18) || be24(t + 1) + 11 != last_tag_size)
+		return MediaStatus::Truncated;
+	return MediaStatus::Ok;
+}
+
+MediaStatus check_video(QFile& file, qint64 size, qint64* bytes_read)
+{
+	const QByteArray header = file.read(video_header_size);
+	*bytes_read += header.size();
+	const auto d = reinterpret_cast<const uchar*>(header.constData());
+	const int n = header.size();
+	if(n < 16)
+		return MediaStatus::Truncated;
+
+	const auto starts_with = [&header](const char* magic, int length)
+	{
+		return std::memcmp(header.constData(), magic, static_cast<size_t>(length)) == 0;
+	};
+
+	if(std::memcmp(d + 4, "ftyp", 4) == 0 || std::memcmp(d + 4, "moov", 4) == 0
+	|| std::memcmp(d + 4, "mdat", 4) == 0 || std::memcmp(d + 4, "free", 4) == 0
+	|| std::memcmp(d + 4, "wide", 4) == 0)
+		return check_mp4(file, size, bytes_read);
+
+	if(starts_with("\x1A\x45\xDF\xA3", 4))
+		return check_matroska(header, size);
+
+	if(starts_with("RIFF", 4)) // AVI, sizes of further RIFF chunks of large files are not checked
+		return le32(d + 4) + 8ull > static_cast<quint64>(size) ? MediaStatus::Truncated : MediaStatus::Ok;
+
+	if(starts_with("\x30\x26\xB2\x75\x8E\x66\xCF\x11", 8)) { // ASF header object
+		if(n < 24)
+			return MediaStatus::Truncated;
+		return le64(d + 16) > static_cast<quint64>(size) ? MediaStatus::Truncated : MediaStatus::Ok;
+	}
+
+	if(starts_with("FLV", 3))
+		return check_flv(file, size, bytes_read);
+
+	if(d[0] == 0x47 && (size <= ts_packet_size || (n > ts_packet_size && d[ts_packet_size] == 0x47)))
+		return size % ts_packet_size ? MediaStatus::Truncated : MediaStatus::Ok;
+
+	if(n > m2ts_packet_size + 4 && d[4] == 0x47 && d[m2ts_packet_size + 4] == 0x47)
+		return size % m2ts_packet_size ? MediaStatus::Truncated : MediaStatus::Ok;
+
+	// NOTE: MPEG program streams have no size or end to check
+	return MediaStatus::Unknown;
+}
+
+} // namespace
+
+MediaStatus util::check_media_file(const QString& filename, qint64* bytes_read)
+{
+	qint64 read = 0;
+	if(!bytes_read)
+		bytes_read = &read;
+	*bytes_read = 0;
+
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly))
+		return MediaStatus::Unreadable;
+
+	const qint64 size = file.size();
+	if(size == 0)
+		return MediaStatus::Empty;
+
+	if(QDir::match(util::supported_video_formats_namefilter(), QFileInfo(filename).fileName()))
+		return check_video(file, size, bytes_read);
+
+	const QByteArray data = file.readAll();
+	*bytes_read = data.size();
+	if(data.size() != size)
+		return MediaStatus::Unreadable;
+	return check_image(data);
+}
+
+QString util::media_status_name(MediaStatus status)
+{
+	switch(status) {
+	case MediaStatus::Unknown:    return QStringLiteral("unknown");
+	case MediaStatus::Ok:         return QStringLiteral("ok");
+	case MediaStatus::Empty:      return QStringLiteral("empty");
+	case MediaStatus::Truncated:  return QStringLiteral("truncated");
+	case MediaStatus::Corrupt:    return QStringLiteral("corrupt");
+	case MediaStatus::Unreadable: return QStringLiteral("unreadable");
+	}
+	return QString();
+}
+
+//------------------------------------------------------------------------------
+
+bool MediaStatusPredicate::parse(const QString& str, MediaStatusPredicate* predicate)
+{
+	const auto prefix = QStringLiteral("status=");
+	if(!str.startsWith(prefix, Qt::CaseInsensitive))
+		return false;
+
+	const auto value = str.mid(prefix.size()).toLower();
+	if(value == QStringLiteral("broken")) {
+		predicate->m_any_broken = true;
+		return true;
+	}
+	for(auto status : {MediaStatus::Ok, MediaStatus::Empty, MediaStatus::Truncated,
+	                   MediaStatus::Corrupt, MediaStatus::Unreadable}) {
+		if(value == util::media_status_name(status)) {
+			predicate->m_any_broken = false;
+			predicate->m_status = status;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool MediaStatusPredicate::matches(MediaStatus status) const
+{
+	return m_any_broken ? util::is_broken(status) : status == m_status;
+}
+
+//------------------------------------------------------------------------------
+
+/// Task for checking files in background.
+struct ScanFilesTask : public QRunnable
+{
+	ScanFilesTask(IntegrityScanner* s, uint64_t g, std::vector<QString>&& f) :
+	        scanner(s), generation(g), files(std::move(f))
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		// NOTE: checking may take hours, leave the CPU to everything else
+		QThread::currentThread()->setPriority(QThread::IdlePriority);
+		scanner->scanThreadFunc(generation, files);
+		QThread::currentThread()->setPriority(QThread::NormalPriority);
+	}
+
+	IntegrityScanner* scanner;
+	uint64_t          generation;
+	std::vector<QString> files;
+};
+
+IntegrityScanner::IntegrityScanner()
+{
+	m_thread_pool.setMaxThreadCount(1);
+}
+
+IntegrityScanner::~IntegrityScanner()
+{
+	cancel();
+	m_thread_pool.waitForDone();
+}
+
+void IntegrityScanner::setBudget(qint64 bytes_per_second, int busy_percent)
+{
+	m_bytes_per_second = std::max(bytes_per_second, qint64(0));
+	m_busy_percent = std::max(1, std::min(busy_percent, 100));
+}
+
+void IntegrityScanner::scanFiles(const std::vector<QString>& files)
+{
+	cancel();
+
+	std::vector<QString> remaining;
+	for(const auto& f : files) {
+		if(!m_entries.contains(f))
+			remaining.push_back(f);
+	}
+	m_total = static_cast<int>(remaining.size());
+	m_checked = 0;
+	if(remaining.empty())
+		return;
+
+	m_running = true;
+	pdbg << "checking" << m_total << "files";
+	m_thread_pool.start(new ScanFilesTask(this, m_generation.load(), std::move(remaining)));
+}
+
+void IntegrityScanner::cancel()
+{
+	++m_generation;
+	m_thread_pool.clear();
+	m_running = false;
+
+	QMutexLocker _{&m_results_lock};
+	m_results.clear();
+	m_finished = false;
+}
+
+void IntegrityScanner::clear()
+{
+	cancel();
+	m_entries.clear();
+	m_total = 0;
+	m_checked = 0;
+	m_broken = 0;
+}
+
+bool IntegrityScanner::isRunning() const
+{
+	return m_running;
+}
+
+MediaStatus IntegrityScanner::status(const QString& file) const
+{
+	return m_entries.value(file).status;
+}
+
+bool IntegrityScanner::isBroken(const QString& file) const
+{
+	const auto it = m_entries.find(file);
+	if(it == m_entries.end() || !util::is_broken(it->status))
+		return false;
+
+	// same size and modification time is treated as same file
+	const QFileInfo fi(file);
+	return fi.size() == it->file_size && fi.lastModified().toMSecsSinceEpoch() == it->modified;
+}
+
+void IntegrityScanner::renameFile(const QString& from, const QString& to)
+{
+	const auto it = m_entries.find(from);
+	if(it == m_entries.end())
+		return;
+	const auto entry = it.value();
+	m_entries.erase(it);
+	setEntry(to, entry);
+}
+
+void IntegrityScanner::removeFile(const QString& file)
+{
+	const auto it = m_entries.find(file);
+	if(it == m_entries.end())
+		return;
+	if(util::is_broken(it->status))
+		--m_broken;
+	m_entries.erase(it);
+}
+
+int IntegrityScanner::checkedCount() const
+{
+	return m_checked;
+}
+
+int IntegrityScanner::totalCount() const
+{
+	return m_total;
+}
+
+int IntegrityScanner::brokenCount() const
+{
+	return m_broken;
+}
+
+void IntegrityScanner::scanThreadFunc(uint64_t generation, const std::vector<QString>& files)
+{
+	QElapsedTimer timer, batch_timer;
+	timer.start();
+	batch_timer.start();
+	qint64 bytes_read = 0;
+	qint64 busy_ns = 0;
+
+	std::vector<ScanResult> results;
+	for(size_t i = 0; i < files.size(); ++i) {
+		QElapsedTimer work;
+		work.start();
+
+		ScanResult r;
+		r.file = files[i];
+		const QFileInfo fi(r.file);
+		r.entry.file_size = fi.size();
+		r.entry.modified = fi.lastModified().toMSecsSinceEpoch();
+		qint64 read = 0;
+		r.entry.status = util::check_media_file(r.file, &read);
+		results.push_back(std::move(r));
+		bytes_read += read;
+		busy_ns += work.nsecsElapsed();
+
+		const bool last = i + 1 == files.size();
+		if(last || results.size() >= batch_size || batch_timer.elapsed() >= batch_interval_ms) {
+			{
+				QMutexLocker _{&m_results_lock};
+				if(m_generation != generation)
+					return;
+				std::move(results.begin(), results.end(), std::back_inserter(m_results));
+				m_finished = last;
+			}
+			QMetaObject::invokeMethod(this, "applyScanResults", Qt::QueuedConnection);
+			results.clear();
+			batch_timer.restart();
+		}
+
+		if(!last && !throttle(generation, timer.elapsed(), bytes_read, busy_ns))
+			return;
+	}
+}
+
+bool IntegrityScanner::throttle(uint64_t generation, qint64 elapsed_ms, qint64 bytes_read, qint64 busy_ns) const
+{
+	// time the work done so far is allowed to take within budget, the rest is slept off
+	qint64 allowed_ms = busy_ns / (10000 * m_busy_percent.load());
+	const qint64 bytes_per_second = m_bytes_per_second;
+	if(bytes_per_second > 0)
+		allowed_ms = std::max(allowed_ms, bytes_read * 1000 / bytes_per_second);
+
+	for(qint64 wait = allowed_ms - elapsed_ms; wait > 0; wait -= max_sleep_ms) {
+		if(m_generation != generation)
+			return false;
+		QThread::msleep(static_cast<unsigned long>(std::min(wait, max_sleep_ms)));
+	}
+	return m_generation == generation;
+}
+
+void IntegrityScanner::setEntry(const QString& file, const Entry& entry)
+{
+	const auto it = m_entries.find(file);
+	if(it != m_entries.end()) {
+		if(util::is_broken(it->status))
+			--m_broken;
+		it.value() = entry;
+	} else {
+		m_entries.insert(file, entry);
+	}
+	if(util::is_broken(entry.status))
+		++m_broken;
+}
+
+void IntegrityScanner::applyScanResults()
+{
+	std::vector<ScanResult> results;
+	bool finished;
+	{
+		QMutexLocker _{&m_results_lock};
+		std::swap(results, m_results);
+		finished = m_finished;
+		m_finished = false;
+	}
+	if(!m_running)
+		return; // cancelled meanwhile
+
+	for(const auto& r : results) {
+		if(util::is_broken(r.entry.status))
+			pdbg << r.file << "is" << util::media_status_name(r.entry.status);
+		setEntry(r.file, r.entry);
+	}
+	m_checked += static_cast<int>(results.size());
+	if(!results.empty())
+		emit progress(m_checked, m_total, m_broken);
+
+	if(finished) {
+		pdbg << "checked" << m_checked << "files," << m_broken << "broken";
+		m_running = false;
+		emit finished();
+	}
+}
@@ -0,0 +1,201 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_INTEGRITY_SCANNER_H
+#define UTIL_INTEGRITY_SCANNER_H
+
+/**
+ * \file integrity_scanner.h
+ * \brief Checking media files for damage, class \ref IntegrityScanner
+ */
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/// Result of checking media file for damage.
+enum class MediaStatus : uint8_t
+{
+	Unknown,    ///< Not checked yet, or container format is not recognized.
+	Ok,
+	Empty,      ///< File is zero bytes.
+	Truncated,  ///< File ends before its data does.
+	Corrupt,    ///< File structure is invalid or data could not be decoded.
+	Unreadable, ///< File could not be opened.
+};
+
+namespace util {
+
+/// Is \p status one of damaged file states.
+inline bool is_broken(MediaStatus status)
+{
+	return status != MediaStatus::Unknown && status != MediaStatus::Ok;
+}
+
+/*!
+ * \brief Check \p filename for damage.
+ * \param bytes_read Set to the number of bytes read from file, may be null.
+ *
+ * Images are checked for end of their data (JPEG EOI marker, PNG IEND chunk,
+ * GIF trailer, RIFF and BMP sizes) and decoded at reduced size.
+ *
+ * Videos are checked by walking their container structure: MP4 and MOV boxes,
+ * Matroska and WebM segment size, AVI RIFF size, ASF header size and MPEG-TS
+ * packets. Only headers are read, video streams are not decoded.
+ */
+MediaStatus check_media_file(const QString& filename, qint64* bytes_read = nullptr);
+
+/// Lowercase name of \p status, as used in queue filter.
+QString media_status_name(MediaStatus status);
+
+} // namespace util
+
+/*!
+ * \brief Condition on media status, used in queue filter.
+ *
+ * Written as \c status= and either status name (\c ok, \c empty, \c truncated,
+ * \c corrupt, \c unreadable) or \c broken for any kind of damage.
+ * Files not checked yet never match.
+ */
+class MediaStatusPredicate
+{
+public:
+	/*!
+	 * \brief Parse predicate from \p str.
+	 * \return True if \p str is a valid predicate, \p predicate is set then.
+	 */
+	static bool parse(const QString& str, MediaStatusPredicate* predicate);
+
+	/// Does file with \p status match.
+	bool matches(MediaStatus status) const;
+
+private:
+	MediaStatus m_status = MediaStatus::Ok;
+	bool        m_any_broken = false;
+};
+
+/*!
+ * \brief Checks media files for damage in background.
+ *
+ * Files are checked one at a time by a single idle priority thread, within a budget
+ * of bytes read per second and share of time spent checking, see \ref setBudget().
+ * Damaged files are then known before they are opened, so they can be filtered,
+ * removed from queue or skipped without an error dialog.
+ *
+ * \note Member functions must be called from the thread the object lives in.
+ */
+class IntegrityScanner : public QObject
+{
+	Q_OBJECT
+public:
+	/// Default budget of bytes read per second.
+	static constexpr qint64 default_bytes_per_second = 16 * 1024 * 1024;
+
+	/// Default share of time spent checking files, in percent.
+	static constexpr int default_busy_percent = 25;
+
+	IntegrityScanner();
+	~IntegrityScanner() override;
+
+	/*!
+	 * \brief Set budget of checking files.
+	 * \param bytes_per_second Bytes read from files per second, 0 for unlimited.
+	 * \param busy_percent     Share of time the thread spends checking files, 1 to 100.
+	 */
+	void setBudget(qint64 bytes_per_second, int busy_percent);
+
+	/*!
+	 * \brief Check \p files in background.
+	 *
+	 * Files checked before are skipped. Replaces files of previous call that
+	 * were not checked yet.
+	 */
+	void scanFiles(const std::vector<QString>& files);
+
+	/// Stop checking files, results so far are kept.
+	void cancel();
+
+	/// Forget all results.
+	void clear();
+
+	/// Are files being checked.
+	bool isRunning() const;
+
+	/// Status of \p file, \ref MediaStatus::Unknown if it was not checked yet.
+	MediaStatus status(const QString& file) const;
+
+	/// Was \p file found damaged, and not modified since.
+	bool isBroken(const QString& file) const;
+
+	/// Keep status of renamed file.
+	void renameFile(const QString& from, const QString& to);
+
+	/// Forget status of file removed from queue.
+	void removeFile(const QString& file);
+
+	/// Number of files checked by running or last call to \ref scanFiles().
+	int checkedCount() const;
+
+	/// Number of files passed to running or last call to \ref scanFiles() that were not checked before.
+	int totalCount() const;
+
+	/// Number of known damaged files.
+	int brokenCount() const;
+
+signals:
+	/// Emitted as files are checked.
+	void progress(int checked, int total, int broken);
+
+	/// Emitted when all files passed to \ref scanFiles() are checked.
+	void finished();
+
+private slots:
+	void applyScanResults();
+
+private:
+	friend struct ScanFilesTask;
+
+	/// Checked file, with identity of file it was checked from.
+	struct Entry
+	{
+		MediaStatus status = MediaStatus::Unknown;
+		qint64      file_size = -1;
+		qint64      modified  = 0;
+	};
+
+	/// File checked by worker thread.
+	struct ScanResult
+	{
+		QString file;
+		Entry   entry;
+	};
+
+	void scanThreadFunc(uint64_t generation, const std::vector<QString>& files);
+	bool throttle(uint64_t generation, qint64 elapsed_ms, qint64 bytes_read, qint64 busy_ns) const;
+	void setEntry(const QString& file, const Entry& entry);
+
+	QHash<QString, Entry> m_entries;
+	int                   m_total = 0;
+	int                   m_checked = 0;
+	int                   m_broken = 0;
+	bool                  m_running = false;
+	std::atomic<uint64_t> m_generation{0};
+	std::atomic<qint64>   m_bytes_per_second{default_bytes_per_second};
+	std::atomic<int>      m_busy_percent{default_busy_percent};
+
+	QMutex      m_results_lock;
+	std::vector<ScanResult> m_results; ///< Guarded by \p m_results_lock.
+	bool        m_finished = false;    ///< Guarded by \p m_results_lock.
+	QThreadPool m_thread_pool;
+};
+
+#endif // UTIL_INTEGRITY_SCANNER_H
@@ -0,0 +1,116 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "mapped_file_device.h"
+#include <QLoggingCategory>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace logging_category {Q_LOGGING_CATEGORY(mappedfile, "MappedFileDevice")}
+#define pdbg qCDebug(logging_category::mappedfile)
+#define pwarn qCWarning(logging_category::mappedfile)
+
+MappedFileDevice::MappedFileDevice(const QString& filename, QObject* parent) :
+	QIODevice(parent),
+	m_file(filename) { }
+
+MappedFileDevice::~MappedFileDevice()
+{
+	close();
+}
+
+bool MappedFileDevice::open(OpenMode mode)
+{
+	if((mode & ReadWrite) != ReadOnly) {
+		pwarn << "only read-only access is supported";
+		return false;
+	}
+	if(isOpen())
+		close();
+
+	if(!m_file.open(QIODevice::ReadOnly))
+		return false;
+
+	m_size = m_file.size();
+	if(m_size > 0)
+		m_map = m_file.map(0, m_size);
+
+	if(!m_map) {
+		pdbg << "could not map" << m_file.fileName() << ", reading into memory";
+		m_fallback = m_file.readAll();
+		m_size = m_fallback.size();
+		m_file.close();
+	}
+
+	return QIODevice::open(mode | Unbuffered);
+}
+
+void MappedFileDevice::close()
+{
+	if(!isOpen())
+		return;
+	QIODevice::close();
+	if(m_map) {
+		m_file.unmap(m_map);
+		m_map = nullptr;
+	}
+	m_file.close();
+	m_fallback.clear();
+	m_size = 0;
+}
+
+qint64 MappedFileDevice::size() const
+{
+	return m_size;
+}
+
+bool MappedFileDevice::isMapped() const
+{
+	return m_map != nullptr;
+}
+
+void MappedFileDevice::advise(Access access)
+{
+#if defined(Q_OS_UNIX) && defined(MADV_SEQUENTIAL)
+	if(!m_map)
+		return;
+
+	int advice = MADV_NORMAL;
+	switch(access) {
+	case Access::Sequential: advice = MADV_SEQUENTIAL; break;
+	case Access::WillNeed:   advice = MADV_WILLNEED;   break;
+	default: break;
+	}
+	// NOTE: mapping of the whole file starts at page boundary
+	if(madvise(m_map, static_cast<size_t>(m_size), advice) != 0)
+		pdbg << "madvise failed:" << std::strerror(errno);
+#else
+	Q_UNUSED(access)
+#endif
+}
+
+qint64 MappedFileDevice::readData(char* data, qint64 maxlen)
+{
+	const qint64 available = m_size - pos();
+	const qint64 len = std::min(maxlen, available);
+	if(len <= 0)
+		return 0;
+
+	const char* src = m_map ? reinterpret_cast<const char*>(m_map) : m_fallback.constData();
+	std::memcpy(data, src + pos(), static_cast<size_t>(len));
+	return len;
+}
+
+qint64 MappedFileDevice::writeData(const char*, qint64)
+{
+	return -1;
+}
@@ -0,0 +1,71 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef MAPPED_FILE_DEVICE_H
+#define MAPPED_FILE_DEVICE_H
+
+/**
+ * \file mapped_file_device.h
+ * \brief Class \ref MappedFileDevice
+ */
+
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+
+/*!
+ * \brief Read-only QIODevice over a memory-mapped file.
+ *
+ * Lets image decoders read file contents without copying the whole file
+ * to the heap first. The mapping is released when the device is closed.
+ *
+ * If the file can not be mapped (e.g. it is empty or on a filesystem that
+ * does not support mapping), its contents are read into memory instead.
+ *
+ * \note The file should not be truncated while it is mapped.
+ */
+class MappedFileDevice : public QIODevice
+{
+public:
+	/// Expected access pattern, passed to \c madvise() where available.
+	enum class Access
+	{
+		Normal,     ///< No particular pattern.
+		Sequential, ///< Read once from start to end, e.g. while decoding.
+		WillNeed,   ///< Read soon and repeatedly, e.g. during playback.
+	};
+
+	explicit MappedFileDevice(const QString& filename, QObject* parent = nullptr);
+	~MappedFileDevice() override;
+
+	/// Map the file, only \a QIODevice::ReadOnly is supported.
+	bool   open(OpenMode mode) override;
+
+	/// Unmap the file.
+	void   close() override;
+
+	/// Size of the file in bytes.
+	qint64 size() const override;
+
+	/// Is the file memory-mapped rather than read into memory.
+	bool   isMapped() const;
+
+	/// Hint how the mapping is going to be read.
+	void   advise(Access access);
+
+protected:
+	qint64 readData(char* data, qint64 maxlen) override;
+	qint64 writeData(const char* data, qint64 len) override;
+
+private:
+	QFile      m_file;
+	QByteArray m_fallback;
+	uchar*     m_map  = nullptr;
+	qint64     m_size = 0;
+};
+
+#endif // MAPPED_FILE_DEVICE_H
@@ -0,0 +1,219 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "memory_governor.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QLoggingCategory>
+#include <algorithm>
+#include <limits>
+
+namespace logging_category {Q_LOGGING_CATEGORY(memgov, "MemoryGovernor")}
+#define pdbg qCDebug(logging_category::memgov)
+#define pwarn qCWarning(logging_category::memgov)
+
+/// Interval of polling system memory state.
+static constexpr int poll_interval_ms = 2000;
+
+/// Budget used when physical memory size is unknown.
+static constexpr size_t fallback_budget = size_t{2048} * 1024 * 1024;
+
+/// Memory kept available for the rest of the system, at least.
+static constexpr size_t min_reserve = size_t{256} * 1024 * 1024;
+
+/// PSI \c some avg10 percentage treated as moderate pressure.
+static constexpr double psi_some_moderate = 10.0;
+
+/// PSI \c full avg10 percentage treated as critical pressure.
+static constexpr double psi_full_critical = 5.0;
+
+MemoryGovernor& MemoryGovernor::instance()
+{
+	static MemoryGovernor instance;
+	return instance;
+}
+
+MemoryGovernor::MemoryGovernor() : QObject(nullptr)
+{
+	pollSystemMemory();
+#ifdef Q_OS_LINUX
+	connect(&m_poll_timer, &QTimer::timeout, this, [this]()
+	{
+		const auto old_pressure = m_pressure;
+		pollSystemMemory();
+		if(m_pressure != old_pressure)
+			pdbg << "memory pressure changed from" << old_pressure << "to" << m_pressure;
+		rebalance();
+	});
+	m_poll_timer.start(poll_interval_ms);
+
+	// NOTE: the instance outlives the application object
+	connect(qApp, &QCoreApplication::aboutToQuit, &m_poll_timer, &QTimer::stop);
+#endif
+}
+
+MemoryGovernor::~MemoryGovernor() = default;
+
+void MemoryGovernor::registerConsumer(MemoryConsumer *consumer)
+{
+	Q_ASSERT(consumer);
+	if(std::find(m_consumers.begin(), m_consumers.end(), consumer) == m_consumers.end())
+		m_consumers.push_back(consumer);
+	usageChanged();
+}
+
+void MemoryGovernor::unregisterConsumer(MemoryConsumer *consumer)
+{
+	m_consumers.erase(std::remove(m_consumers.begin(), m_consumers.end(), consumer), m_consumers.end());
+}
+
+void MemoryGovernor::setBudget(size_t bytes)
+{
+	m_budget = bytes;
+	rebalance();
+}
+
+size_t MemoryGovernor::budget() const
+{
+	if(m_budget)
+		return m_budget;
+	if(m_mem_total)
+		return m_mem_total / 4;
+	return fallback_budget;
+}
+
+MemoryGovernor::Pressure MemoryGovernor::pressure() const
+{
+	return m_pressure;
+}
+
+void MemoryGovernor::usageChanged()
+{
+	if(!m_rebalance_pending.exchange(true, std::memory_order_acq_rel))
+		QMetaObject::invokeMethod(this, "rebalance", Qt::QueuedConnection);
+}
+
+void MemoryGovernor::rebalance()
+{
+	m_rebalance_pending.store(false, std::memory_order_release);
+
+	size_t display_usage = 0, prefetch_usage = 0, prefetch_consumers = 0;
+	for(const auto c : m_consumers) {
+		if(c->memoryPriority() == MemoryConsumer::Priority::Display) {
+			display_usage += c->memoryUsage();
+		} else {
+			prefetch_usage += c->memoryUsage();
+			++prefetch_consumers;
+		}
+	}
+
+	size_t limit = budget();
+	if(m_mem_available) {
+		// do not grow into memory the rest of the system needs
+		const size_t reserve = std::max(min_reserve, m_mem_total / 20);
+		const size_t headroom = m_mem_available > reserve ? m_mem_available - reserve : 0;
+		limit = std::min(limit, display_usage + prefetch_usage + headroom);
+	}
+
+	size_t prefetch_allowance = limit > display_usage ? limit - display_usage : 0;
+	size_t display_allowance = std::numeric_limits<size_t>::max();
+	switch(m_pressure) {
+	case Pressure::Moderate:
+		// NOTE: halving current usage instead would shrink the cache again on every poll
+		prefetch_allowance /= 2;
+		break;
+	case Pressure::Critical:
+		prefetch_allowance = 0;
+		display_allowance = 0;
+		break;
+	default:
+		break;
+	}
+	if(display_usage > limit)
+		display_allowance = std::min(display_allowance, limit);
+
+	if(prefetch_consumers > 1)
+		prefetch_allowance /= prefetch_consumers;
+
+	if(prefetch_allowance != m_prefetch_allowance) {
+		pdbg << "display:" << display_usage / 1024 << "KiB, prefetch:" << prefetch_usage / 1024
+		     << "KiB, prefetch allowance:" << prefetch_allowance / 1024 << "KiB";
+		m_prefetch_allowance = prefetch_allowance;
+	}
+
+	for(const auto c : m_consumers) {
+		if(c->memoryPriority() == MemoryConsumer::Priority::Display) {
+			c->setMemoryAllowance(display_allowance);
+		} else {
+			c->setMemoryAllowance(prefetch_allowance);
+		}
+	}
+}
+
+#ifdef Q_OS_LINUX
+/// Reads value in KiB of \p key from /proc/meminfo contents.
+static size_t meminfo_value(const QByteArray& meminfo, const char* key)
+{
+	const int pos = meminfo.indexOf(key);
+	if(pos < 0)
+		return 0;
+	const int start = pos + static_cast<int>(qstrlen(key));
+	const int end = meminfo.indexOf('\n', start);
+	auto value = meminfo.mid(start, end < 0 ? -1 : end - start).trimmed();
+	if(value.endsWith("kB"))
+		value.chop(2);
+	return value.trimmed().toULongLong();
+}
+
+/// Reads avg10 value of \p kind ("some" or "full") line from /proc/pressure/memory contents.
+static double psi_avg10(const QByteArray& psi, const char* kind)
+{
+	for(const auto& line : psi.split('\n')) {
+		if(!line.startsWith(kind))
+			continue;
+		const int pos = line.indexOf("avg10=");
+		if(pos < 0)
+			return 0.0;
+		const int end = line.indexOf(' ', pos);
+		return line.mid(pos + 6, end < 0 ? -1 : end - pos - 6).toDouble();
+	}
+	return 0.0;
+}
+#endif
+
+void MemoryGovernor::pollSystemMemory()
+{
+#ifdef Q_OS_LINUX
+	QFile meminfo(QStringLiteral("/proc/meminfo"));
+	if(meminfo.open(QIODevice::ReadOnly)) {
+		const auto data = meminfo.readAll();
+		m_mem_total     = meminfo_value(data, "MemTotal:") * 1024;
+		m_mem_available = meminfo_value(data, "MemAvailable:") * 1024;
+	}
+
+	Pressure pressure = Pressure::None;
+	QFile psi(QStringLiteral("/proc/pressure/memory"));
+	if(psi.open(QIODevice::ReadOnly)) { // NOTE: requires kernel 4.20+ with PSI enabled
+		const auto data = psi.readAll();
+		if(psi_avg10(data, "full") >= psi_full_critical) {
+			pressure = Pressure::Critical;
+		} else if(psi_avg10(data, "some") >= psi_some_moderate) {
+			pressure = Pressure::Moderate;
+		}
+	}
+
+	if(m_mem_available && m_mem_total) {
+		const size_t reserve = std::max(min_reserve, m_mem_total / 20);
+		if(m_mem_available < reserve) {
+			pressure = Pressure::Critical;
+		} else if(m_mem_available < reserve * 2) {
+			pressure = std::max(pressure, Pressure::Moderate);
+		}
+	}
+	m_pressure = pressure;
+#endif
+}
@@ -0,0 +1,129 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+/**
+ * \file memory_governor.h
+ * \brief Classes \ref MemoryGovernor and \ref MemoryConsumer
+ */
+
+#include <QObject>
+#include <QTimer>
+#include <atomic>
+#include <vector>
+
+/*!
+ * \brief Interface of objects holding large amounts of memory.
+ *
+ * Consumers register with \ref MemoryGovernor, which periodically queries
+ * their usage and tells each one how much memory it is allowed to hold.
+ */
+class MemoryConsumer
+{
+public:
+	/// Importance of memory held by consumer.
+	enum class Priority
+	{
+		Prefetch, ///< Memory can be dropped at any time, e.g. preloaded images.
+		Display,  ///< Memory used for media currently being displayed.
+	};
+
+	virtual ~MemoryConsumer() = default;
+
+	/// Approximate number of bytes currently held.
+	virtual size_t   memoryUsage() const = 0;
+
+	/// Importance of memory held.
+	virtual Priority memoryPriority() const = 0;
+
+	/*!
+	 * \brief Limit memory held by consumer to \p bytes.
+	 *
+	 * Consumer should release memory above the allowance if possible.
+	 * Called from the main thread only.
+	 */
+	virtual void     setMemoryAllowance(size_t bytes) = 0;
+};
+
+/*!
+ * \brief Process-wide memory budget.
+ *
+ * The MemoryGovernor singleton distributes memory budget between registered
+ * \ref MemoryConsumer objects. Memory used for displayed media is subtracted
+ * from the budget first, the rest is allowed for prefetching.
+ *
+ * On Linux, \c /proc/meminfo and \c /proc/pressure/memory are polled to
+ * shrink the budget when the system is low on memory: under moderate pressure
+ * prefetch allowance is halved, under critical pressure prefetched data is
+ * dropped entirely and display consumers are asked to release what they can.
+ *
+ * Member functions must be called from the main thread unless noted otherwise.
+ */
+class MemoryGovernor : public QObject
+{
+	Q_OBJECT
+public:
+	/// System memory pressure level.
+	enum class Pressure
+	{
+		None,
+		Moderate,
+		Critical,
+	};
+	Q_ENUM(Pressure)
+
+	/// Returns reference to an instance of MemoryGovernor.
+	static MemoryGovernor& instance();
+
+	/// Start distributing memory budget to \p consumer.
+	void     registerConsumer(MemoryConsumer* consumer);
+
+	/// Stop distributing memory budget to \p consumer.
+	void     unregisterConsumer(MemoryConsumer* consumer);
+
+	/*!
+	 * \brief Set process-wide memory budget.
+	 * \param bytes Budget in bytes, \c 0 to derive it from physical memory size.
+	 */
+	void     setBudget(size_t bytes);
+
+	/// Memory budget before accounting for system memory pressure.
+	size_t   budget() const;
+
+	/// Current system memory pressure level.
+	Pressure pressure() const;
+
+	/*!
+	 * \brief Notify governor that memory usage of some consumer has changed.
+	 *
+	 * Schedules redistribution of memory budget. Can be called from any thread.
+	 */
+	void     usageChanged();
+
+public slots:
+	/// Query consumers and redistribute memory budget immediately.
+	void     rebalance();
+
+private:
+	MemoryGovernor();
+	~MemoryGovernor() override;
+
+	void     pollSystemMemory();
+
+	std::vector<MemoryConsumer*> m_consumers;
+	QTimer           m_poll_timer;
+	size_t           m_budget = 0;
+	size_t           m_mem_total = 0;
+	size_t           m_mem_available = 0;
+	size_t           m_prefetch_allowance = 0;
+	Pressure         m_pressure = Pressure::None;
+	std::atomic_bool m_rebalance_pending{false};
+};
+
+#endif // MEMORY_GOVERNOR_H
@@ -0,0 +1,178 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "perceptual_hash.h"
+#include "util/resample.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdlib>
+
+/// Luminance of \p image reduced to \p width x \p height pixels, row by row.
+static std::vector<float> luminance(const QImage& image, int width, int height)
+{
+	using namespace util::resample;
+	const QImage small = scaled(image, QSize(width, height), Filter::Box, 1);
+	std::vector<float> res;
+	if(small.isNull())
+		return res;
+
+	res.reserve(static_cast<size_t>(width * height));
+	for(int y = 0; y < height; ++y) {
+		const auto line = reinterpret_cast<const QRgb*>(small.constScanLine(y));
+		for(int x = 0; x < width; ++x)
+			res.push_back(0.299f * qRed(line[x]) + 0.587f * qGreen(line[x]) + 0.114f * qBlue(line[x]));
+	}
+	return res;
+}
+
+uint64_t util::dhash(const QImage& image)
+{
+	const auto px = luminance(image, 9, 8);
+	if(px.empty())
+		return 0;
+
+	uint64_t hash = 0;
+	for(int y = 0; y < 8; ++y) {
+		for(int x = 0; x < 8; ++x) {
+			if(px[static_cast<size_t>(y * 9 + x)] > px[static_cast<size_t>(y * 9 + x + 1)])
+				hash |= uint64_t(1) << (y * 8 + x);
+		}
+	}
+	return hash;
+}
+
+uint64_t util::phash(const QImage& image)
+{
+	constexpr int n = phash_source_size;
+	constexpr int k = 8; // frequencies kept in each direction
+
+	const auto px = luminance(image, n, n);
+	if(px.empty())
+		return 0;
+
+	// DCT-II basis of the lowest k frequencies
+	static const auto basis = []{
+		std::array<float, k * n> b;
+		const double pi = std::acos(-1.0);
+		for(int u = 0; u < k; ++u) {
+			for(int x = 0; x < n; ++x)
+				b[static_cast<size_t>(u * n + x)] = static_cast<float>(std::cos((2 * x + 1) * u * pi / (2 * n)));
+		}
+		return b;
+	}();
+
+	// separable transform, rows then columns, only low frequencies are computed
+	std::array<float, n * k> rows;
+	for(int y = 0; y < n; ++y) {
+		for(int u = 0; u < k; ++u) {
+			float sum = 0;
+			for(int x = 0; x < n; ++x)
+				sum += px[static_cast<size_t>(y * n + x)] * basis[static_cast<size_t>(u * n + x)];
+			rows[static_cast<size_t>(y * k + u)] = sum;
+		}
+	}
+	std::array<float, k * k> coeffs;
+	for(int v = 0; v < k; ++v) {
+		for(int u = 0; u < k; ++u) {
+			float sum = 0;
+			for(int y = 0; y < n; ++y)
+				sum += rows[static_cast<size_t>(y * k + u)] * basis[static_cast<size_t>(v * n + y)];
+			coeffs[static_cast<size_t>(v * k + u)] = sum;
+		}
+	}
+
+	// NOTE: DC coefficient is average brightness, left out of the median
+	auto ac = std::vector<float>(coeffs.begin() + 1, coeffs.end());
+	std::nth_element(ac.begin(), ac.begin() + ac.size() / 2, ac.end());
+	const float median = ac[ac.size() / 2];
+
+	uint64_t hash = 0;
+	for(size_t i = 0; i < coeffs.size(); ++i) {
+		if(coeffs[i] > median)
+			hash |= uint64_t(1) << i;
+	}
+	return hash;
+}
+
+int util::hamming_distance(uint64_t a, uint64_t b)
+{
+	return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+//------------------------------------------------------------------------------
+
+constexpr int HammingIndex::blocks;
+constexpr int HammingIndex::block_bits;
+
+/// Calls \p fn with every 16-bit value at most \p distance bits away from \p value.
+template<typename F>
+static void for_each_neighbour(uint32_t value, int distance, int first_bit, F&& fn)
+{
+	fn(value);
+	if(distance == 0)
+		return;
+	for(int bit = first_bit; bit < 16; ++bit)
+		for_each_neighbour(value ^ (1u << bit), distance - 1, bit + 1, fn);
+}
+
+void HammingIndex::insert(uint64_t hash, uint32_t value)
+{
+	// NOTE: tables take 6 MiB even when empty, allocate them on first use
+	if(m_tables.empty())
+		m_tables.assign(blocks, std::vector<std::vector<uint32_t>>(size_t(1) << block_bits));
+
+	const auto index = static_cast<uint32_t>(m_hashes.size());
+	m_hashes.push_back(hash);
+	m_values.push_back(value);
+	for(int b = 0; b < blocks; ++b) {
+		const auto key = static_cast<size_t>((hash >> (b * block_bits)) & 0xFFFF);
+		m_tables[static_cast<size_t>(b)][key].push_back(index);
+	}
+}
+
+std::vector<std::pair<uint32_t, int>> HammingIndex::find(uint64_t hash, int radius) const
+{
+	std::vector<uint32_t> matches;
+	if(m_tables.empty())
+		return {};
+
+	const int block_radius = std::min(radius / blocks, block_bits);
+	for(int b = 0; b < blocks; ++b) {
+		const auto& table = m_tables[static_cast<size_t>(b)];
+		const auto key = static_cast<uint32_t>((hash >> (b * block_bits)) & 0xFFFF);
+		for_each_neighbour(key, block_radius, 0, [&](uint32_t neighbour) {
+			for(auto index : table[neighbour]) {
+				if(util::hamming_distance(hash, m_hashes[index]) <= radius)
+					matches.push_back(index);
+			}
+		});
+	}
+
+	// NOTE: hashes close in several blocks are found repeatedly
+	std::sort(matches.begin(), matches.end());
+	matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+	std::vector<std::pair<uint32_t, int>> res;
+	res.reserve(matches.size());
+	for(auto index : matches)
+		res.emplace_back(m_values[index], util::hamming_distance(hash, m_hashes[index]));
+	return res;
+}
+
+size_t HammingIndex::size() const
+{
+	return m_hashes.size();
+}
+
+void HammingIndex::clear()
+{
+	m_tables.clear();
+	m_hashes.clear();
+	m_values.clear();
+}
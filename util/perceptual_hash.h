@@ -0,0 +1,85 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_PERCEPTUAL_HASH_H
+#define UTIL_PERCEPTUAL_HASH_H
+
+/**
+ * \file perceptual_hash.h
+ * \brief Perceptual image hashes and class \ref HammingIndex
+ */
+
+#include <QImage>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/// Images are reduced to this size for \ref phash(), smaller images are hashed as well.
+constexpr int phash_source_size = 32;
+
+/*!
+ * \brief Difference hash of \p image.
+ *
+ * Each bit tells whether a pixel of the 9x8 grayscale image is brighter
+ * than its right neighbour. Cheap, robust to scaling and recompression.
+ */
+uint64_t dhash(const QImage& image);
+
+/*!
+ * \brief DCT-based perceptual hash of \p image.
+ *
+ * Each bit tells whether one of the 8x8 lowest frequencies of the 32x32
+ * grayscale image is above their median. More robust than \ref dhash()
+ * to brightness and contrast changes.
+ */
+uint64_t phash(const QImage& image);
+
+/// Number of differing bits of hashes \p a and \p b.
+int hamming_distance(uint64_t a, uint64_t b);
+
+} // namespace util
+
+/*!
+ * \brief Multi-index hash table of 64-bit hashes for queries by Hamming distance.
+ *
+ * Hashes are split into 4 blocks of 16 bits, each block indexes its own table.
+ * Two hashes at most \c r bits apart have at least one block at most \c r/4
+ * bits apart, so a query only looks into buckets of block values within
+ * \c r/4 bits of the queried hash, and checks the full distance of hashes found there.
+ *
+ * Unlike a BK-tree, query time does not grow with the distance between
+ * unrelated hashes, a query with radius 8 over a million hashes takes well
+ * under a millisecond.
+ */
+class HammingIndex
+{
+public:
+	/// Add \p hash with associated \p value, equal hashes may be added repeatedly.
+	void insert(uint64_t hash, uint32_t value);
+
+	/// Values with hashes at most \p radius bits away from \p hash, with their distance.
+	std::vector<std::pair<uint32_t, int>> find(uint64_t hash, int radius) const;
+
+	/// Number of hashes in index.
+	size_t size() const;
+
+	/// Remove all hashes.
+	void clear();
+
+private:
+	static constexpr int blocks = 4;
+	static constexpr int block_bits = 64 / blocks;
+
+	/// Indices into \p m_hashes and \p m_values, by block value, for each block.
+	std::vector<std::vector<std::vector<uint32_t>>> m_tables;
+	std::vector<uint64_t> m_hashes;
+	std::vector<uint32_t> m_values;
+};
+
+#endif // UTIL_PERCEPTUAL_HASH_H
@@ -0,0 +1,108 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "prefetch_planner.h"
+#include <algorithm>
+#include <cmath>
+
+/// Files further than this are never prefetched, on either side.
+static constexpr int max_depth = 64;
+
+/// Navigation pauses longer than this end the current streak.
+static constexpr double idle_interval_ms = 3000.0;
+
+/// Lookahead should cover this much time of navigation at current speed.
+static constexpr double horizon_s = 2.0;
+
+/// Weight of the newest interval in its moving average.
+static constexpr double interval_smoothing = 0.3;
+
+/// Number of steps in one direction after which the opposite side is reduced to one file.
+static constexpr int min_streak = 3;
+
+PrefetchPlanner::PrefetchPlanner()
+{
+	m_timer.invalidate();
+}
+
+void PrefetchPlanner::navigated(int direction)
+{
+	const double elapsed_ms = m_timer.isValid() ? m_timer.restart() : idle_interval_ms;
+	if(!m_timer.isValid())
+		m_timer.start();
+
+	if(direction == 0 || direction != m_direction || elapsed_ms >= idle_interval_ms) {
+		m_direction = direction;
+		m_streak = direction != 0 ? 1 : 0;
+		m_interval_ms = 0.0;
+		return;
+	}
+
+	++m_streak;
+	if(m_interval_ms <= 0.0) {
+		m_interval_ms = elapsed_ms;
+	} else {
+		m_interval_ms += interval_smoothing * (elapsed_ms - m_interval_ms);
+	}
+}
+
+void PrefetchPlanner::setBaseDepth(int depth)
+{
+	m_base_depth = std::max(std::min(depth, max_depth), 1);
+}
+
+void PrefetchPlanner::setThroughput(double images_per_second)
+{
+	m_throughput = std::max(images_per_second, 0.0);
+}
+
+void PrefetchPlanner::setMemory(size_t capacity, size_t bytes_per_image)
+{
+	m_capacity = capacity;
+	m_bytes_per_image = bytes_per_image;
+}
+
+double PrefetchPlanner::velocity() const
+{
+	if(m_direction == 0 || m_streak < 2 || m_interval_ms <= 0.0)
+		return 0.0;
+	if(m_timer.isValid() && m_timer.elapsed() >= idle_interval_ms)
+		return 0.0;
+	return 1000.0 / std::max(m_interval_ms, 1.0);
+}
+
+PrefetchPlanner::Plan PrefetchPlanner::plan() const
+{
+	Plan res;
+	res.ahead = res.behind = m_base_depth;
+
+	const double speed = velocity();
+	if(speed > 0.0) {
+		res.direction = m_direction;
+
+		// cover the horizon at current speed, but no more than the cache can decode in that time
+		int ahead = static_cast<int>(std::ceil(speed * horizon_s));
+		if(m_throughput > 0.0)
+			ahead = std::min(ahead, static_cast<int>(std::ceil(m_throughput * horizon_s)));
+		res.ahead = std::max(ahead, m_base_depth);
+
+		if(m_streak >= min_streak)
+			res.behind = 1;
+	}
+	res.ahead = std::min(res.ahead, max_depth);
+
+	if(m_capacity && m_bytes_per_image) {
+		// current image is in cache too
+		const size_t fit = m_capacity / m_bytes_per_image;
+		const int max_total = static_cast<int>(std::min<size_t>(fit > 1 ? fit - 1 : 0, max_depth * 2));
+		if(res.ahead + res.behind > max_total) {
+			res.behind = std::min(res.behind, max_total / 4);
+			res.ahead = std::max(max_total - res.behind, 1);
+		}
+	}
+	return res;
+}
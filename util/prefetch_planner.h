@@ -0,0 +1,87 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef PREFETCH_PLANNER_H
+#define PREFETCH_PLANNER_H
+
+/**
+ * \file prefetch_planner.h
+ * \brief Class \ref PrefetchPlanner
+ */
+
+#include <QElapsedTimer>
+#include <cstddef>
+
+/*!
+ * \brief Decides how many files to prefetch around the current one.
+ *
+ * Tracks direction and speed of sequential navigation. While the user keeps
+ * moving in one direction, lookahead grows with navigation speed and the
+ * opposite side shrinks to a single file. Lookahead is capped by the number
+ * of images the cache can decode within the prefetch horizon and by the
+ * number of images that fit into its capacity.
+ *
+ * Without a consistent direction both sides use the configured base depth.
+ */
+class PrefetchPlanner
+{
+public:
+	/// Number of files to prefetch on each side of the current file.
+	struct Plan
+	{
+		/// Files to prefetch in \p direction of travel.
+		int ahead  = 0;
+
+		/// Files to prefetch in the opposite direction.
+		int behind = 0;
+
+		/// Direction of travel, \c +1 for forward, \c -1 for backward.
+		int direction = +1;
+	};
+
+	PrefetchPlanner();
+
+	/*!
+	 * \brief Record navigation to another file.
+	 * \param direction \c +1 or \c -1 for sequential steps, \c 0 for jumps.
+	 */
+	void   navigated(int direction);
+
+	/// Set depth used on both sides when there is no direction of travel.
+	void   setBaseDepth(int depth);
+
+	/*!
+	 * \brief Set measured decode throughput of the cache.
+	 * \param images_per_second Images decoded per second by all threads, \c 0 if unknown.
+	 */
+	void   setThroughput(double images_per_second);
+
+	/*!
+	 * \brief Set memory constraints of the cache.
+	 * \param capacity Cache capacity in bytes.
+	 * \param bytes_per_image Expected size of one cached image in bytes.
+	 */
+	void   setMemory(size_t capacity, size_t bytes_per_image);
+
+	/// Navigation speed in files per second, \c 0 if not moving sequentially.
+	double velocity() const;
+
+	/// Prefetch plan for the current navigation state.
+	Plan   plan() const;
+
+private:
+	QElapsedTimer m_timer;
+	double m_interval_ms     = 0.0;
+	double m_throughput      = 0.0;
+	size_t m_capacity        = 0;
+	size_t m_bytes_per_image = 0;
+	int    m_base_depth      = 1;
+	int    m_direction       = 0;
+	int    m_streak          = 0;
+};
+
+#endif // PREFETCH_PLANNER_H
@@ -0,0 +1,250 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef QUEUE_AWARE_CACHE_H
+#define QUEUE_AWARE_CACHE_H
+
+/**
+ * \file queue_aware_cache.h
+ * \brief Class \ref QueueAwareCache
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*!
+ * \brief Cache of owned objects that evicts by distance from current position in queue.
+ *
+ * Interface follows \c QCache, but instead of evicting least recently used
+ * objects, each object is scored by distance of its key from current queue
+ * position, see \ref setPositions(). Keys behind the direction of navigation
+ * count as further away than keys ahead of it, and a small recency term
+ * breaks ties between objects at similar distance. Objects with unknown
+ * position are the first to go, in least recently used order.
+ *
+ * Objects of current key and its immediate neighbours are never evicted in
+ * favor of other objects. A new object that would be evicted first is not
+ * inserted at all.
+ *
+ * \note Not thread-safe, except that concurrent calls to \ref object() are allowed.
+ */
+template<class Key, class T>
+class QueueAwareCache
+{
+public:
+	/// Keys this close to current position are protected from eviction.
+	static constexpr int protected_distance = 1;
+
+	/// Distance of keys against direction of navigation is multiplied by this.
+	static constexpr double behind_weight = 2.0;
+
+	/// Score of object not used for this many navigation steps grows as if it was one position further.
+	static constexpr double recency_steps = 4.0;
+
+	explicit QueueAwareCache(int max_cost = 100) : m_max_cost(max_cost) { }
+	~QueueAwareCache() = default;
+
+	// disable copy and move
+	QueueAwareCache(const QueueAwareCache&) = delete;
+	QueueAwareCache& operator=(const QueueAwareCache&) = delete;
+
+	/// Maximum total cost of objects.
+	int  maxCost() const { return m_max_cost; }
+
+	/// Set maximum total cost of objects, evicting objects if it is exceeded.
+	void setMaxCost(int max_cost)
+	{
+		m_max_cost = max_cost;
+		trim(nullptr);
+	}
+
+	/// Total cost of objects in cache.
+	int  totalCost() const { return m_total_cost; }
+
+	/// Number of objects in cache.
+	int  count() const { return static_cast<int>(m_nodes.size()); }
+
+	/// Is there an object of \p key.
+	bool contains(const Key& key) const { return m_nodes.count(key) != 0; }
+
+	/// Object of \p key or null, marks the object as used.
+	T* object(const Key& key) const
+	{
+		const auto it = m_nodes.find(key);
+		if(it == m_nodes.end())
+			return nullptr;
+		it->second.last_used.store(m_epoch, std::memory_order_relaxed);
+		return it->second.object.get();
+	}
+
+	/*!
+	 * \brief Insert \p object of \p key, replacing previous object of \p key.
+	 * \return False if \p object is too costly or would be evicted right away, it is deleted then.
+	 *
+	 * Cache takes ownership of \p object even if it was not inserted.
+	 */
+	bool insert(const Key& key, T* object, int cost = 1)
+	{
+		std::unique_ptr<T> owned{object};
+		remove(key);
+		if(cost > m_max_cost)
+			return false;
+
+		m_nodes.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+		                std::forward_as_tuple(std::move(owned), cost, m_epoch));
+		m_total_cost += cost;
+		return trim(&key);
+	}
+
+	/// Remove object of \p key from cache without deleting it, null if there is none.
+	T* take(const Key& key)
+	{
+		const auto it = m_nodes.find(key);
+		if(it == m_nodes.end())
+			return nullptr;
+		m_total_cost -= it->second.cost;
+		T* object = it->second.object.release();
+		m_nodes.erase(it);
+		return object;
+	}
+
+	/// Delete object of \p key, returns false if there is none.
+	bool remove(const Key& key)
+	{
+		std::unique_ptr<T> object{take(key)};
+		return object != nullptr;
+	}
+
+	/// Delete all objects, positions are kept.
+	void clear()
+	{
+		m_nodes.clear();
+		m_total_cost = 0;
+	}
+
+	/*!
+	 * \brief Set position of keys relative to current one, used to choose objects to evict.
+	 * \param offsets Signed queue distance of keys from current one, \c 0 for current key.
+	 * \param direction Direction of navigation, \c +1 forward, \c -1 backward or \c 0 if unknown.
+	 *
+	 * Keys not in \p offsets are treated as far away. Each call counts as a navigation step
+	 * for the recency term.
+	 */
+	void setPositions(std::unordered_map<Key, int>&& offsets, int direction)
+	{
+		m_offsets = std::move(offsets);
+		m_direction = direction;
+		++m_epoch;
+	}
+
+	/// Set position of single \p key, as in \ref setPositions().
+	void setPosition(const Key& key, int offset)
+	{
+		m_offsets[key] = offset;
+	}
+
+private:
+	struct Node
+	{
+		Node(std::unique_ptr<T>&& obj, int c, uint64_t epoch) :
+		        object(std::move(obj)), cost(c), last_used(epoch) { }
+
+		std::unique_ptr<T> object;
+		int                cost;
+		mutable std::atomic<uint64_t> last_used; ///< Navigation step object was last used at.
+	};
+
+	/*!
+	 * Eviction score of object of \p key, larger is evicted first. Negative if object is protected.
+	 * Keys with unknown position are at \p far_distance.
+	 */
+	double score(const Key& key, const Node& node, double far_distance) const
+	{
+		const auto age = static_cast<double>(m_epoch - node.last_used.load(std::memory_order_relaxed));
+		const auto it = m_offsets.find(key);
+		if(it == m_offsets.end())
+			return far_distance + age / recency_steps;
+
+		const int offset = it->second;
+		if(std::abs(offset) <= protected_distance)
+			return -1.0;
+
+		const bool behind = m_direction != 0 && (offset > 0) != (m_direction > 0);
+		return std::abs(offset) * (behind ? behind_weight : 1.0) + age / recency_steps;
+	}
+
+	/// Distance of keys with unknown position, further than any known one.
+	double far_distance() const
+	{
+		int max_offset = 0;
+		for(const auto& o : m_offsets)
+			max_offset = std::max(max_offset, std::abs(o.second));
+		return (max_offset + 1) * behind_weight;
+	}
+
+	/*!
+	 * Evicts objects with highest score until total cost fits into maximum cost.
+	 * Returns false if object of \p inserted was evicted.
+	 */
+	bool trim(const Key* inserted)
+	{
+		if(m_total_cost <= m_max_cost)
+			return true;
+
+		const double far = far_distance();
+		std::vector<std::pair<double, const Key*>> scored;
+		scored.reserve(m_nodes.size());
+		for(const auto& n : m_nodes)
+			scored.emplace_back(score(n.first, n.second, far), &n.first);
+		std::sort(scored.begin(), scored.end(), [](const auto& a, const auto& b)
+		{
+			return a.first > b.first;
+		});
+
+		// NOTE: protected objects go only if there is nothing else, but never the inserted one
+		std::vector<Key> evict;
+		int total_cost = m_total_cost;
+		for(const auto& s : scored) {
+			if(total_cost <= m_max_cost)
+				break;
+			if(inserted && *s.second == *inserted) {
+				if(s.first < 0)
+					continue;
+				// cache fit before insertion, other objects need not go for an object that is not kept
+				const Key key = *inserted;
+				remove(key);
+				return false;
+			}
+			evict.push_back(*s.second);
+			total_cost -= m_nodes.find(*s.second)->second.cost;
+		}
+
+		for(const auto& key : evict)
+			remove(key);
+		return true;
+	}
+
+	std::unordered_map<Key, Node> m_nodes;
+	std::unordered_map<Key, int>  m_offsets;
+	uint64_t m_epoch = 0;
+	int      m_direction = 0;
+	int      m_max_cost;
+	int      m_total_cost = 0;
+};
+
+template<class Key, class T> constexpr int    QueueAwareCache<Key, T>::protected_distance;
+template<class Key, class T> constexpr double QueueAwareCache<Key, T>::behind_weight;
+template<class Key, class T> constexpr double QueueAwareCache<Key, T>::recency_steps;
+
+#endif // QUEUE_AWARE_CACHE_H
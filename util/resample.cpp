@@ -0,0 +1,522 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "resample.h"
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define WT_RESAMPLE_SSE2 1
+	#include <emmintrin.h>
+	#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		#define WT_RESAMPLE_AVX2 1
+		#include <immintrin.h>
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define WT_RESAMPLE_NEON 1
+	#include <arm_neon.h>
+#endif
+
+using namespace util::resample;
+
+namespace {
+
+/// Destination images smaller than this many rows per thread are not split further.
+constexpr int min_rows_per_thread = 32;
+
+/// Filter weights for one dimension.
+struct Coefficients
+{
+	/// Maximum number of taps per output pixel.
+	int window = 0;
+
+	/// Pairs of first source pixel index and number of taps, per output pixel.
+	std::vector<int> bounds;
+
+	/// Normalized weights, \a window entries per output pixel.
+	std::vector<float> weights;
+};
+
+double box_filter(double x)
+{
+	return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+}
+
+double sinc(double x)
+{
+	constexpr double pi = 3.14159265358979323846;
+	if(x == 0.0)
+		return 1.0;
+	x *= pi;
+	return std::sin(x) / x;
+}
+
+double lanczos3_filter(double x)
+{
+	return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+/*!
+ * \brief Precomputes weights for resampling \p in_size pixels into \p out_size pixels.
+ *
+ * When reducing, filter support is widened by the scale factor so that every
+ * source pixel contributes to the result.
+ */
+Coefficients compute_coefficients(int in_size, int out_size, Filter filter)
+{
+	const double radius = (filter == Filter::Box) ? 0.5 : 3.0;
+	const auto filter_fn = (filter == Filter::Box) ? box_filter : lanczos3_filter;
+
+	const double scale = static_cast<double>(in_size) / out_size;
+	const double filter_scale = std::max(scale, 1.0);
+	const double support = radius * filter_scale;
+	const double inv_filter_scale = 1.0 / filter_scale;
+
+	Coefficients c;
+	c.window = static_cast<int>(std::ceil(support)) * 2 + 1;
+	c.bounds.resize(static_cast<size_t>(out_size) * 2);
+	c.weights.assign(static_cast<size_t>(out_size) * c.window, 0.0f);
+
+	std::vector<double> w(c.window);
+	for(int i = 0; i < out_size; ++i) {
+		const double center = (i + 0.5) * scale;
+		int first = std::max(static_cast<int>(center - support + 0.5), 0);
+		int last  = std::min(static_cast<int>(center + support + 0.5), in_size);
+		int count = std::min(last - first, c.window);
+
+		for(int k = 0; k < count; ++k)
+			w[k] = filter_fn((first + k - center + 0.5) * inv_filter_scale);
+
+		// skip taps that do not contribute to the result
+		int lead = 0;
+		while(lead < count && w[lead] == 0.0)
+			++lead;
+		while(count > lead && w[count - 1] == 0.0)
+			--count;
+
+		double total = 0.0;
+		for(int k = lead; k < count; ++k)
+			total += w[k];
+
+		float* out = &c.weights[static_cast<size_t>(i) * c.window];
+		if(total == 0.0) {
+			// degenerate case, fall back to nearest pixel
+			first = std::min(static_cast<int>(center), in_size - 1);
+			count = 1;
+			out[0] = 1.0f;
+		} else {
+			for(int k = lead; k < count; ++k)
+				out[k - lead] = static_cast<float>(w[k] / total);
+			first += lead;
+			count -= lead;
+		}
+		c.bounds[2*i]   = first;
+		c.bounds[2*i+1] = count;
+	}
+	return c;
+}
+
+/// Filters source row horizontally into \p dst, 4 floats (B, G, R, A) per output pixel.
+using horizontal_fn = void(*)(const uint32_t* src, const Coefficients& c, int out_width, float* dst);
+
+/// Filters \p count rows of \p width pixels vertically and packs the result into \p dst.
+using vertical_fn = void(*)(const float* const* rows, const float* weights, int count, int width, uint32_t* dst);
+
+/// Set of resampling kernels for one instruction set.
+struct Kernels
+{
+	horizontal_fn horizontal;
+	vertical_fn   vertical;
+	const char*   name;
+};
+
+//------------------------------------------------------------------------------
+// Scalar
+
+#if !defined(WT_RESAMPLE_SSE2) && !defined(WT_RESAMPLE_NEON)
+
+void horizontal_scalar(const uint32_t* src, const Coefficients& c, int out_width, float* dst)
+{
+	for(int x = 0; x < out_width; ++x) {
+		const uint32_t* s = src + c.bounds[2*x];
+		const int count   = c.bounds[2*x+1];
+		const float* w    = &c.weights[static_cast<size_t>(x) * c.window];
+
+		float b = 0.0f, g = 0.0f, r = 0.0f, a = 0.0f;
+		for(int k = 0; k < count; ++k) {
+			const uint32_t px = s[k];
+			b += w[k] * static_cast<float>(px & 0xff);
+			g += w[k] * static_cast<float>((px >> 8) & 0xff);
+			r += w[k] * static_cast<float>((px >> 16) & 0xff);
+			a += w[k] * static_cast<float>(px >> 24);
+		}
+		dst[4*x+0] = b;
+		dst[4*x+1] = g;
+		dst[4*x+2] = r;
+		dst[4*x+3] = a;
+	}
+}
+
+inline uint32_t clamp_channel(float v, float max)
+{
+	return static_cast<uint32_t>(std::min(std::max(v, 0.0f), max) + 0.5f);
+}
+
+void vertical_scalar(const float* const* rows, const float* w, int count, int width, uint32_t* dst)
+{
+	for(int x = 0; x < width; ++x) {
+		float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		for(int k = 0; k < count; ++k) {
+			const float* p = rows[k] + 4*x;
+			for(int i = 0; i < 4; ++i)
+				acc[i] += w[k] * p[i];
+		}
+		// premultiplied color must not exceed alpha
+		const uint32_t a = clamp_channel(acc[3], 255.0f);
+		const float max = static_cast<float>(a);
+		dst[x] = (a << 24)
+		       | (clamp_channel(acc[2], max) << 16)
+		       | (clamp_channel(acc[1], max) << 8)
+		       |  clamp_channel(acc[0], max);
+	}
+}
+
+#endif // scalar
+
+//------------------------------------------------------------------------------
+// SSE2
+
+#ifdef WT_RESAMPLE_SSE2
+
+inline __m128 load_pixel_sse2(uint32_t px)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_cvtsi32_si128(static_cast<int>(px));
+	v = _mm_unpacklo_epi8(v, zero);
+	v = _mm_unpacklo_epi16(v, zero);
+	return _mm_cvtepi32_ps(v);
+}
+
+inline uint32_t pack_pixel_sse2(__m128 acc)
+{
+	__m128 alpha = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_min_ps(alpha, _mm_set1_ps(255.0f));
+	acc = _mm_max_ps(_mm_min_ps(acc, alpha), _mm_setzero_ps());
+	__m128i v = _mm_cvtps_epi32(acc);
+	v = _mm_packs_epi32(v, v);
+	v = _mm_packus_epi16(v, v);
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+void horizontal_sse2(const uint32_t* src, const Coefficients& c, int out_width, float* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for(int x = 0; x < out_width; ++x) {
+		const uint32_t* s = src + c.bounds[2*x];
+		const int count   = c.bounds[2*x+1];
+		const float* w    = &c.weights[static_cast<size_t>(x) * c.window];
+
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		int k = 0;
+		for(; k + 1 < count; k += 2) {
+			// two pixels per iteration
+			const __m128i two = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + k)), zero);
+			const __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(two, zero));
+			const __m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(two, zero));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(p0, _mm_set1_ps(w[k])));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(p1, _mm_set1_ps(w[k+1])));
+		}
+		if(k < count)
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(load_pixel_sse2(s[k]), _mm_set1_ps(w[k])));
+
+		_mm_storeu_ps(dst + 4*x, _mm_add_ps(acc0, acc1));
+	}
+}
+
+void vertical_sse2(const float* const* rows, const float* w, int count, int width, uint32_t* dst)
+{
+	int x = 0;
+	for(; x + 1 < width; x += 2) {
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for(int k = 0; k < count; ++k) {
+			const __m128 wk = _mm_set1_ps(w[k]);
+			const float* p = rows[k] + 4*x;
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(p), wk));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(p + 4), wk));
+		}
+		dst[x]   = pack_pixel_sse2(acc0);
+		dst[x+1] = pack_pixel_sse2(acc1);
+	}
+	for(; x < width; ++x) {
+		__m128 acc = _mm_setzero_ps();
+		for(int k = 0; k < count; ++k)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(rows[k] + 4*x), _mm_set1_ps(w[k])));
+		dst[x] = pack_pixel_sse2(acc);
+	}
+}
+
+#endif // WT_RESAMPLE_SSE2
+
+//------------------------------------------------------------------------------
+// AVX2, selected at runtime
+
+#ifdef WT_RESAMPLE_AVX2
+
+__attribute__((target("avx2,fma")))
+void horizontal_avx2(const uint32_t* src, const Coefficients& c, int out_width, float* dst)
+{
+	for(int x = 0; x < out_width; ++x) {
+		const uint32_t* s = src + c.bounds[2*x];
+		const int count   = c.bounds[2*x+1];
+		const float* w    = &c.weights[static_cast<size_t>(x) * c.window];
+
+		__m256 acc = _mm256_setzero_ps();
+		int k = 0;
+		for(; k + 1 < count; k += 2) {
+			// two pixels per iteration, one in each 128-bit lane
+			const __m128i two = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + k));
+			const __m256 px = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(two));
+			const __m256 wk = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(w[k])),
+			                                       _mm_set1_ps(w[k+1]), 1);
+			acc = _mm256_fmadd_ps(px, wk, acc);
+		}
+		__m128 res = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		if(k < count) {
+			const __m128i one = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(s[k])));
+			res = _mm_fmadd_ps(_mm_cvtepi32_ps(one), _mm_set1_ps(w[k]), res);
+		}
+		_mm_storeu_ps(dst + 4*x, res);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+void vertical_avx2(const float* const* rows, const float* w, int count, int width, uint32_t* dst)
+{
+	const __m256 max_alpha = _mm256_set1_ps(255.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	int x = 0;
+	for(; x + 3 < width; x += 4) {
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		for(int k = 0; k < count; ++k) {
+			const __m256 wk = _mm256_set1_ps(w[k]);
+			const float* p = rows[k] + 4*x;
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(p), wk, acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(p + 8), wk, acc1);
+		}
+		const __m256 alpha0 = _mm256_min_ps(_mm256_permute_ps(acc0, 0xff), max_alpha);
+		const __m256 alpha1 = _mm256_min_ps(_mm256_permute_ps(acc1, 0xff), max_alpha);
+		acc0 = _mm256_max_ps(_mm256_min_ps(acc0, alpha0), zero);
+		acc1 = _mm256_max_ps(_mm256_min_ps(acc1, alpha1), zero);
+
+		// packs operate within 128-bit lanes, so lane 0 ends up with p0 p2 and lane 1 with p1 p3
+		__m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(acc0), _mm256_cvtps_epi32(acc1));
+		v = _mm256_packus_epi16(v, v);
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(v));
+	}
+	for(; x < width; ++x) {
+		__m128 acc = _mm_setzero_ps();
+		for(int k = 0; k < count; ++k)
+			acc = _mm_fmadd_ps(_mm_loadu_ps(rows[k] + 4*x), _mm_set1_ps(w[k]), acc);
+		dst[x] = pack_pixel_sse2(acc);
+	}
+}
+
+#endif // WT_RESAMPLE_AVX2
+
+//------------------------------------------------------------------------------
+// NEON
+
+#ifdef WT_RESAMPLE_NEON
+
+inline float32x4_t load_pixel_neon(uint32_t px)
+{
+	const uint16x8_t h = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(px)));
+	return vcvtq_f32_u32(vmovl_u16(vget_low_u16(h)));
+}
+
+inline uint32_t pack_pixel_neon(float32x4_t acc)
+{
+	const float alpha = std::min(vgetq_lane_f32(acc, 3), 255.0f);
+	acc = vmaxq_f32(vminq_f32(acc, vdupq_n_f32(alpha)), vdupq_n_f32(0.0f));
+	const uint32x4_t u = vcvtq_u32_f32(vaddq_f32(acc, vdupq_n_f32(0.5f)));
+	const uint16x4_t h = vmovn_u32(u);
+	const uint8x8_t b = vmovn_u16(vcombine_u16(h, h));
+	return vget_lane_u32(vreinterpret_u32_u8(b), 0);
+}
+
+void horizontal_neon(const uint32_t* src, const Coefficients& c, int out_width, float* dst)
+{
+	for(int x = 0; x < out_width; ++x) {
+		const uint32_t* s = src + c.bounds[2*x];
+		const int count   = c.bounds[2*x+1];
+		const float* w    = &c.weights[static_cast<size_t>(x) * c.window];
+
+		float32x4_t acc = vdupq_n_f32(0.0f);
+		for(int k = 0; k < count; ++k)
+			acc = vmlaq_n_f32(acc, load_pixel_neon(s[k]), w[k]);
+		vst1q_f32(dst + 4*x, acc);
+	}
+}
+
+void vertical_neon(const float* const* rows, const float* w, int count, int width, uint32_t* dst)
+{
+	for(int x = 0; x < width; ++x) {
+		float32x4_t acc = vdupq_n_f32(0.0f);
+		for(int k = 0; k < count; ++k)
+			acc = vmlaq_n_f32(acc, vld1q_f32(rows[k] + 4*x), w[k]);
+		dst[x] = pack_pixel_neon(acc);
+	}
+}
+
+#endif // WT_RESAMPLE_NEON
+
+//------------------------------------------------------------------------------
+
+Kernels select_kernels()
+{
+#ifdef WT_RESAMPLE_AVX2
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return {horizontal_avx2, vertical_avx2, "AVX2"};
+#endif
+#if defined(WT_RESAMPLE_SSE2)
+	return {horizontal_sse2, vertical_sse2, "SSE2"};
+#elif defined(WT_RESAMPLE_NEON)
+	return {horizontal_neon, vertical_neon, "NEON"};
+#else
+	return {horizontal_scalar, vertical_scalar, "scalar"};
+#endif
+}
+
+const Kernels& kernels()
+{
+	static const Kernels k = select_kernels();
+	return k;
+}
+
+/*!
+ * \brief Resamples destination rows in range [\p y_begin, \p y_end).
+ *
+ * Horizontally filtered source rows are kept in a ring buffer of
+ * \a Coefficients::window rows, each source row is filtered only once.
+ */
+void resample_rows(const uint32_t* src, int src_stride,
+                   uint32_t* dst, int dst_width, int dst_stride,
+                   const Coefficients& ch, const Coefficients& cv,
+                   int y_begin, int y_end)
+{
+	const auto& k = kernels();
+	const int ring = cv.window;
+	const size_t row_floats = static_cast<size_t>(dst_width) * 4;
+
+	std::vector<float> buffer(static_cast<size_t>(ring) * row_floats);
+	std::vector<const float*> rows(ring);
+
+	int next_row = 0;
+	for(int y = y_begin; y < y_end; ++y) {
+		const int first = cv.bounds[2*y];
+		const int count = cv.bounds[2*y+1];
+
+		next_row = std::max(next_row, first);
+		for(; next_row < first + count; ++next_row) {
+			k.horizontal(src + static_cast<size_t>(next_row) * src_stride, ch, dst_width,
+			             &buffer[static_cast<size_t>(next_row % ring) * row_floats]);
+		}
+		for(int i = 0; i < count; ++i)
+			rows[i] = &buffer[static_cast<size_t>((first + i) % ring) * row_floats];
+
+		k.vertical(rows.data(), &cv.weights[static_cast<size_t>(y) * cv.window], count, dst_width,
+		           dst + static_cast<size_t>(y) * dst_stride);
+	}
+}
+
+} // namespace
+
+Filter util::resample::filter_for(QSize from, QSize to)
+{
+	if(from.width() > to.width() * 2 || from.height() > to.height() * 2)
+		return Filter::Box;
+	return Filter::Lanczos3;
+}
+
+void util::resample::resample_argb32(const uint32_t *src, int src_width, int src_height, int src_stride,
+                                     uint32_t *dst, int dst_width, int dst_height, int dst_stride,
+                                     Filter filter, int threads)
+{
+	if(src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0)
+		return;
+
+	const auto ch = compute_coefficients(src_width, dst_width, filter);
+	const auto cv = compute_coefficients(src_height, dst_height, filter);
+
+	if(threads <= 0)
+		threads = QThread::idealThreadCount();
+	threads = std::max(1, std::min(threads, dst_height / min_rows_per_thread));
+
+	const int chunk = (dst_height + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	int y = chunk;
+	for(; y < dst_height && static_cast<int>(workers.size()) < threads - 1; y += chunk) {
+		const int y_end = std::min(y + chunk, dst_height);
+		try {
+			workers.emplace_back(resample_rows, src, src_stride, dst, dst_width, dst_stride,
+			                     std::cref(ch), std::cref(cv), y, y_end);
+		} catch(const std::system_error&) {
+			// could not start a thread, process remaining rows here
+			break;
+		}
+	}
+	resample_rows(src, src_stride, dst, dst_width, dst_stride, ch, cv, 0, std::min(chunk, dst_height));
+	if(y < dst_height)
+		resample_rows(src, src_stride, dst, dst_width, dst_stride, ch, cv, y, dst_height);
+
+	for(auto& t : workers)
+		t.join();
+}
+
+QImage util::resample::scaled(const QImage &image, QSize size, Filter filter, int threads)
+{
+	if(image.isNull() || size.isEmpty())
+		return QImage();
+
+	const auto format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+	                                            : QImage::Format_RGB32;
+	const QImage src = image.convertToFormat(format);
+	if(src.size() == size)
+		return src;
+
+	QImage dst(size, format);
+	if(dst.isNull()) // allocation failed
+		return dst;
+
+	resample_argb32(reinterpret_cast<const uint32_t*>(src.constBits()),
+	                src.width(), src.height(), src.bytesPerLine() / 4,
+	                reinterpret_cast<uint32_t*>(dst.bits()),
+	                dst.width(), dst.height(), dst.bytesPerLine() / 4,
+	                filter, threads);
+	dst.setDevicePixelRatio(image.devicePixelRatio());
+	return dst;
+}
+
+QImage util::resample::scaled(const QImage &image, QSize size, int threads)
+{
+	return scaled(image, size, filter_for(image.size(), size), threads);
+}
+
+const char* util::resample::kernel_name()
+{
+	return kernels().name;
+}
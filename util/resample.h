@@ -0,0 +1,83 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+/**
+ * @file resample.h
+ * @brief High-quality image resampling
+ */
+
+#ifndef UTIL_RESAMPLE_H
+#define UTIL_RESAMPLE_H
+
+#include <QImage>
+#include <QSize>
+#include <stdint.h>
+
+namespace util {
+
+/**
+ * @namespace util::resample
+ * @brief Separable image resampler with SIMD kernels.
+ *
+ * Images are resampled in premultiplied 32-bit format in two passes
+ * (horizontal, then vertical) using a sliding window of intermediate rows,
+ * so memory use does not depend on the source image height.
+ *
+ * SSE2 kernels are always used on x86-64, AVX2 kernels are selected at
+ * runtime when supported by CPU, and NEON kernels are used on ARM.
+ */
+namespace resample {
+
+	/// Resampling filter.
+	enum class Filter
+	{
+		Box,      ///< Area averaging, best for large reductions.
+		Lanczos3, ///< Lanczos windowed sinc with radius 3, sharp for small reductions and upscaling.
+	};
+
+	/*!
+	 * \brief Filter best suited for scaling from \p from size to \p to size.
+	 *
+	 * Returns \a Filter::Box when image is reduced more than twice and
+	 * \a Filter::Lanczos3 otherwise.
+	 */
+	Filter  filter_for(QSize from, QSize to);
+
+	/*!
+	 * \brief Resample \p image to \p size.
+	 * \param image Source image of any format.
+	 * \param size Target size, aspect ratio is not preserved.
+	 * \param filter Resampling filter.
+	 * \param threads Number of threads used to process rows, \c 0 for ideal thread count.
+	 * \return Image in \c Format_ARGB32_Premultiplied, or \c Format_RGB32 if
+	 *         source has no alpha channel. Device pixel ratio is preserved.
+	 */
+	QImage  scaled(const QImage& image, QSize size, Filter filter, int threads = 0);
+
+	/*!
+	 * \brief Resample \p image to \p size choosing filter automatically.
+	 * \sa filter_for()
+	 */
+	QImage  scaled(const QImage& image, QSize size, int threads = 0);
+
+	/*!
+	 * \brief Resample raw 32-bit premultiplied pixels.
+	 *
+	 * Source and destination strides are in pixels. Rows of the destination
+	 * are split between \p threads threads.
+	 */
+	void    resample_argb32(const uint32_t* src, int src_width, int src_height, int src_stride,
+	                        uint32_t* dst, int dst_width, int dst_height, int dst_stride,
+	                        Filter filter, int threads);
+
+	/// Name of the SIMD instruction set used by resampling kernels.
+	const char* kernel_name();
+
+} // namespace resample
+} // namespace util
+
+#endif // UTIL_RESAMPLE_H
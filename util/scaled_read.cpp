@@ -0,0 +1,62 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "scaled_read.h"
+#include "util/resample.h"
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QLoggingCategory>
+
+namespace logging_category {Q_LOGGING_CATEGORY(scaledread, "ScaledRead")}
+#define pdbg qCDebug(logging_category::scaledread)
+
+/// Size of \p size fitted into \p target, never larger than \p size.
+static QSize fit(QSize size, QSize target)
+{
+	if(size.width() <= target.width() && size.height() <= target.height())
+		return size;
+	return size.scaled(target, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+}
+
+/// Is \p size above \ref util::huge_image_pixels.
+static bool is_huge(QSize size)
+{
+	return static_cast<qint64>(size.width()) * size.height() > util::huge_image_pixels;
+}
+
+QImage util::read_scaled(QImageReader& reader, QSize target_size, QSize* original_size)
+{
+	// NOTE: size and scaled size are given before orientation is applied
+	const QSize raw_size = reader.size();
+	const bool transposed = reader.autoTransform()
+	        && (reader.transformation() & QImageIOHandler::TransformationRotate90);
+	const QSize oriented_size = transposed ? raw_size.transposed() : raw_size;
+
+	if(raw_size.isValid() && is_huge(raw_size) && target_size.isValid()
+	   && reader.supportsOption(QImageIOHandler::ScaledSize))
+	{
+		const QSize fitted = fit(oriented_size, target_size);
+		pdbg << "decoding" << oriented_size << "image at" << fitted;
+		reader.setScaledSize(transposed ? fitted.transposed() : fitted);
+		auto image = reader.read();
+		if(original_size)
+			*original_size = image.isNull() ? QSize() : oriented_size;
+		return image;
+	}
+
+	auto image = reader.read();
+	if(original_size)
+		*original_size = image.size();
+	if(!image.isNull() && is_huge(image.size()) && target_size.isValid()) {
+		const QSize fitted = fit(image.size(), target_size);
+		if(fitted != image.size()) {
+			pdbg << "downscaling" << image.size() << "image to" << fitted;
+			image = util::resample::scaled(image, fitted, 1);
+		}
+	}
+	return image;
+}
@@ -0,0 +1,42 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+/**
+ * @file scaled_read.h
+ * @brief Reading huge images at display size
+ */
+
+#ifndef UTIL_SCALED_READ_H
+#define UTIL_SCALED_READ_H
+
+#include <QImage>
+#include <QSize>
+
+class QImageReader;
+
+namespace util {
+
+/// Images with more pixels are not kept at full size.
+constexpr qint64 huge_image_pixels = 64ll * 1024 * 1024;
+
+/*!
+ * \brief Read image from \p reader, fitted into \p target_size if it is huge.
+ * \param reader Image reader, EXIF orientation is applied if it is set to auto transform.
+ * \param target_size Size in device pixels after orientation the image is displayed in.
+ * \param original_size Set to size of the full image after orientation, if not null.
+ * \return Decoded image, or null image on failure.
+ *
+ * Images of at most \ref huge_image_pixels are read at full size. Larger
+ * images are decoded at reduced size by formats that support it (JPEG
+ * decodes only the DCT coefficients needed), other formats are decoded
+ * fully and downscaled right away, so only the fitted image stays in memory.
+ */
+QImage read_scaled(QImageReader& reader, QSize target_size, QSize* original_size = nullptr);
+
+} // namespace util
+
+#endif // UTIL_SCALED_READ_H
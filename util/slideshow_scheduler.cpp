@@ -0,0 +1,313 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "slideshow_scheduler.h"
+#include "util/imagecache.h"
+#include "util/misc.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+namespace logging_category {
+	Q_LOGGING_CATEGORY(slideshow, "SlideshowScheduler")
+}
+#define pdbg qCDebug(logging_category::slideshow)
+#define pwarn qCWarning(logging_category::slideshow)
+
+constexpr int SlideshowScheduler::min_lookahead;
+constexpr int SlideshowScheduler::max_lookahead;
+constexpr int SlideshowScheduler::default_interval_ms;
+
+namespace {
+
+/// Time between slides advanced by user is not measured outside of these bounds.
+constexpr double min_observed_interval_ms = 100;
+constexpr double max_observed_interval_ms = 60000;
+
+/// Weight of last time between slides in estimated interval.
+constexpr double interval_smoothing = 0.25;
+
+/// Peak time to prepare a frame decays by this factor with every frame.
+constexpr double prepare_time_decay = 0.9;
+
+/// Frames prepared ahead never take more than this share of cache capacity.
+constexpr size_t cache_share_divisor = 2;
+
+} // namespace
+
+struct PrepareFrameTask : public QRunnable
+{
+	PrepareFrameTask(SlideshowScheduler* s, uint64_t g) : scheduler(s), generation(g)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		// NOTE: raising priority above normal has no effect on Linux, indexing and checking run at idle priority instead
+		scheduler->prepareThreadFunc(generation);
+	}
+
+	SlideshowScheduler* scheduler;
+	uint64_t            generation;
+};
+
+SlideshowScheduler::SlideshowScheduler()
+{
+	m_thread_pool.setMaxThreadCount(std::max(2, QThread::idealThreadCount() / 2));
+	m_slide_timer.setSingleShot(true);
+	connect(&m_slide_timer, &QTimer::timeout, this, &SlideshowScheduler::slideTimeout);
+	m_clock.start();
+}
+
+SlideshowScheduler::~SlideshowScheduler()
+{
+	stop();
+	m_thread_pool.waitForDone();
+}
+
+void SlideshowScheduler::setImageCache(ImageCache* cache)
+{
+	m_cache = cache;
+}
+
+void SlideshowScheduler::setInterval(int interval_ms)
+{
+	m_interval_ms = std::max(interval_ms, 0);
+	if(m_active && m_interval_ms > 0 && !m_holding)
+		m_slide_timer.start(m_interval_ms);
+	else if(m_interval_ms == 0)
+		m_slide_timer.stop();
+}
+
+bool SlideshowScheduler::setViewport(QSize viewport, double device_pixel_ratio, bool upscale)
+{
+	if(viewport == m_viewport && device_pixel_ratio == m_dpr && upscale == m_upscale)
+		return false;
+
+	m_viewport = viewport;
+	m_dpr = device_pixel_ratio;
+	m_upscale = upscale;
+
+	// frames of previous size are never shown
+	m_ready.clear();
+	return true;
+}
+
+void SlideshowScheduler::start()
+{
+	Q_ASSERT(m_cache != nullptr);
+	stop();
+	m_active = true;
+	m_statistics = Statistics{};
+	m_shown_at_ms = -1;
+	pdbg << "started, interval" << m_interval_ms << "ms, viewport" << m_viewport;
+}
+
+void SlideshowScheduler::stop()
+{
+	if(m_active) {
+		pdbg << "stopped:" << m_statistics.shown << "slides shown,"
+		     << m_statistics.missed << "missed deadline";
+	}
+	++m_generation;
+	m_thread_pool.clear();
+	m_slide_timer.stop();
+	m_active = false;
+	m_holding = false;
+	m_next_file.clear();
+	m_deadlines.clear();
+	m_ready.clear();
+
+	QMutexLocker _{&m_jobs_lock};
+	m_jobs.clear();
+	m_prepared.clear();
+}
+
+bool SlideshowScheduler::isActive() const
+{
+	return m_active;
+}
+
+int SlideshowScheduler::lookahead() const
+{
+	// frames needed before the slowest frame seen recently is prepared, and one spare
+	const double interval = slide_interval();
+	int count = min_lookahead + static_cast<int>(std::ceil(m_prepare_ms / interval));
+	count = std::min(count, max_lookahead);
+
+	if(m_cache != nullptr && !m_viewport.isEmpty()) {
+		const size_t frame_bytes = size_t(m_viewport.width()) * size_t(m_viewport.height()) * 4;
+		const size_t fit = m_cache->statistics().capacity / cache_share_divisor / frame_bytes;
+		count = std::min(count, std::max(static_cast<int>(fit), 1));
+	}
+	return count;
+}
+
+void SlideshowScheduler::schedule(const QStringList& upcoming)
+{
+	if(!m_active)
+		return;
+
+	const qint64 now = m_clock.elapsed();
+	const qint64 interval = slide_interval();
+	const qint64 first = (m_shown_at_ms >= 0 ? m_shown_at_ms : now) + interval;
+	const auto image_filter = util::supported_image_formats_namefilter();
+
+	m_next_file = upcoming.value(0);
+	m_deadlines.clear();
+
+	std::vector<Job> jobs;
+	jobs.reserve(static_cast<size_t>(upcoming.size()));
+	for(int i = 0; i < upcoming.size(); ++i) {
+		const auto& file = upcoming[i];
+		if(!QDir::match(image_filter, QFileInfo(file).fileName()))
+			continue;
+
+		const qint64 deadline = first + i * interval;
+		m_deadlines.insert(file, deadline);
+		if(!m_ready.contains(file))
+			jobs.push_back(Job{file, deadline, m_viewport, m_dpr, m_upscale});
+	}
+	if(m_viewport.isEmpty())
+		return;
+
+	// latest deadline first, so the earliest one is popped from back
+	std::reverse(jobs.begin(), jobs.end());
+	const int task_count = std::min(static_cast<int>(jobs.size()), m_thread_pool.maxThreadCount());
+	{
+		QMutexLocker _{&m_jobs_lock};
+		m_jobs = std::move(jobs);
+	}
+
+	// running tasks take jobs of this call too, only queued ones are replaced
+	m_thread_pool.clear();
+	for(int i = 0; i < task_count; ++i)
+		m_thread_pool.start(new PrepareFrameTask(this, m_generation.load()));
+}
+
+void SlideshowScheduler::shown(const QString& file)
+{
+	const qint64 now = m_clock.elapsed();
+	if(m_interval_ms == 0 && m_shown_at_ms >= 0) {
+		const double sample = static_cast<double>(now - m_shown_at_ms);
+		if(sample >= min_observed_interval_ms && sample <= max_observed_interval_ms) {
+			m_observed_interval_ms += interval_smoothing * (sample - m_observed_interval_ms);
+		}
+	}
+	m_shown_at_ms = now;
+	if(!m_active)
+		return;
+
+	const auto it = m_deadlines.find(file);
+	if(it != m_deadlines.end()) {
+		++m_statistics.shown;
+		// NOTE: slides advanced by user before their estimated deadline are not late
+		if(!m_ready.contains(file) && now >= it.value())
+			missed(file, now - it.value());
+		m_deadlines.erase(it);
+	}
+	m_ready.remove(file);
+	m_holding = false;
+
+	if(m_interval_ms > 0)
+		m_slide_timer.start(m_interval_ms);
+}
+
+SlideshowScheduler::Statistics SlideshowScheduler::statistics() const
+{
+	return m_statistics;
+}
+
+void SlideshowScheduler::prepareThreadFunc(uint64_t generation)
+{
+	QElapsedTimer timer;
+	while(m_generation == generation) {
+		Job job;
+		{
+			QMutexLocker _{&m_jobs_lock};
+			if(m_jobs.empty())
+				return;
+			job = std::move(m_jobs.back());
+			m_jobs.pop_back();
+		}
+
+		timer.start();
+		const bool ok = m_cache->prepareFrame(job.file, job.viewport, job.dpr, job.upscale);
+		const qint64 elapsed = timer.elapsed();
+
+		QMutexLocker _{&m_jobs_lock};
+		if(m_generation != generation)
+			return;
+		m_prepared.push_back(Prepared{job.file, m_clock.elapsed(), elapsed, ok});
+		if(m_prepared.size() == 1)
+			QMetaObject::invokeMethod(this, "applyPreparedFrames", Qt::QueuedConnection);
+	}
+}
+
+void SlideshowScheduler::applyPreparedFrames()
+{
+	std::vector<Prepared> prepared;
+	{
+		QMutexLocker _{&m_jobs_lock};
+		std::swap(prepared, m_prepared);
+	}
+	if(!m_active)
+		return; // stopped meanwhile
+
+	for(const auto& p : prepared) {
+		m_prepare_ms = std::max(static_cast<double>(p.prepare_ms), m_prepare_ms * prepare_time_decay);
+
+		const auto it = m_deadlines.find(p.file);
+		if(!p.ok || it == m_deadlines.end())
+			continue; // not an image that can be prepared, or already shown
+
+		++m_statistics.prepared;
+		m_ready.insert(p.file);
+		if(p.finished_ms > it.value())
+			missed(p.file, p.finished_ms - it.value());
+
+		if(m_holding && p.file == m_next_file) {
+			m_holding = false;
+			m_slide_timer.stop();
+			emit advance();
+		}
+	}
+}
+
+void SlideshowScheduler::slideTimeout()
+{
+	if(!m_active)
+		return;
+
+	// hold current slide for up to another interval rather than show next one loading
+	if(!m_holding && m_deadlines.contains(m_next_file) && !m_ready.contains(m_next_file)) {
+		pdbg << "holding slide, next one is not ready:" << m_next_file;
+		m_holding = true;
+		m_slide_timer.start(m_interval_ms);
+		return;
+	}
+	m_holding = false;
+	emit advance();
+}
+
+qint64 SlideshowScheduler::slide_interval() const
+{
+	return m_interval_ms > 0 ? m_interval_ms : static_cast<qint64>(m_observed_interval_ms);
+}
+
+void SlideshowScheduler::missed(const QString& file, qint64 late_ms)
+{
+	++m_statistics.missed;
+	m_statistics.max_late_ms = std::max(m_statistics.max_late_ms, late_ms);
+	pwarn << "frame missed its deadline by" << late_ms << "ms:" << file
+	      << "prepare time" << m_prepare_ms << "ms";
+	emit deadlineMissed(file, late_ms);
+}
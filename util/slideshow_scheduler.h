@@ -0,0 +1,177 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_SLIDESHOW_SCHEDULER_H
+#define UTIL_SLIDESHOW_SCHEDULER_H
+
+/**
+ * \file slideshow_scheduler.h
+ * \brief Class \ref SlideshowScheduler
+ */
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QSize>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <vector>
+
+class ImageCache;
+
+/*!
+ * \brief Prepares upcoming slides of a slide show before they are due.
+ *
+ * Each upcoming image gets a deadline, the time it is shown at, from the slide
+ * interval. Frames scaled to exactly the display size are prepared by
+ * \ref ImageCache::prepareFrame() in order of their deadlines, by threads of
+ * normal priority, ahead of indexing and integrity checking that run at idle priority.
+ *
+ * Number of upcoming slides prepared grows with time it takes to prepare them,
+ * so slow storage is read further ahead. When the next slide is not ready
+ * in time, the current one is shown for up to another interval instead of
+ * showing a partially loaded image.
+ *
+ * Frames that were not ready by their deadline are reported by \ref deadlineMissed().
+ *
+ * \note Member functions must be called from the thread the object lives in.
+ */
+class SlideshowScheduler : public QObject
+{
+	Q_OBJECT
+public:
+	/// Slides prepared ahead at least, and at most.
+	static constexpr int min_lookahead = 2;
+	static constexpr int max_lookahead = 16;
+
+	/// Interval assumed while slides are advanced by user, until it is measured.
+	static constexpr int default_interval_ms = 3000;
+
+	/// Counters of current or last slide show.
+	struct Statistics
+	{
+		int    shown = 0;       ///< Slides shown that were scheduled.
+		int    prepared = 0;    ///< Frames prepared.
+		int    missed = 0;      ///< Frames not ready by their deadline.
+		qint64 max_late_ms = 0; ///< Longest time a frame was late.
+	};
+
+	SlideshowScheduler();
+	~SlideshowScheduler() override;
+
+	/// Cache frames are prepared in, must be set before \ref start().
+	void setImageCache(ImageCache* cache);
+
+	/*!
+	 * \brief Set time each slide is shown for.
+	 * \param interval_ms Slide interval, or \c 0 if slides are advanced by user.
+	 *
+	 * Without an interval, deadlines are estimated from time between slides shown so far.
+	 */
+	void setInterval(int interval_ms);
+
+	/*!
+	 * \brief Set display area frames are prepared for.
+	 * \param viewport Size of display area in device pixels.
+	 * \param device_pixel_ratio Device pixel ratio of display.
+	 * \param upscale Are small images scaled up to fit \p viewport.
+	 * \return True if display area has changed, slides should be scheduled again then.
+	 */
+	bool setViewport(QSize viewport, double device_pixel_ratio, bool upscale);
+
+	/// Start slide show, resets statistics.
+	void start();
+
+	/// Stop slide show, drops frames not prepared yet.
+	void stop();
+
+	/// Is slide show running.
+	bool isActive() const;
+
+	/// Number of upcoming slides that should be passed to \ref schedule().
+	int lookahead() const;
+
+	/*!
+	 * \brief Prepare frames of \p upcoming files, in order they are shown after the current one.
+	 *
+	 * Files that are not images are shown as usual. Replaces files of previous call
+	 * that are not being prepared yet.
+	 */
+	void schedule(const QStringList& upcoming);
+
+	/// Record that \p file is shown now, starts interval of next slide.
+	void shown(const QString& file);
+
+	/// Counters since \ref start().
+	Statistics statistics() const;
+
+signals:
+	/// Emitted when next slide is due.
+	void advance();
+
+	/// Emitted when frame of \p file was not ready by its deadline, \p late_ms after it.
+	void deadlineMissed(const QString& file, qint64 late_ms);
+
+private slots:
+	void applyPreparedFrames();
+	void slideTimeout();
+
+private:
+	friend struct PrepareFrameTask;
+
+	/// Frame to prepare.
+	struct Job
+	{
+		QString file;
+		qint64  deadline_ms;
+		QSize   viewport;
+		double  dpr;
+		bool    upscale;
+	};
+
+	/// Frame prepared by worker thread.
+	struct Prepared
+	{
+		QString file;
+		qint64  finished_ms;
+		qint64  prepare_ms;
+		bool    ok;
+	};
+
+	void prepareThreadFunc(uint64_t generation);
+	qint64 slide_interval() const;
+	void missed(const QString& file, qint64 late_ms);
+
+	ImageCache*   m_cache = nullptr;
+	QElapsedTimer m_clock;
+	QTimer        m_slide_timer;
+	QSize         m_viewport;
+	double        m_dpr = 1.0;
+	bool          m_upscale = true;
+	bool          m_active = false;
+	bool          m_holding = false; ///< Current slide is held until next one is ready.
+	int           m_interval_ms = 0;
+	double        m_observed_interval_ms = default_interval_ms;
+	double        m_prepare_ms = 0;  ///< Peak time to prepare a frame, decaying slowly.
+	qint64        m_shown_at_ms = -1;
+	QString       m_next_file;
+	QHash<QString, qint64> m_deadlines; ///< Of scheduled files not shown yet.
+	QSet<QString> m_ready;              ///< Scheduled files with frames prepared.
+	Statistics    m_statistics;
+
+	std::atomic<uint64_t> m_generation{0};
+	QMutex                m_jobs_lock;
+	std::vector<Job>      m_jobs;     ///< Latest deadline first, guarded by \p m_jobs_lock.
+	std::vector<Prepared> m_prepared; ///< Guarded by \p m_jobs_lock.
+	QThreadPool           m_thread_pool;
+};
+
+#endif // UTIL_SLIDESHOW_SCHEDULER_H
@@ -0,0 +1,554 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#include "tag_suggester.h"
+#include "util/imageboard.h"
+#include "util/imagecache.h"
+#include "util/perceptual_hash.h"
+#include "util/resample.h"
+#include "util/strings.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+
+namespace logging_category {
+	Q_LOGGING_CATEGORY(suggester, "TagSuggester")
+}
+#define pdbg qCDebug(logging_category::suggester)
+#define pwarn qCWarning(logging_category::suggester)
+
+constexpr int      ImageDescriptor::histogram_bins;
+constexpr int      TagSuggester::default_neighbours;
+constexpr int      TagSuggester::min_votes;
+constexpr uint32_t TagSuggester::not_an_image;
+
+/// Number of files indexed by single task.
+static constexpr size_t task_size = 64;
+
+/// Files are decoded at this size for indexing, decoders skip most of the work at reduced sizes.
+static constexpr int decode_size = 4 * util::phash_source_size;
+
+/// Hash distance is weighted to be comparable with histogram distance, which is up to 510.
+static constexpr int phash_weight = 4;
+
+static constexpr quint32 index_magic = 0x57545349; // "WTSI"
+static constexpr quint32 index_version = 1;
+
+//------------------------------------------------------------------------------
+
+ImageDescriptor ImageDescriptor::fromImage(const QImage& image)
+{
+	using namespace util::resample;
+	ImageDescriptor res;
+	const QImage small = scaled(image, QSize(util::phash_source_size, util::phash_source_size), Filter::Box, 1);
+	if(small.isNull())
+		return res;
+
+	std::array<int, histogram_bins> counts{};
+	for(int y = 0; y < small.height(); ++y) {
+		const auto line = reinterpret_cast<const QRgb*>(small.constScanLine(y));
+		for(int x = 0; x < small.width(); ++x)
+			++counts[static_cast<size_t>((qRed(line[x]) >> 6) << 4 | (qGreen(line[x]) >> 6) << 2 | qBlue(line[x]) >> 6)];
+	}
+
+	const int pixels = small.width() * small.height();
+	for(size_t i = 0; i < counts.size(); ++i)
+		res.histogram[i] = static_cast<uint8_t>((counts[i] * 255 + pixels / 2) / pixels);
+	res.phash = util::phash(small);
+	return res;
+}
+
+int ImageDescriptor::distance(const ImageDescriptor& other) const
+{
+	int res = 0;
+	for(size_t i = 0; i < histogram.size(); ++i)
+		res += std::abs(histogram[i] - other.histogram[i]);
+	return res + phash_weight * util::hamming_distance(phash, other.phash);
+}
+
+//------------------------------------------------------------------------------
+
+/// Task for loading saved index in background.
+struct LoadIndexTask : public QRunnable
+{
+	LoadIndexTask(TagSuggester* s, const QString& p) : suggester(s), path(p)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		suggester->loadThreadFunc(path);
+	}
+
+	TagSuggester* suggester;
+	QString       path;
+};
+
+/// Task for indexing part of files in background.
+struct IndexFilesTask : public QRunnable
+{
+	IndexFilesTask(TagSuggester* s, uint64_t g, std::vector<QString>&& f) :
+	        suggester(s), generation(g), files(std::move(f))
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		// NOTE: indexing may take hours, leave the CPU to everything else
+		QThread::currentThread()->setPriority(QThread::IdlePriority);
+		suggester->indexThreadFunc(generation, files);
+		QThread::currentThread()->setPriority(QThread::NormalPriority);
+	}
+
+	TagSuggester* suggester;
+	uint64_t      generation;
+	std::vector<QString> files;
+};
+
+/// Task for describing file suggestions were requested for.
+struct DescribeFileTask : public QRunnable
+{
+	DescribeFileTask(TagSuggester* s, const QString& f) : suggester(s), file(f)
+	{
+		setAutoDelete(true);
+	}
+
+	void run() override
+	{
+		suggester->describeThreadFunc(file);
+	}
+
+	TagSuggester* suggester;
+	QString       file;
+};
+
+TagSuggester::TagSuggester()
+{
+	// NOTE: idle priority sticks to threads on Linux, so indexing threads are not shared with other tasks
+	m_index_pool.setMaxThreadCount(std::max(QThread::idealThreadCount() / 2, 1));
+	m_thread_pool.setMaxThreadCount(1);
+}
+
+TagSuggester::~TagSuggester()
+{
+	m_shutting_down = true;
+	cancel();
+	m_index_pool.waitForDone();
+	m_thread_pool.waitForDone();
+	save();
+}
+
+void TagSuggester::setImageCache(const ImageCache* cache)
+{
+	m_cache = cache;
+}
+
+void TagSuggester::setIndexPath(const QString& path)
+{
+	m_index_path = path;
+}
+
+bool TagSuggester::index_loaded()
+{
+	if(m_loaded || m_index_path.isEmpty())
+		return true;
+
+	if(!m_loading) {
+		m_loading = true;
+		m_thread_pool.start(new LoadIndexTask(this, m_index_path));
+	}
+	return false;
+}
+
+void TagSuggester::indexFiles(const std::vector<QString>& files)
+{
+	cancel();
+	if(!index_loaded()) {
+		m_pending_files = files;
+		return;
+	}
+
+	std::vector<QString> remaining;
+	for(const auto& f : files) {
+		if(!m_items.contains(f))
+			remaining.push_back(f);
+	}
+	if(remaining.empty())
+		return;
+
+	const auto generation = m_generation.load();
+	m_total = static_cast<int>(remaining.size());
+	m_indexed = 0;
+	m_running_tasks = 0;
+	for(size_t begin = 0; begin < remaining.size(); begin += task_size) {
+		const auto first = std::next(remaining.begin(), static_cast<ptrdiff_t>(begin));
+		const auto last = std::next(remaining.begin(), static_cast<ptrdiff_t>(std::min(begin + task_size, remaining.size())));
+		m_index_pool.start(new IndexFilesTask(this, generation, std::vector<QString>(first, last)));
+		++m_running_tasks;
+	}
+	pdbg << "indexing" << m_total << "files in" << m_running_tasks << "tasks";
+}
+
+void TagSuggester::cancel()
+{
+	++m_generation;
+	m_index_pool.clear();
+	m_running_tasks = 0;
+	m_pending_files.clear();
+
+	QMutexLocker _{&m_results_lock};
+	m_results.clear();
+	m_finished_tasks = 0;
+}
+
+bool TagSuggester::isRunning() const
+{
+	return m_running_tasks != 0 || !m_pending_files.empty();
+}
+
+size_t TagSuggester::size() const
+{
+	return m_entries.size();
+}
+
+void TagSuggester::renameFile(const QString& from, const QString& to)
+{
+	const auto it = m_items.find(from);
+	if(it == m_items.end())
+		return;
+
+	const auto item = it.value();
+	m_items.erase(it);
+	m_items.insert(to, item);
+	if(item == not_an_image)
+		return;
+
+	auto& entry = m_entries[item];
+	entry.file = to;
+	entry.tags = tag_ids(fileTags(to));
+	m_modified = true;
+}
+
+void TagSuggester::requestSuggestions(const QString& file)
+{
+	m_requested_file = file;
+	if(!index_loaded())
+		return;
+
+	const auto item = m_items.value(file, not_an_image);
+	if(item != not_an_image) {
+		emit suggestionsReady(file, suggestions(m_descriptors[item], file));
+		return;
+	}
+	if(m_items.contains(file)) {
+		emit suggestionsReady(file, {});
+		return;
+	}
+
+	// NOTE: runs in its own pool at normal priority, so it does not wait for indexing tasks
+	m_thread_pool.start(new DescribeFileTask(this, file));
+}
+
+std::vector<TagSuggester::Suggestion> TagSuggester::suggestions(const ImageDescriptor& descriptor,
+                                                                const QString& exclude_file,
+                                                                int neighbours) const
+{
+	if(neighbours <= 0)
+		return {};
+
+	const auto exclude = m_items.value(exclude_file, not_an_image);
+
+	// max-heap of nearest tagged images by distance
+	using Neighbour = std::pair<int, uint32_t>;
+	std::vector<Neighbour> nearest;
+	nearest.reserve(static_cast<size_t>(neighbours) + 1);
+	for(uint32_t i = 0; i < m_descriptors.size(); ++i) {
+		if(i == exclude || m_entries[i].tags.empty())
+			continue;
+
+		const int d = descriptor.distance(m_descriptors[i]);
+		if(nearest.size() < static_cast<size_t>(neighbours)) {
+			nearest.emplace_back(d, i);
+			std::push_heap(nearest.begin(), nearest.end());
+		} else if(d < nearest.front().first) {
+			std::pop_heap(nearest.begin(), nearest.end());
+			nearest.back() = Neighbour(d, i);
+			std::push_heap(nearest.begin(), nearest.end());
+		}
+	}
+
+	QHash<uint32_t, int> votes;
+	for(const auto& n : nearest) {
+		for(auto tag : m_entries[n.second].tags)
+			++votes[tag];
+	}
+
+	std::vector<Suggestion> res;
+	for(auto it = votes.begin(); it != votes.end(); ++it) {
+		if(it.value() >= min_votes)
+			res.push_back(Suggestion{m_tag_names[it.key()], it.value()});
+	}
+	std::sort(res.begin(), res.end(), [](const Suggestion& a, const Suggestion& b)
+	{
+		return a.votes > b.votes || (a.votes == b.votes && a.tag < b.tag);
+	});
+	return res;
+}
+
+bool TagSuggester::save()
+{
+	// NOTE: index that was not loaded completely must not overwrite the saved one
+	if(!m_modified || m_index_path.isEmpty() || !m_loaded)
+		return true;
+
+	QSaveFile file(m_index_path);
+	if(!file.open(QIODevice::WriteOnly)) {
+		pwarn << "could not open" << m_index_path << "for writing:" << file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << index_magic << index_version << static_cast<quint32>(m_entries.size());
+	for(size_t i = 0; i < m_entries.size(); ++i) {
+		const auto& e = m_entries[i];
+		const auto& d = m_descriptors[i];
+		stream << e.file << e.file_size << e.modified << static_cast<quint64>(d.phash);
+		stream.writeRawData(reinterpret_cast<const char*>(d.histogram.data()), static_cast<int>(d.histogram.size()));
+	}
+
+	if(stream.status() != QDataStream::Ok || !file.commit()) {
+		pwarn << "could not write" << m_index_path;
+		return false;
+	}
+	m_modified = false;
+	pdbg << "saved" << m_entries.size() << "images to" << m_index_path;
+	return true;
+}
+
+QStringList TagSuggester::fileTags(const QString& file)
+{
+	auto tags = util::split(QFileInfo(file).completeBaseName());
+
+	auto begin = tags.begin(), id = begin;
+	if(ib::find_imageboard_tags(begin, tags.end(), begin, id)) {
+		for(auto it = begin; it != std::next(id); ++it)
+			it->clear();
+	}
+	begin = tags.begin();
+	while(ib::find_short_imageboard_tag(begin, tags.end(), begin)) {
+		begin->clear();
+		begin = std::next(begin);
+	}
+
+	tags.removeAll(QString());
+	tags.removeDuplicates();
+	return tags;
+}
+
+void TagSuggester::loadThreadFunc(const QString& path)
+{
+	std::vector<IndexResult> results;
+	QFile file(path);
+	if(file.open(QIODevice::ReadOnly)) {
+		QDataStream stream(&file);
+		stream.setVersion(QDataStream::Qt_5_6);
+		quint32 magic = 0, version = 0, count = 0;
+		stream >> magic >> version >> count;
+		if(magic != index_magic || version != index_version) {
+			pwarn << "ignoring index" << path << "of unknown version";
+			count = 0;
+		}
+
+		for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+			if(m_shutting_down)
+				return;
+
+			IndexResult r;
+			quint64 phash = 0;
+			stream >> r.file >> r.file_size >> r.modified >> phash;
+			r.descriptor.phash = phash;
+			stream.readRawData(reinterpret_cast<char*>(r.descriptor.histogram.data()),
+			                   static_cast<int>(r.descriptor.histogram.size()));
+
+			// files modified since are indexed again, removed files are dropped
+			const QFileInfo fi(r.file);
+			if(!fi.exists() || fi.size() != r.file_size || fi.lastModified().toMSecsSinceEpoch() != r.modified)
+				continue;
+
+			r.tags = fileTags(r.file);
+			r.valid = true;
+			results.push_back(std::move(r));
+		}
+		if(stream.status() != QDataStream::Ok)
+			pwarn << "index" << path << "is truncated";
+	}
+
+	{
+		QMutexLocker _{&m_results_lock};
+		m_loaded_results = std::move(results);
+	}
+	QMetaObject::invokeMethod(this, "applyLoadedIndex", Qt::QueuedConnection);
+}
+
+void TagSuggester::indexThreadFunc(uint64_t generation, const std::vector<QString>& files)
+{
+	std::vector<IndexResult> results;
+	results.reserve(files.size());
+	for(const auto& f : files) {
+		if(m_generation != generation)
+			return;
+		IndexResult r;
+		r.valid = describeFile(f, &r);
+		results.push_back(std::move(r));
+	}
+
+	{
+		QMutexLocker _{&m_results_lock};
+		if(m_generation != generation)
+			return;
+		std::move(results.begin(), results.end(), std::back_inserter(m_results));
+		++m_finished_tasks;
+	}
+	QMetaObject::invokeMethod(this, "applyIndexResults", Qt::QueuedConnection);
+}
+
+void TagSuggester::describeThreadFunc(const QString& file)
+{
+	IndexResult r;
+	r.valid = describeFile(file, &r);
+	{
+		QMutexLocker _{&m_results_lock};
+		m_described.push_back(std::move(r));
+	}
+	QMetaObject::invokeMethod(this, "applySuggestionRequest", Qt::QueuedConnection);
+}
+
+bool TagSuggester::describeFile(const QString& file, IndexResult* result) const
+{
+	result->file = file;
+	const QFileInfo fi(file);
+	result->file_size = fi.size();
+	result->modified = fi.lastModified().toMSecsSinceEpoch();
+
+	const QImage image = ImageCache::reducedImage(m_cache, file, QSize(util::phash_source_size, util::phash_source_size),
+	                                              QSize(decode_size, decode_size));
+	if(image.isNull())
+		return false;
+
+	result->tags = fileTags(file);
+	result->descriptor = ImageDescriptor::fromImage(image);
+	return true;
+}
+
+void TagSuggester::addEntry(const IndexResult& result)
+{
+	if(m_items.contains(result.file))
+		return;
+
+	if(!result.valid) {
+		m_items.insert(result.file, not_an_image);
+		return;
+	}
+
+	m_items.insert(result.file, static_cast<uint32_t>(m_entries.size()));
+	m_entries.push_back(Entry{result.file, result.file_size, result.modified, tag_ids(result.tags)});
+	m_descriptors.push_back(result.descriptor);
+}
+
+std::vector<uint32_t> TagSuggester::tag_ids(const QStringList& tags)
+{
+	std::vector<uint32_t> res;
+	res.reserve(static_cast<size_t>(tags.size()));
+	for(const auto& tag : tags) {
+		auto it = m_tag_ids.find(tag);
+		if(it == m_tag_ids.end()) {
+			it = m_tag_ids.insert(tag, static_cast<uint32_t>(m_tag_names.size()));
+			m_tag_names.push_back(tag);
+		}
+		res.push_back(it.value());
+	}
+	return res;
+}
+
+void TagSuggester::applyLoadedIndex()
+{
+	std::vector<IndexResult> results;
+	{
+		QMutexLocker _{&m_results_lock};
+		std::swap(results, m_loaded_results);
+	}
+
+	m_items.reserve(static_cast<int>(results.size()));
+	m_entries.reserve(results.size());
+	m_descriptors.reserve(results.size());
+	for(const auto& r : results)
+		addEntry(r);
+	m_loading = false;
+	m_loaded = true;
+	pdbg << "loaded" << m_entries.size() << "images from" << m_index_path;
+
+	auto pending = std::move(m_pending_files);
+	m_pending_files.clear();
+	if(!pending.empty())
+		indexFiles(pending);
+	if(!m_requested_file.isEmpty())
+		requestSuggestions(m_requested_file);
+}
+
+void TagSuggester::applyIndexResults()
+{
+	std::vector<IndexResult> results;
+	int finished_tasks;
+	{
+		QMutexLocker _{&m_results_lock};
+		std::swap(results, m_results);
+		finished_tasks = m_finished_tasks;
+	}
+	if(m_running_tasks == 0)
+		return; // cancelled meanwhile
+
+	for(const auto& r : results)
+		addEntry(r);
+	m_indexed += static_cast<int>(results.size());
+	m_modified = m_modified || !results.empty();
+	if(!results.empty())
+		emit progress(m_indexed, m_total);
+
+	if(finished_tasks == m_running_tasks) {
+		pdbg << "indexed" << m_indexed << "files," << m_entries.size() << "images in total";
+		m_running_tasks = 0;
+		save();
+		emit finished();
+	}
+}
+
+void TagSuggester::applySuggestionRequest()
+{
+	std::vector<IndexResult> results;
+	{
+		QMutexLocker _{&m_results_lock};
+		std::swap(results, m_described);
+	}
+
+	for(const auto& r : results) {
+		m_modified = m_modified || (r.valid && !m_items.contains(r.file));
+		addEntry(r);
+		if(r.file == m_requested_file)
+			emit suggestionsReady(r.file, r.valid ? suggestions(r.descriptor, r.file) : std::vector<Suggestion>());
+	}
+}
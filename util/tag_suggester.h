@@ -0,0 +1,209 @@
+/* Copyright © 2026 cat <cat@wolfgirl.org>
+ * This program is free software. It comes without any warranty, to the extent
+ * permitted by applicable law. You can redistribute it and/or modify it under
+ * the terms of the Do What The Fuck You Want To Public License, Version 2, as
+ * published by Sam Hocevar. See http://www.wtfpl.net/ for more details.
+ */
+
+#ifndef UTIL_TAG_SUGGESTER_H
+#define UTIL_TAG_SUGGESTER_H
+
+/**
+ * \file tag_suggester.h
+ * \brief Classes \ref ImageDescriptor and \ref TagSuggester
+ */
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class ImageCache;
+
+/*!
+ * \brief Compact visual descriptor of image: perceptual hash and color histogram.
+ *
+ * Takes 72 bytes, so a million descriptors are compared in a few milliseconds.
+ */
+struct ImageDescriptor
+{
+	/// Number of color histogram bins, 4 levels of each RGB channel.
+	static constexpr int histogram_bins = 64;
+
+	uint64_t phash = 0; ///< See \ref util::phash().
+	std::array<uint8_t, histogram_bins> histogram{}; ///< Fraction of pixels in each bin, scaled to 255.
+
+	/// Descriptor of \p image.
+	static ImageDescriptor fromImage(const QImage& image);
+
+	/// Dissimilarity of images, 0 for identical images.
+	int distance(const ImageDescriptor& other) const;
+};
+
+/*!
+ * \brief Suggests tags from tags of visually similar images.
+ *
+ * Tags are read from file names, so every tagged image is a labelled
+ * example. Files are indexed in background by a thread pool, downscaled
+ * images already in \ref ImageCache are used instead of decoding the file again.
+ *
+ * Suggestions are the tags most common among the nearest tagged images,
+ * found by comparing \ref ImageDescriptor of all tagged images.
+ *
+ * Index is saved to a file, so only new and modified files are indexed
+ * in later sessions.
+ *
+ * \note Member functions must be called from the thread the object lives in.
+ */
+class TagSuggester : public QObject
+{
+	Q_OBJECT
+public:
+	/// Default number of nearest tagged images suggestions are taken from.
+	static constexpr int default_neighbours = 10;
+
+	/// Tags found in fewer nearest images are not suggested.
+	static constexpr int min_votes = 2;
+
+	/// Suggested tag.
+	struct Suggestion
+	{
+		QString tag;
+		int     votes; ///< Number of nearest images having the tag.
+	};
+
+	TagSuggester();
+	~TagSuggester() override;
+
+	/// Use images cached in \p cache when available, may be null.
+	void setImageCache(const ImageCache* cache);
+
+	/*!
+	 * \brief Save index to \p path, and load it from there before indexing.
+	 *
+	 * Index is not saved if \p path is empty.
+	 */
+	void setIndexPath(const QString& path);
+
+	/*!
+	 * \brief Index \p files in background.
+	 *
+	 * Files indexed before are skipped. Replaces files of previous call that
+	 * were not indexed yet.
+	 */
+	void indexFiles(const std::vector<QString>& files);
+
+	/// Stop indexing files, files indexed so far are kept.
+	void cancel();
+
+	/// Are files being indexed.
+	bool isRunning() const;
+
+	/// Number of indexed images.
+	size_t size() const;
+
+	/// Update path and tags of renamed file.
+	void renameFile(const QString& from, const QString& to);
+
+	/*!
+	 * \brief Find suggestions for \p file, emits \ref suggestionsReady().
+	 *
+	 * Files not indexed yet are indexed in background first.
+	 */
+	void requestSuggestions(const QString& file);
+
+	/// Tags of \p neighbours tagged images nearest to \p descriptor, except \p exclude_file, by votes.
+	std::vector<Suggestion> suggestions(const ImageDescriptor& descriptor, const QString& exclude_file,
+	                                    int neighbours = default_neighbours) const;
+
+	/// Write index to path set with \ref setIndexPath(), if it was changed.
+	bool save();
+
+	/// Tags in name of \p file, without imageboard ids.
+	static QStringList fileTags(const QString& file);
+
+signals:
+	/// Emitted as files are indexed.
+	void progress(int indexed, int total);
+
+	/// Emitted when all files passed to \ref indexFiles() are indexed.
+	void finished();
+
+	/// Emitted when suggestions requested by \ref requestSuggestions() were found.
+	void suggestionsReady(const QString& file, const std::vector<TagSuggester::Suggestion>& suggestions);
+
+private slots:
+	void applyLoadedIndex();
+	void applyIndexResults();
+	void applySuggestionRequest();
+
+private:
+	friend struct LoadIndexTask;
+	friend struct IndexFilesTask;
+	friend struct DescribeFileTask;
+
+	/// Indexed file, by index of its descriptor.
+	struct Entry
+	{
+		QString file;
+		qint64  file_size = -1;
+		qint64  modified  = 0;
+		std::vector<uint32_t> tags; ///< Into \p m_tag_names.
+	};
+
+	/// File described by worker thread.
+	struct IndexResult
+	{
+		QString     file;
+		qint64      file_size = -1;
+		qint64      modified  = 0;
+		QStringList tags;
+		ImageDescriptor descriptor;
+		bool        valid = false; ///< Could the file be decoded.
+	};
+
+	void loadThreadFunc(const QString& path);
+	void indexThreadFunc(uint64_t generation, const std::vector<QString>& files);
+	void describeThreadFunc(const QString& file);
+	bool describeFile(const QString& file, IndexResult* result) const;
+	void addEntry(const IndexResult& result);
+	std::vector<uint32_t> tag_ids(const QStringList& tags);
+	bool index_loaded(); ///< Starts loading index if it was not loaded.
+
+	static constexpr uint32_t not_an_image = UINT32_MAX;
+
+	QHash<QString, uint32_t>     m_items; ///< Index into \p m_entries, or \p not_an_image.
+	std::vector<Entry>           m_entries;
+	std::vector<ImageDescriptor> m_descriptors;
+	QHash<QString, uint32_t>     m_tag_ids;
+	std::vector<QString>         m_tag_names;
+
+	const ImageCache*     m_cache = nullptr;
+	QString               m_index_path;
+	bool                  m_loading = false;
+	bool                  m_loaded = false;
+	bool                  m_modified = false;
+	std::vector<QString>  m_pending_files; ///< Passed to \ref indexFiles() while index is loaded.
+	QString               m_requested_file; ///< Last file passed to \ref requestSuggestions().
+	std::atomic<uint64_t> m_generation{0};
+	std::atomic<bool>     m_shutting_down{false};
+	int                   m_total = 0;
+	int                   m_indexed = 0;
+	int                   m_running_tasks = 0;
+
+	QMutex      m_results_lock;
+	std::vector<IndexResult> m_loaded_results;   ///< Guarded by \p m_results_lock.
+	std::vector<IndexResult> m_results;          ///< Guarded by \p m_results_lock.
+	int                      m_finished_tasks = 0; ///< Guarded by \p m_results_lock.
+	std::vector<IndexResult> m_described;        ///< Guarded by \p m_results_lock.
+	QThreadPool m_index_pool;  ///< Runs \ref indexFiles() tasks at idle priority.
+	QThreadPool m_thread_pool; ///< Runs index loading and \ref requestSuggestions() tasks.
+};
+
+#endif // UTIL_TAG_SUGGESTER_H